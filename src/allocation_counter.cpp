@@ -0,0 +1,68 @@
+#include "allocation_counter.hpp"
+
+#ifdef COUNT_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+
+    void* counted_allocation(std::size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+
+        // malloc(0) may return null, operator new may not
+        if(auto pointer = std::malloc(size ? size : 1)) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+}
+
+// The nothrow and sized forms forward to these by default
+void* operator new(std::size_t size) {
+    return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size) {
+    return counted_allocation(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace AllocationCounter {
+    bool is_enabled() {
+        return true;
+    }
+
+    AllocationStats get_stats() {
+        return AllocationStats{allocations.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed)};
+    }
+}
+#else
+namespace AllocationCounter {
+    bool is_enabled() {
+        return false;
+    }
+
+    AllocationStats get_stats() {
+        return AllocationStats{0, 0};
+    }
+}
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+struct AllocationStats {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+// Counts heap allocations made through the global operator new, across all
+// threads. Only builds configured with -DCOUNT_ALLOCATIONS=ON replace the
+// operator, everywhere else the counts stay at zero and is_enabled() says so.
+namespace AllocationCounter {
+    bool is_enabled();
+
+    // Totals since startup
+    AllocationStats get_stats();
+}
+
+// Measures the allocations made between construction and get_stats()
+class AllocationScope {
+public:
+    AllocationScope() : m_start(AllocationCounter::get_stats()) {}
+
+    AllocationStats get_stats() const {
+        auto now = AllocationCounter::get_stats();
+        return AllocationStats{now.allocations - m_start.allocations, now.bytes - m_start.bytes};
+    }
+
+private:
+    AllocationStats m_start;
+};
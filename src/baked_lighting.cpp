@@ -0,0 +1,257 @@
+#include "baked_lighting.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "job_system.hpp"
+#include "terrain_query.hpp"
+
+namespace {
+    // Samples a side per job
+    constexpr unsigned int TILE_SIZE = 64;
+
+    // Width of the sun's shadow edge, as a difference of elevation angle
+    // tangents, about 3 degrees near the horizon
+    constexpr float PENUMBRA = 0.05f;
+
+    // Searches step one sample at a time up close, where the horizon is
+    // usually found, then further apart
+    constexpr float UNIT_STEPS = 8.0f;
+    constexpr float STEP_GROWTH = 1.25f;
+
+    // One point of a horizon search, relative to the sample searched from
+    struct Step {
+        // To the cell the point falls in, in the padded grid
+        std::ptrdiff_t offset;
+        float fx;
+        float fz;
+        float inverse_distance;
+    };
+
+    std::vector<Step> make_steps(const glm::vec2 direction, const float max_distance, const unsigned int row) {
+        std::vector<Step> steps;
+        for(auto distance = 1.0f; distance <= max_distance; distance = distance < UNIT_STEPS ? distance + 1.0f : distance * STEP_GROWTH) {
+            auto point = direction * distance;
+            auto cell = glm::vec2(std::floor(point.x), std::floor(point.y));
+            steps.push_back(Step {
+                static_cast<std::ptrdiff_t>(cell.y) * row + static_cast<std::ptrdiff_t>(cell.x),
+                point.x - cell.x,
+                point.y - cell.y,
+                1.0f / distance
+            });
+        }
+        return steps;
+    }
+
+    // Tangent of the steepest rise seen from sample along steps
+    float horizon(const float* sample, const std::vector<Step>& steps, const std::ptrdiff_t row) {
+        auto steepest = -std::numeric_limits<float>::infinity();
+        for(auto& step : steps) {
+            auto cell = sample + step.offset;
+            auto near = cell[0] + (cell[1] - cell[0]) * step.fx;
+            auto far = cell[row] + (cell[row + 1] - cell[row]) * step.fx;
+            auto height = near + (far - near) * step.fz;
+            steepest = std::max(steepest, (height - sample[0]) * step.inverse_distance);
+        }
+        return steepest;
+    }
+
+    float sky_occlusion(const float tangent) {
+        auto rise = std::max(tangent, 0.0f);
+        return rise / std::sqrt(1.0f + rise * rise);
+    }
+
+    float sun_visibility(const float tangent, const float sun_tangent) {
+        return std::clamp((sun_tangent - tangent) / PENUMBRA + 0.5f, 0.0f, 1.0f);
+    }
+
+#ifdef __SSE2__
+    // horizon() of sample[0] to sample[3] at once, the same step reads the
+    // same neighbours of each
+    __m128 horizon4(const float* sample, const std::vector<Step>& steps, const std::ptrdiff_t row) {
+        auto origin = _mm_loadu_ps(sample);
+        auto steepest = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+        for(auto& step : steps) {
+            auto cell = sample + step.offset;
+            auto fx = _mm_set1_ps(step.fx);
+            auto h00 = _mm_loadu_ps(cell);
+            auto h10 = _mm_loadu_ps(cell + 1);
+            auto h01 = _mm_loadu_ps(cell + row);
+            auto h11 = _mm_loadu_ps(cell + row + 1);
+            auto near = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fx));
+            auto far = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), fx));
+            auto height = _mm_add_ps(near, _mm_mul_ps(_mm_sub_ps(far, near), _mm_set1_ps(step.fz)));
+            steepest = _mm_max_ps(steepest, _mm_mul_ps(_mm_sub_ps(height, origin), _mm_set1_ps(step.inverse_distance)));
+        }
+        return steepest;
+    }
+
+    __m128 sky_occlusion4(const __m128 tangent) {
+        auto rise = _mm_max_ps(tangent, _mm_setzero_ps());
+        return _mm_div_ps(rise, _mm_sqrt_ps(_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(rise, rise))));
+    }
+
+    __m128 sun_visibility4(const __m128 tangent, const float sun_tangent) {
+        auto visibility = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(sun_tangent), tangent), _mm_set1_ps(1.0f / PENUMBRA)), _mm_set1_ps(0.5f));
+        return _mm_min_ps(_mm_max_ps(visibility, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    }
+#endif
+
+    uint8_t to_unorm8(const float value) {
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+}
+
+BakedLighting::BakedLighting()
+    : BakedLighting(0, 0, glm::vec2(0.0f, 0.0f))
+{
+}
+
+BakedLighting::BakedLighting(const unsigned int width, const unsigned int depth, const glm::vec2 origin)
+    : m_width(width),
+      m_depth(depth),
+      m_origin(origin),
+      m_sun_direction(0.0f, 1.0f, 0.0f),
+      m_texels(static_cast<std::size_t>(width) * depth * 2, 255),
+      m_bake_ms(0.0)
+{
+}
+
+BakedLighting BakedLighting::bake(const TerrainQuery& terrain, const LightingBakeSettings& settings, JobSystem& jobs) {
+    auto start = std::chrono::steady_clock::now();
+
+    auto width = terrain.get_width();
+    auto depth = terrain.get_depth();
+    auto& heights = terrain.get_samples();
+
+    BakedLighting lighting(width, depth, terrain.get_origin());
+    lighting.m_sun_direction = settings.sun_direction;
+
+    // Searches run past the edges into a border of clamped heights, which
+    // spares every read a bounds check
+    auto max_distance = std::max(settings.max_distance, 1.0f);
+    auto pad = static_cast<unsigned int>(std::ceil(max_distance)) + 2;
+    auto row = static_cast<std::ptrdiff_t>(width + 2 * pad);
+    std::vector<float> padded(static_cast<std::size_t>(row) * (depth + 2 * pad));
+    for(auto z = 0u; z < depth + 2 * pad; z++) {
+        auto source_z = std::min(static_cast<unsigned int>(std::max(static_cast<int>(z) - static_cast<int>(pad), 0)), depth - 1);
+        auto source = heights.data() + static_cast<std::size_t>(source_z) * width;
+        auto target = padded.data() + z * row;
+        std::fill(target, target + pad, source[0]);
+        std::copy(source, source + width, target + pad);
+        std::fill(target + pad + width, target + row, source[width - 1]);
+    }
+
+    auto directions = std::max(settings.directions, 1u);
+    std::vector<std::vector<Step>> sky_steps;
+    for(auto direction = 0u; direction < directions; direction++) {
+        auto angle = 2.0f * 3.14159265f * direction / directions;
+        sky_steps.push_back(make_steps(glm::vec2(std::cos(angle), std::sin(angle)), max_distance, row));
+    }
+
+    // A sun straight overhead lights everything, one below the horizon
+    // nothing. Otherwise the search runs along its azimuth.
+    auto sun_across = glm::length(glm::vec2(settings.sun_direction.x, settings.sun_direction.z));
+    auto sun_tangent = settings.sun_direction.y > 0.0f ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+    std::vector<Step> sun_steps;
+    if(sun_across > 1e-4f && settings.sun_direction.y > 0.0f) {
+        sun_tangent = settings.sun_direction.y / sun_across;
+        sun_steps = make_steps(glm::vec2(settings.sun_direction.x, settings.sun_direction.z) / sun_across, max_distance, row);
+    }
+
+    auto inverse_directions = 1.0f / directions;
+    auto bake_tile = [&](unsigned int tile_x, unsigned int tile_z) {
+        auto end_x = std::min(tile_x + TILE_SIZE, width);
+        auto end_z = std::min(tile_z + TILE_SIZE, depth);
+        for(auto z = tile_z; z < end_z; z++) {
+            auto samples = padded.data() + (z + pad) * row + pad;
+            auto texels = lighting.m_texels.data() + (static_cast<std::size_t>(z) * width) * 2;
+
+            auto x = tile_x;
+#ifdef __SSE2__
+            alignas(16) float ambient[4];
+            alignas(16) float sun[4];
+            for(; x + 4 <= end_x; x += 4) {
+                auto occlusion = _mm_setzero_ps();
+                for(auto& steps : sky_steps) {
+                    occlusion = _mm_add_ps(occlusion, sky_occlusion4(horizon4(samples + x, steps, row)));
+                }
+                _mm_store_ps(ambient, _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(occlusion, _mm_set1_ps(inverse_directions))));
+
+                auto sun_horizon = sun_steps.empty() ? _mm_setzero_ps() : horizon4(samples + x, sun_steps, row);
+                _mm_store_ps(sun, sun_visibility4(sun_horizon, sun_tangent));
+
+                for(auto lane = 0u; lane < 4; lane++) {
+                    texels[(x + lane) * 2] = to_unorm8(ambient[lane]);
+                    texels[(x + lane) * 2 + 1] = to_unorm8(sun[lane]);
+                }
+            }
+#endif
+
+            for(; x < end_x; x++) {
+                auto occlusion = 0.0f;
+                for(auto& steps : sky_steps) {
+                    occlusion += sky_occlusion(horizon(samples + x, steps, row));
+                }
+
+                auto sun_horizon = sun_steps.empty() ? 0.0f : horizon(samples + x, sun_steps, row);
+                texels[x * 2] = to_unorm8(1.0f - occlusion * inverse_directions);
+                texels[x * 2 + 1] = to_unorm8(sun_visibility(sun_horizon, sun_tangent));
+            }
+        }
+    };
+
+    std::vector<JobHandle> tiles;
+    for(auto tile_z = 0u; tile_z < depth; tile_z += TILE_SIZE) {
+        for(auto tile_x = 0u; tile_x < width; tile_x += TILE_SIZE) {
+            tiles.push_back(jobs.submit([&bake_tile, tile_x, tile_z] {
+                bake_tile(tile_x, tile_z);
+            }, JobPriority::IMMEDIATE));
+        }
+    }
+
+    for(auto& tile : tiles) {
+        jobs.wait(tile);
+    }
+
+    lighting.m_bake_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return lighting;
+}
+
+float BakedLighting::get_ambient(const unsigned int x, const unsigned int z) const {
+    return m_texels[(static_cast<std::size_t>(z) * m_width + x) * 2] / 255.0f;
+}
+
+float BakedLighting::get_sun(const unsigned int x, const unsigned int z) const {
+    return m_texels[(static_cast<std::size_t>(z) * m_width + x) * 2 + 1] / 255.0f;
+}
+
+unsigned int BakedLighting::get_width() const {
+    return m_width;
+}
+
+unsigned int BakedLighting::get_depth() const {
+    return m_depth;
+}
+
+glm::vec2 BakedLighting::get_origin() const {
+    return m_origin;
+}
+
+glm::vec3 BakedLighting::get_sun_direction() const {
+    return m_sun_direction;
+}
+
+const std::vector<uint8_t>& BakedLighting::get_texels() const {
+    return m_texels;
+}
+
+double BakedLighting::get_bake_ms() const {
+    return m_bake_ms;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+class JobSystem;
+class TerrainQuery;
+
+struct LightingBakeSettings {
+    // Towards the sun, need not be normalized. A sun at or below the
+    // horizon shadows everything.
+    glm::vec3 sun_direction = glm::vec3(-0.6f, 0.45f, -0.35f);
+
+    // Azimuths the ambient occlusion horizon is searched along
+    unsigned int directions = 8;
+
+    // Horizontal reach of the horizon searches, in samples
+    float max_distance = 32.0f;
+};
+
+// Ambient occlusion and sun shadows baked from a TerrainQuery, two bytes per
+// sample: how much of the sky a sample sees and how much of the sun. Both
+// come from horizon angles, the steepest rise of the terrain seen from a
+// sample in some direction. Laid out as RG8 texels, row major, so that the
+// map can be uploaded as it is and filtered by the shader.
+class BakedLighting {
+public:
+    BakedLighting();
+    BakedLighting(const unsigned int width, const unsigned int depth, const glm::vec2 origin);
+
+    // Ambient visibility is one minus the mean sine of the horizon angle
+    // over settings.directions azimuths. Sun visibility compares the
+    // horizon angle towards the sun with the sun's elevation, over a
+    // penumbra of a few degrees. Rows are split into tiles over the job
+    // system, and four neighbouring samples are scanned at once with SSE2:
+    // along a fixed direction they read neighbouring heights.
+    static BakedLighting bake(const TerrainQuery& terrain, const LightingBakeSettings& settings, JobSystem& jobs);
+
+    // Both in [0, 1]
+    float get_ambient(const unsigned int x, const unsigned int z) const;
+    float get_sun(const unsigned int x, const unsigned int z) const;
+
+    unsigned int get_width() const;
+    unsigned int get_depth() const;
+    glm::vec2 get_origin() const;
+    glm::vec3 get_sun_direction() const;
+
+    // Ambient in the even bytes, sun in the odd ones
+    const std::vector<uint8_t>& get_texels() const;
+
+    double get_bake_ms() const;
+
+private:
+    unsigned int m_width;
+    unsigned int m_depth;
+    glm::vec2 m_origin;
+    glm::vec3 m_sun_direction;
+    std::vector<uint8_t> m_texels;
+    double m_bake_ms;
+};
@@ -0,0 +1,238 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    std::string escape(const std::string& value) {
+        std::string escaped;
+        for(auto c : value) {
+            if(c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    void write_summary(std::ostream& stream, const char *name, const TimingSummary& summary) {
+        stream << "  \"" << name << "\": {"
+               << "\"count\": " << summary.count << ", "
+               << "\"mean\": " << summary.mean << ", "
+               << "\"p50\": " << summary.p50 << ", "
+               << "\"p95\": " << summary.p95 << ", "
+               << "\"p99\": " << summary.p99 << ", "
+               << "\"max\": " << summary.max << "}";
+    }
+
+    // Flattens the report's objects into "section.key" entries
+    class ReportParser {
+    public:
+        explicit ReportParser(const std::string& text) : m_text(text), m_position(0) {}
+
+        std::map<std::string, std::string> parse() {
+            std::map<std::string, std::string> values;
+            parse_object("", values);
+            return values;
+        }
+
+    private:
+        void parse_object(const std::string& prefix, std::map<std::string, std::string>& values) {
+            expect('{');
+            if(peek() == '}') {
+                m_position++;
+                return;
+            }
+
+            while(true) {
+                auto key = prefix + parse_string();
+                expect(':');
+
+                if(peek() == '{') {
+                    parse_object(key + ".", values);
+                } else if(peek() == '"') {
+                    values[key] = parse_string();
+                } else {
+                    values[key] = parse_number();
+                }
+
+                if(peek() == ',') {
+                    m_position++;
+                    continue;
+                }
+
+                expect('}');
+                return;
+            }
+        }
+
+        std::string parse_string() {
+            expect('"');
+            std::string value;
+            while(m_position < m_text.size() && m_text[m_position] != '"') {
+                if(m_text[m_position] == '\\') {
+                    m_position++;
+                }
+                if(m_position < m_text.size()) {
+                    value += m_text[m_position++];
+                }
+            }
+            expect('"');
+            return value;
+        }
+
+        std::string parse_number() {
+            auto start = m_position;
+            while(m_position < m_text.size() && (std::isdigit(static_cast<unsigned char>(m_text[m_position])) || std::strchr("+-.eE", m_text[m_position]))) {
+                m_position++;
+            }
+            if(start == m_position) {
+                throw std::runtime_error("Malformed benchmark report: expected a number at offset " + std::to_string(start));
+            }
+            return m_text.substr(start, m_position - start);
+        }
+
+        char peek() {
+            while(m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position]))) {
+                m_position++;
+            }
+            return m_position < m_text.size() ? m_text[m_position] : '\0';
+        }
+
+        void expect(char c) {
+            if(peek() != c) {
+                throw std::runtime_error(std::string("Malformed benchmark report: expected '") + c + "' at offset " + std::to_string(m_position));
+            }
+            m_position++;
+        }
+
+        const std::string& m_text;
+        std::size_t m_position;
+    };
+
+    double number(const std::map<std::string, std::string>& values, const std::string& key) {
+        auto value = values.find(key);
+        if(value == values.end()) {
+            throw std::runtime_error("Benchmark report is missing " + key);
+        }
+        return std::stod(value->second);
+    }
+
+    TimingSummary read_summary(const std::map<std::string, std::string>& values, const std::string& name) {
+        return TimingSummary {
+            static_cast<unsigned int>(number(values, name + ".count")),
+            number(values, name + ".mean"),
+            number(values, name + ".p50"),
+            number(values, name + ".p95"),
+            number(values, name + ".p99"),
+            number(values, name + ".max")
+        };
+    }
+
+    void compare_summary(
+        const char *name,
+        const TimingSummary& baseline,
+        const TimingSummary& current,
+        double threshold,
+        std::vector<std::string>& regressions)
+    {
+        // Nothing to compare against, e.g. a path without settings changes
+        if(baseline.count == 0 || current.count == 0) {
+            return;
+        }
+
+        auto check = [&](const char *percentile, double before, double after) {
+            if(after > before * (1.0 + threshold) && after - before > Benchmark::MIN_REGRESSION_MS) {
+                std::ostringstream message;
+                message << std::fixed << std::setprecision(3)
+                        << name << " " << percentile << " " << before << " ms -> " << after << " ms"
+                        << " (+" << std::setprecision(1) << (before > 0.0 ? (after / before - 1.0) * 100.0 : 100.0) << "%)";
+                regressions.push_back(message.str());
+            }
+        };
+
+        check("p50", baseline.p50, current.p50);
+        check("p95", baseline.p95, current.p95);
+        check("p99", baseline.p99, current.p99);
+        check("max", baseline.max, current.max);
+    }
+}
+
+namespace Benchmark {
+    TimingSummary summarize(std::vector<double> samples) {
+        if(samples.empty()) {
+            return TimingSummary{0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        auto percentile = [&](double fraction) {
+            auto rank = static_cast<std::size_t>(std::ceil(fraction * samples.size()));
+            return samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1];
+        };
+
+        return TimingSummary {
+            static_cast<unsigned int>(samples.size()),
+            std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size(),
+            percentile(0.50),
+            percentile(0.95),
+            percentile(0.99),
+            samples.back()
+        };
+    }
+
+    void write_report(const std::string& path, const BenchmarkReport& report) {
+        std::ofstream file(path);
+        file << std::setprecision(6);
+        file << "{\n"
+             << "  \"name\": \"" << escape(report.name) << "\",\n"
+             << "  \"renderer\": \"" << escape(report.renderer) << "\",\n"
+             << "  \"width\": " << report.width << ",\n"
+             << "  \"height\": " << report.height << ",\n"
+             << "  \"timestep\": " << report.timestep << ",\n";
+        write_summary(file, "frame_ms", report.frame_ms);
+        file << ",\n";
+        write_summary(file, "regeneration_ms", report.regeneration_ms);
+        file << "\n}\n";
+
+        if(!file) {
+            throw std::runtime_error("Failed to write benchmark report " + path);
+        }
+    }
+
+    BenchmarkReport read_report(const std::string& path) {
+        std::ifstream file(path);
+        if(!file) {
+            throw std::runtime_error("Failed to open benchmark report " + path);
+        }
+
+        std::stringstream text;
+        text << file.rdbuf();
+        auto values = ReportParser(text.str()).parse();
+
+        return BenchmarkReport {
+            values["name"],
+            values["renderer"],
+            static_cast<unsigned int>(number(values, "width")),
+            static_cast<unsigned int>(number(values, "height")),
+            number(values, "timestep"),
+            read_summary(values, "frame_ms"),
+            read_summary(values, "regeneration_ms")
+        };
+    }
+
+    std::vector<std::string> compare(const BenchmarkReport& baseline, const BenchmarkReport& current, double threshold) {
+        std::vector<std::string> regressions;
+        compare_summary("frame", baseline.frame_ms, current.frame_ms, threshold, regressions);
+        compare_summary("regeneration", baseline.regeneration_ms, current.regeneration_ms, threshold, regressions);
+        return regressions;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Distribution of one kind of sample, all values in milliseconds
+struct TimingSummary {
+    unsigned int count;
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+struct BenchmarkReport {
+    std::string name;
+    std::string renderer;
+    unsigned int width;
+    unsigned int height;
+    double timestep;
+    TimingSummary frame_ms;
+    TimingSummary regeneration_ms;
+};
+
+// Summaries, JSON reports and baseline comparisons for the flythrough
+// benchmark. Only the fields written by write_report are read back, this is
+// not a general JSON reader.
+namespace Benchmark {
+    // Percentiles use the nearest rank
+    TimingSummary summarize(std::vector<double> samples);
+
+    void write_report(const std::string& path, const BenchmarkReport& report);
+    BenchmarkReport read_report(const std::string& path);
+
+    // Returns a description of every percentile that got slower than the
+    // baseline by more than threshold (0.1 = 10%). Differences below
+    // MIN_REGRESSION_MS are timer noise and never count.
+    constexpr double MIN_REGRESSION_MS = 0.05;
+    std::vector<std::string> compare(const BenchmarkReport& baseline, const BenchmarkReport& current, double threshold);
+}
@@ -112,6 +112,27 @@ public:
         return m_position;
     }
 
+    glm::vec3 get_front() const {
+        return m_front;
+    }
+
+    float get_yaw() const {
+        return m_yaw;
+    }
+
+    float get_pitch() const {
+        return m_pitch;
+    }
+
+    // Places the camera directly, e.g. when replaying a recorded path
+    void set_pose(const glm::vec3& position, float yaw, float pitch) {
+        m_position = position;
+        m_yaw = yaw;
+        m_pitch = pitch;
+
+        update_camera_vectors();
+    }
+
     void process_keyboard(CameraMovement direction, float delta_time) {
         float velocity = m_movement_speed * delta_time;
         if (direction == CameraMovement::FORWARD)
@@ -1,31 +1,21 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <variant>
 #include <vector>
 
 #include <glad/glad.h>
 
-// This is a convenience define that will check for errors after each hidden
-// opengl call, and if GL_CALL_HISTORY is defined, it will also log gl calls 
-// to stdout
-#define API_DUMP 0
-#define GL_CHECK(func) func;                                                \
-if(API_DUMP) {                                                              \
-    std::cout << #func << std::endl;                                        \
-}                                                                           \
-if(GLenum err = glGetError()) {                                             \
-    std::string err_string = "GL ERROR "                                    \
-        + std::to_string(err)                                               \
-        + " at line "                                                       \
-        + std::to_string(__LINE__)                                          \
-        + " in " #func " at "                                               \
-        + std::string(__PRETTY_FUNCTION__);                                 \
-    throw std::runtime_error(err_string);                                   \
-}
-
-using Indices = std::vector<unsigned int>;
+#include "gl_diagnostics.hpp"
+#include "gl_state.hpp"
+#include "gpu_profiler.hpp"
+#include "height_field.hpp"
+#include "vertex_cache.hpp"
 
 enum class VertexDataType {
     FLOAT = GL_FLOAT,
@@ -46,15 +36,18 @@ struct VertexArrayObject {
     }
 
     ~VertexArrayObject() {
-        glDeleteVertexArrays(1, &vao);
+        if(vao) {
+            GlState::forget_vertex_array(vao);
+            glDeleteVertexArrays(1, &vao);
+        }
     }
 
     void bind() const {
-        GL_CHECK(glBindVertexArray(vao));
+        GlState::bind_vertex_array(vao);
     }
 
     void unbind() const {
-        GL_CHECK(glBindVertexArray(0));
+        GlState::bind_vertex_array(0);
     }
 
     VaoInner vao;
@@ -84,10 +77,14 @@ struct VertexBufferObject {
     }
 
     ~VertexBufferObject() {
-        glGenBuffers(1, &vbo);
+        if(vbo) {
+            GlState::forget_buffer(vbo);
+            glDeleteBuffers(1, &vbo);
+        }
     }
 
-    void enable_attribute_pointer(std::size_t index, std::size_t size, VertexDataType t_type, std::size_t stride, std::size_t offset) {
+    // A non-zero divisor advances the attribute per instance instead of per vertex
+    void enable_attribute_pointer(std::size_t index, std::size_t size, VertexDataType t_type, std::size_t stride, std::size_t offset, std::size_t divisor = 0) {
         auto width = 0;
         switch(t_type) {
             case VertexDataType::FLOAT:
@@ -100,10 +97,13 @@ struct VertexBufferObject {
 
         GL_CHECK(glVertexAttribPointer(index, size, static_cast<GLenum>(t_type), GL_FALSE, stride * width, reinterpret_cast<void *>(offset * width)));
         GL_CHECK(glEnableVertexAttribArray(index));
+        if(divisor) {
+            GL_CHECK(glVertexAttribDivisor(index, divisor));
+        }
     }
 
     void bind() const {
-        GL_CHECK(glBindBuffer(static_cast<GLenum>(type), vbo));
+        GlState::bind_buffer(static_cast<GLenum>(type), vbo);
     }
 
     template<typename Type>
@@ -123,14 +123,209 @@ struct VertexBufferObject {
         GL_CHECK(glUnmapBuffer(static_cast<GLenum>(type)));
     }
 
+    // Overwrites data.size() elements starting at element offset and leaves
+    // the rest of the buffer untouched
+    template<typename Type>
+    void update_data(const std::vector<Type> &data, const std::size_t offset) const {
+        GL_CHECK(glBufferSubData(static_cast<GLenum>(type), sizeof(Type) * offset, sizeof(Type) * data.size(), data.data()));
+    }
+
     void unbind() const {
-        GL_CHECK(glBindBuffer(static_cast<GLenum>(type), 0));
+        GlState::bind_buffer(static_cast<GLenum>(type), 0);
     }
 
     VboInner vbo;
     const VertexBufferType type;
 };
 
+// Array of equally sized single channel textures, one per layer, stored in
+// one of the HeightField formats. Shaders read all of them as floats.
+struct TextureArrayObject {
+    using TextureInner = GLuint;
+
+    explicit TextureArrayObject(std::size_t t_width, std::size_t t_height, std::size_t t_layers, HeightFormat t_format = HeightFormat::FLOAT32) 
+        : texture(0u), width(t_width), height(t_height), layers(t_layers), format(t_format)
+    {
+        GL_CHECK(glGenTextures(1, &texture));
+        bind();
+        GL_CHECK(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format(), width, height, layers, 0, GL_RED, pixel_type(), nullptr));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    }
+
+    explicit TextureArrayObject(TextureArrayObject&& other) 
+        : texture(other.texture), width(other.width), height(other.height), layers(other.layers), format(other.format)
+    {
+        other.texture = 0;
+    }
+
+    ~TextureArrayObject() {
+        if(texture) {
+            GlState::forget_texture(texture);
+            glDeleteTextures(1, &texture);
+        }
+    }
+
+    void bind(GLuint unit = 0) const {
+        GlState::bind_texture(unit, GL_TEXTURE_2D_ARRAY, texture);
+    }
+
+    void update_layer(std::size_t layer, const std::vector<float>& data) const {
+        if(format != HeightFormat::FLOAT32) {
+            throw std::runtime_error("Texture array layers of 16 bit formats must be updated from a HeightField");
+        }
+
+        bind();
+        GL_CHECK(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RED, GL_FLOAT, data.data()));
+    }
+
+    // Uploads field's samples as they are, without decoding
+    void update_layer(std::size_t layer, const HeightField& field) const {
+        if(field.get_format() != format || field.get_width() != width || field.get_height() != height) {
+            throw std::runtime_error("Height field does not match the texture array layers");
+        }
+
+        bind();
+
+        // Rows of 16 bit samples need not be a multiple of 4 bytes long
+        GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 2));
+        GL_CHECK(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RED, pixel_type(), field.get_data()));
+        GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    }
+
+    GLint internal_format() const {
+        switch(format) {
+            case HeightFormat::UNORM16:
+                return GL_R16;
+            case HeightFormat::FLOAT16:
+                return GL_R16F;
+            default:
+                return GL_R32F;
+        }
+    }
+
+    GLenum pixel_type() const {
+        switch(format) {
+            case HeightFormat::UNORM16:
+                return GL_UNSIGNED_SHORT;
+            case HeightFormat::FLOAT16:
+                return GL_HALF_FLOAT;
+            default:
+                return GL_FLOAT;
+        }
+    }
+
+    TextureInner texture;
+    const std::size_t width;
+    const std::size_t height;
+    const std::size_t layers;
+    const HeightFormat format;
+};
+
+// Two dimensional 32 bit unsigned integer texture holding a bit mask, e.g. a
+// Viewshed, as its words. Shaders read it through a usampler2D with texelFetch.
+struct MaskTextureObject {
+    using TextureInner = GLuint;
+
+    explicit MaskTextureObject(std::size_t t_words_per_row, std::size_t t_rows)
+        : texture(0u), words_per_row(t_words_per_row), rows(t_rows)
+    {
+        GL_CHECK(glGenTextures(1, &texture));
+        bind();
+        GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, words_per_row, rows, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+
+        // Integer textures cannot be filtered
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    }
+
+    explicit MaskTextureObject(MaskTextureObject&& other)
+        : texture(other.texture), words_per_row(other.words_per_row), rows(other.rows)
+    {
+        other.texture = 0;
+    }
+
+    ~MaskTextureObject() {
+        if(texture) {
+            GlState::forget_texture(texture);
+            glDeleteTextures(1, &texture);
+        }
+    }
+
+    void bind(GLuint unit = 0) const {
+        GlState::bind_texture(unit, GL_TEXTURE_2D, texture);
+    }
+
+    void update(const std::vector<uint32_t>& words) const {
+        if(words.size() != words_per_row * rows) {
+            throw std::runtime_error("Mask does not match the texture size");
+        }
+
+        bind();
+        GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, words_per_row, rows, GL_RED_INTEGER, GL_UNSIGNED_INT, words.data()));
+    }
+
+    TextureInner texture;
+    const std::size_t words_per_row;
+    const std::size_t rows;
+};
+
+// Two dimensional RG8 texture holding BakedLighting texels, filtered so
+// that the lighting varies smoothly between samples
+struct LightingTextureObject {
+    using TextureInner = GLuint;
+
+    explicit LightingTextureObject(std::size_t t_width, std::size_t t_height)
+        : texture(0u), width(t_width), height(t_height)
+    {
+        GL_CHECK(glGenTextures(1, &texture));
+        bind();
+        GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width, height, 0, GL_RG, GL_UNSIGNED_BYTE, nullptr));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    }
+
+    explicit LightingTextureObject(LightingTextureObject&& other)
+        : texture(other.texture), width(other.width), height(other.height)
+    {
+        other.texture = 0;
+    }
+
+    ~LightingTextureObject() {
+        if(texture) {
+            GlState::forget_texture(texture);
+            glDeleteTextures(1, &texture);
+        }
+    }
+
+    void bind(GLuint unit = 0) const {
+        GlState::bind_texture(unit, GL_TEXTURE_2D, texture);
+    }
+
+    void update(const std::vector<uint8_t>& texels) const {
+        if(texels.size() != width * height * 2) {
+            throw std::runtime_error("Lighting does not match the texture size");
+        }
+
+        bind();
+
+        // Rows of two byte texels need not be a multiple of 4 bytes long
+        GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 2));
+        GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RG, GL_UNSIGNED_BYTE, texels.data()));
+        GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    }
+
+    TextureInner texture;
+    const std::size_t width;
+    const std::size_t height;
+};
+
 enum class VertexPrimitive {
     TRIANGLES = GL_TRIANGLES,
     TRIANGLE_STRIP = GL_TRIANGLE_STRIP,
@@ -150,7 +345,50 @@ struct DrawElements {
     Indices& indices;
 };
 
-using DrawType = std::variant<DrawArrays, DrawElements>;
+// Draws count indices from the bound element buffer once per instance
+struct DrawElementsInstanced {
+    VertexPrimitive primitive;
+    std::size_t count;
+    VertexDataType type;
+    std::size_t instance_count;
+};
+
+using DrawType = std::variant<DrawArrays, DrawElements, DrawElementsInstanced>;
+
+// Issues the draw call described by draw_type against the bound VAO
+inline void issue_draw(const DrawType& draw_type) {
+    if(std::holds_alternative<DrawArrays>(draw_type)) {
+        auto draw_arrays = std::get_if<DrawArrays>(&draw_type);
+        GL_CHECK(
+            glDrawArrays(
+                static_cast<GLenum>(draw_arrays->primitive), 
+                draw_arrays->first, 
+                draw_arrays->count
+            )
+        );
+    } else if(std::holds_alternative<DrawElements>(draw_type)) {
+        auto draw_elements = std::get_if<DrawElements>(&draw_type);
+        GL_CHECK(
+            glDrawElements(
+                static_cast<GLenum>(draw_elements->primitive), 
+                draw_elements->count, 
+                static_cast<GLenum>(draw_elements->type), 
+                nullptr//&draw_elements->indices[0]
+            )
+        );
+    } else if(std::holds_alternative<DrawElementsInstanced>(draw_type)) {
+        auto draw_instanced = std::get_if<DrawElementsInstanced>(&draw_type);
+        GL_CHECK(
+            glDrawElementsInstanced(
+                static_cast<GLenum>(draw_instanced->primitive), 
+                draw_instanced->count, 
+                static_cast<GLenum>(draw_instanced->type), 
+                nullptr,
+                draw_instanced->instance_count
+            )
+        );
+    }
+}
 
 template <typename Child>
 class Drawable {
@@ -174,28 +412,33 @@ public:
         return static_cast<Child*>(this)->update_impl(std::forward<Args>(args)...);
     }
 
+    // Attribute the GPU time of every following draw() to label
+    void set_profiler(std::shared_ptr<GpuProfiler> t_profiler, std::string label) {
+        profiler = std::move(t_profiler);
+        profile_label = std::move(label);
+    }
+
     void draw() {
-        auto draw_type = static_cast<Child*>(this)->draw_impl();
-        if(std::holds_alternative<DrawArrays>(draw_type)) {
-            auto draw_arrays = std::get_if<DrawArrays>(&draw_type);
-            GL_CHECK(
-                glDrawArrays(
-                    static_cast<GLenum>(draw_arrays->primitive), 
-                    draw_arrays->first, 
-                    draw_arrays->count
-                )
-            );
-        } else if(std::holds_alternative<DrawElements>(draw_type)) {
-            auto draw_elements = std::get_if<DrawElements>(&draw_type);
-            GL_CHECK(
-                glDrawElements(
-                    static_cast<GLenum>(draw_elements->primitive), 
-                    draw_elements->count, 
-                    static_cast<GLenum>(draw_elements->type), 
-                    nullptr//&draw_elements->indices[0]
-                )
-            );
-        }
+        GpuTimerScope timer(profiler.get(), profile_label);
+
+        vao.bind();
+        issue_draw(get_draw_type());
+    }
+
+    DrawType get_draw_type() {
+        return static_cast<Child*>(this)->draw_impl();
+    }
+
+    GLuint get_vao() const {
+        return vao.vao;
+    }
+
+    GpuProfiler* get_profiler() const {
+        return profiler.get();
+    }
+
+    const std::string& get_profile_label() const {
+        return profile_label;
     }
 
 protected:
@@ -203,4 +446,7 @@ protected:
     virtual ~Drawable() {}
 
     const VertexArrayObject vao;
+
+    std::shared_ptr<GpuProfiler> profiler;
+    std::string profile_label;
 };
\ No newline at end of file
@@ -64,8 +64,6 @@ public:
     }
 
     DrawType draw_impl() const {
-        vao.bind();
-
         auto draw_type = DrawArrays {
             VertexPrimitive::TRIANGLES,
             0,
@@ -0,0 +1,512 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+#include "glm/glm.hpp"
+
+#include "../drawable.hpp"
+#include "../horizon_culler.hpp"
+#include "../job_system.hpp"
+#include "../tile_cache.hpp"
+#include "../terrain_generator.hpp"
+
+// Draws a square of chunks_per_side^2 terrain chunks with one instanced call.
+// All chunks share a single patch mesh of local grid coordinates; each chunk's
+// heights live in one layer of a texture array and are displaced in the
+// vertex shader, so the CPU cost of drawing does not grow with the chunk count.
+class TerrainPatches : public Drawable<TerrainPatches> {
+public:
+    // Per-instance attributes, see shaders/terrain_patch.vert
+    struct PatchInstance {
+        glm::vec4 placement;
+        glm::vec4 edge_lods;
+    };
+
+    static constexpr unsigned int MAX_LOD = 3;
+
+    // Heights below this are drawn flat as water, see shaders/terrain_patch.vert
+    static constexpr float WATER_LEVEL = 0.35f;
+
+    // Half the memory of float32 on both sides of the bus, the quantization
+    // step is far below a pixel at any height scale the UI offers
+    static constexpr HeightFormat HEIGHT_FORMAT = HeightFormat::UNORM16;
+
+    // Chunks closer than this many patch widths are drawn at full resolution,
+    // every doubling of the distance halves the resolution
+    static constexpr float LOD_DISTANCE = 1.5f;
+
+    explicit TerrainPatches(
+        VertexArrayObject&& t_vao,
+        VertexBufferObject&& t_vbo,
+        VertexBufferObject&& t_instance_vbo,
+        VertexBufferObject&& t_ebo,
+        TextureArrayObject&& t_heights,
+        unsigned int t_draw_count,
+        VertexCacheReport t_vertex_cache,
+        unsigned int t_patch_size,
+        unsigned int t_chunks_per_side
+    ) : Drawable(std::move(t_vao)),
+        vbo(std::move(t_vbo)),
+        instance_vbo(std::move(t_instance_vbo)),
+        ebo(std::move(t_ebo)),
+        heights(std::move(t_heights)),
+        draw_count(t_draw_count),
+        vertex_cache(t_vertex_cache),
+        patch_size(t_patch_size),
+        chunks_per_side(t_chunks_per_side),
+        instances(t_chunks_per_side * t_chunks_per_side),
+        height_ranges(t_chunks_per_side * t_chunks_per_side, glm::vec2(0.0f, 1.0f)),
+        chunk_visible(t_chunks_per_side * t_chunks_per_side, 1),
+        instances_dirty(true),
+        chunk_fields(t_chunks_per_side * t_chunks_per_side, HeightField(t_patch_size + 3, t_patch_size + 3, HEIGHT_FORMAT)),
+        chunk_details(t_chunks_per_side * t_chunks_per_side, 0),
+        refined_fields(t_chunks_per_side * t_chunks_per_side),
+        refined_ranges(t_chunks_per_side * t_chunks_per_side, glm::vec2(0.0f, 1.0f))
+    {
+        for(auto chunk_z = 0u; chunk_z < chunks_per_side; chunk_z++) {
+            for(auto chunk_x = 0u; chunk_x < chunks_per_side; chunk_x++) {
+                auto layer = chunk_z * chunks_per_side + chunk_x;
+                instances[layer] = PatchInstance {
+                    glm::vec4(chunk_x * patch_size, chunk_z * patch_size, layer, 0.0f),
+                    glm::vec4(0.0f, 0.0f, 0.0f, 0.0f)
+                };
+            }
+        }
+    }
+
+    static std::shared_ptr<TerrainPatches> create_impl(const unsigned int patch_size, const unsigned int chunks_per_side) {
+        if(patch_size % (1u << MAX_LOD) != 0) {
+            throw std::runtime_error("Patch size must be a multiple of " + std::to_string(1u << MAX_LOD));
+        }
+
+        auto patch_vao = VertexArrayObject();
+        auto patch_vbo = VertexBufferObject(VertexBufferType::ARRAY);
+        auto patch_instance_vbo = VertexBufferObject(VertexBufferType::ARRAY);
+        auto patch_ebo = VertexBufferObject(VertexBufferType::ELEMENT);
+
+        // One sample of apron on every side for the normals
+        auto patch_heights = TextureArrayObject(patch_size + 3, patch_size + 3, chunks_per_side * chunks_per_side, HEIGHT_FORMAT);
+
+        auto [local_positions, indices, vertex_cache] = generate_patch(patch_size);
+
+        patch_vao.bind();
+
+        patch_vbo.bind();
+        patch_vbo.send_data(local_positions, VertexDrawType::STATIC);
+        patch_vbo.enable_attribute_pointer(0, 2, VertexDataType::FLOAT, 2, 0);
+
+        patch_instance_vbo.bind();
+        patch_instance_vbo.send_data(std::vector<PatchInstance>(chunks_per_side * chunks_per_side), VertexDrawType::DYNAMIC);
+        patch_instance_vbo.enable_attribute_pointer(1, 4, VertexDataType::FLOAT, 8, 0, 1);
+        patch_instance_vbo.enable_attribute_pointer(2, 4, VertexDataType::FLOAT, 8, 4, 1);
+
+        patch_ebo.bind();
+        patch_ebo.send_data(indices, VertexDrawType::STATIC);
+
+        patch_instance_vbo.unbind();
+        patch_vao.unbind();
+
+        auto patches = std::make_shared<TerrainPatches>(
+            std::move(patch_vao),
+            std::move(patch_vbo),
+            std::move(patch_instance_vbo),
+            std::move(patch_ebo),
+            std::move(patch_heights),
+            indices.size(),
+            vertex_cache,
+            patch_size,
+            chunks_per_side
+        );
+
+        return patches;
+    }
+
+    // Generates every chunk on the job system, nearest chunks first, and
+    // uploads each layer from the main thread as soon as its chunk is done.
+    // Chunks found in cache are decompressed instead of generated, and
+    // generated chunks are added to it. Each chunk only evaluates the noise
+    // octaves its current LOD can show. Refinements still in flight are
+    // dropped, they were generated for the old settings. Rethrows the first
+    // failure once every chunk's jobs have finished.
+    void update_impl(const GenerationSettings& settings, JobSystem& jobs, TileCache& cache) {
+        cancel_refinement(jobs);
+
+        auto sample_count = patch_size + 3;
+
+        chunk_jobs.clear();
+        for(auto& instance : instances) {
+            auto layer = static_cast<std::size_t>(instance.placement.z);
+            auto origin = get_chunk_origin(instance);
+            auto lod = static_cast<unsigned int>(instance.placement.w);
+            chunk_details[layer] = lod;
+
+            auto generate = jobs.submit([this, &settings, &cache, sample_count, layer, origin, lod] {
+                height_ranges[layer] = generate_chunk(settings, cache, sample_count, origin, lod, chunk_fields[layer]);
+            }, static_cast<JobPriority>(lod));
+
+            chunk_jobs.push_back(generate);
+            chunk_jobs.push_back(jobs.submit([this, layer] {
+                heights.update_layer(layer, chunk_fields[layer]);
+            }, JobPriority::NORMAL, {generate}, JobAffinity::MAIN_THREAD));
+        }
+
+        // Every job is waited for, even after one failed, since they use
+        // settings and cache by reference
+        std::exception_ptr failure;
+        for(auto& job : chunk_jobs) {
+            try {
+                jobs.wait(job);
+            } catch(...) {
+                if(!failure) {
+                    failure = std::current_exception();
+                }
+            }
+        }
+        if(failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    // Starts regenerating the chunks whose LOD became finer than the detail
+    // they were generated with, as the camera approached them, without
+    // waiting for them. A refined chunk keeps being drawn at its old detail
+    // until a main thread job swaps the new heights in. Returns true if any
+    // chunk was swapped in since the last call, and rethrows if one failed.
+    bool refine_detail(const GenerationSettings& settings, JobSystem& jobs, TileCache& cache) {
+        auto swapped = false;
+        for(auto refinement = refinements.begin(); refinement != refinements.end();) {
+            if(!refinement->swap->is_done()) {
+                ++refinement;
+                continue;
+            }
+
+            auto generate = refinement->generate;
+            swapped = swapped || !refinement->swap->is_cancelled();
+            refinement = refinements.erase(refinement);
+            jobs.wait(generate);
+        }
+
+        auto sample_count = patch_size + 3;
+        for(auto& instance : instances) {
+            auto layer = static_cast<std::size_t>(instance.placement.z);
+            auto lod = static_cast<unsigned int>(instance.placement.w);
+            auto in_flight = std::any_of(refinements.begin(), refinements.end(), [&](auto& refinement) {
+                return refinement.layer == layer;
+            });
+            if(lod >= chunk_details[layer] || in_flight) {
+                continue;
+            }
+
+            chunk_details[layer] = lod;
+            auto origin = get_chunk_origin(instance);
+
+            // The settings are copied, the caller's may change before the
+            // job runs
+            auto generate = jobs.submit([this, settings, &cache, sample_count, layer, origin, lod] {
+                refined_ranges[layer] = generate_chunk(settings, cache, sample_count, origin, lod, refined_fields[layer]);
+            }, static_cast<JobPriority>(lod));
+
+            auto swap = jobs.submit([this, layer] {
+                std::swap(chunk_fields[layer], refined_fields[layer]);
+                height_ranges[layer] = refined_ranges[layer];
+                heights.update_layer(layer, chunk_fields[layer]);
+            }, JobPriority::NORMAL, {generate}, JobAffinity::MAIN_THREAD);
+
+            refinements.push_back(Refinement {layer, generate, swap});
+        }
+
+        return swapped;
+    }
+
+    // True while refine_detail() has chunks in flight
+    bool is_refining() const {
+        return !refinements.empty();
+    }
+
+    // Drops the refinements in flight: jobs that have not started never
+    // run, running ones finish but are not swapped in. Must be called before
+    // the cache passed to refine_detail() goes away.
+    void cancel_refinement(JobSystem& jobs) {
+        for(auto& refinement : refinements) {
+            refinement.generate->cancel();
+            refinement.swap->cancel();
+        }
+        for(auto& refinement : refinements) {
+            jobs.wait(refinement.swap);
+        }
+        refinements.clear();
+    }
+
+    // Picks every chunk's LOD from its distance to the camera and re-uploads
+    // the instance attributes when any of them changed
+    void update_lods(const glm::vec3& camera_position) {
+        auto lod_of = [&](unsigned int chunk_x, unsigned int chunk_z) {
+            auto center = glm::vec2((chunk_x + 0.5f) * patch_size, (chunk_z + 0.5f) * patch_size);
+            auto distance = glm::length(center - glm::vec2(camera_position.x, camera_position.z));
+            auto lod = std::floor(std::log2(std::max(distance / (patch_size * LOD_DISTANCE), 1.0f)));
+            return std::min(lod, static_cast<float>(MAX_LOD));
+        };
+
+        auto changed = false;
+        for(auto chunk_z = 0u; chunk_z < chunks_per_side; chunk_z++) {
+            for(auto chunk_x = 0u; chunk_x < chunks_per_side; chunk_x++) {
+                auto& instance = instances[chunk_z * chunks_per_side + chunk_x];
+                auto lod = lod_of(chunk_x, chunk_z);
+
+                // Chunks on the outside have no neighbour to match
+                auto edge_lods = glm::vec4(
+                    chunk_x > 0 ? lod_of(chunk_x - 1, chunk_z) : 0.0f,
+                    chunk_x + 1 < chunks_per_side ? lod_of(chunk_x + 1, chunk_z) : 0.0f,
+                    chunk_z > 0 ? lod_of(chunk_x, chunk_z - 1) : 0.0f,
+                    chunk_z + 1 < chunks_per_side ? lod_of(chunk_x, chunk_z + 1) : 0.0f
+                );
+
+                if(instance.placement.w != lod || instance.edge_lods != edge_lods) {
+                    instance.placement.w = lod;
+                    instance.edge_lods = edge_lods;
+                    changed = true;
+                }
+            }
+        }
+
+        instances_dirty = instances_dirty || changed;
+    }
+
+    // Drops the chunks outside the frustum or behind nearer terrain from the
+    // instance buffer. model must only translate, as the Scene's does.
+    void cull(
+        HorizonCuller& culler,
+        const glm::mat4& view_projection,
+        const glm::mat4& model,
+        const glm::vec3& camera_position,
+        const float height_scale)
+    {
+        auto offset = glm::vec3(model[3]);
+
+        chunk_bounds.resize(instances.size());
+        for(auto& instance : instances) {
+            auto layer = static_cast<std::size_t>(instance.placement.z);
+            auto origin = glm::vec3(instance.placement.x, 0.0f, instance.placement.y) + offset;
+            chunk_bounds[layer] = ChunkBounds {
+                origin + glm::vec3(0.0f, height_ranges[layer].x * height_scale, 0.0f),
+                origin + glm::vec3(patch_size, height_ranges[layer].y * height_scale, patch_size)
+            };
+        }
+
+        culler.cull(view_projection, camera_position, WATER_LEVEL * height_scale + offset.y, chunk_bounds, next_visible);
+
+        if(next_visible != chunk_visible) {
+            chunk_visible.swap(next_visible);
+            instances_dirty = true;
+        }
+
+        if(instances_dirty) {
+            upload_instances();
+        }
+    }
+
+    DrawType draw_impl() {
+        auto draw_type = DrawElementsInstanced {
+            VertexPrimitive::TRIANGLES,
+            draw_count,
+            VertexDataType::UNSIGNED_INT,
+            visible_instances.size()
+        };
+
+        return DrawType(draw_type);
+    }
+
+    GLuint get_height_texture() const {
+        return heights.texture;
+    }
+
+    unsigned int get_patch_size() const {
+        return patch_size;
+    }
+
+    // Model space heights of every chunk vertex, water included, stitched
+    // into one grid of chunks_per_side * patch_size + 1 samples a side with
+    // the height at (x, z) at surface[z * side + x]. Neighbouring chunks
+    // generate the samples they share identically.
+    void get_surface_heights(const float height_scale, std::vector<float>& surface) const {
+        auto side = chunks_per_side * patch_size + 1;
+        surface.resize(static_cast<std::size_t>(side) * side);
+
+        for(auto z = 0u; z < side; z++) {
+            auto chunk_z = std::min(z / patch_size, chunks_per_side - 1);
+            for(auto x = 0u; x < side; x++) {
+                auto chunk_x = std::min(x / patch_size, chunks_per_side - 1);
+                auto& field = chunk_fields[chunk_z * chunks_per_side + chunk_x];
+
+                // Past the apron sample the texture starts with
+                auto height = field.get(x - chunk_x * patch_size + 1, z - chunk_z * patch_size + 1);
+                surface[z * side + x] = std::max(height, WATER_LEVEL) * height_scale;
+            }
+        }
+    }
+
+    unsigned int get_chunks_per_side() const {
+        return chunks_per_side;
+    }
+
+    const VertexCacheReport& get_vertex_cache_report() const {
+        return vertex_cache;
+    }
+
+private:
+    // The patch mesh is drawn once per chunk, its indices are reordered for
+    // the post-transform vertex cache
+    static std::tuple<std::vector<glm::vec2>, Indices, VertexCacheReport> generate_patch(const unsigned int patch_size) {
+        auto vertices_per_side = patch_size + 1;
+
+        std::vector<glm::vec2> local_positions;
+        local_positions.reserve(vertices_per_side * vertices_per_side);
+
+        Indices indices;
+        indices.reserve(patch_size * patch_size * 6);
+
+        auto index = 0u;
+        for(auto z = 0u; z < vertices_per_side; z++) {
+            for(auto x = 0u; x < vertices_per_side; x++) {
+                local_positions.emplace_back(x, z);
+
+                if(x < patch_size && z < patch_size) {
+                    indices.push_back(index);
+                    indices.push_back(index + vertices_per_side + 1);
+                    indices.push_back(index + 1);
+
+                    indices.push_back(index + vertices_per_side + 1);
+                    indices.push_back(index);
+                    indices.push_back(index + vertices_per_side);
+                }
+                index++;
+            }
+        }
+
+        auto optimized = VertexCache::optimize_cached(indices, vertices_per_side * vertices_per_side);
+        return std::tuple(local_positions, optimized->indices, optimized->report);
+    }
+
+    // Heights of a chunk with its apron start one sample before the chunk
+    static glm::ivec2 get_chunk_origin(const PatchInstance& instance) {
+        return glm::ivec2(instance.placement.x, instance.placement.y) - glm::ivec2(1, 1);
+    }
+
+    // Fills field with the chunk's heights at the detail of lod, from the
+    // cache if it has them, and returns the normalized range of the samples
+    // the patch vertices use
+    glm::vec2 generate_chunk(
+        const GenerationSettings& settings,
+        TileCache& cache,
+        const unsigned int sample_count,
+        const glm::ivec2 origin,
+        const unsigned int lod,
+        HeightField& field) const
+    {
+        // A chunk's LOD is its distance band, and doubles as its priority
+        static_assert(MAX_LOD + 1 == JobSystem::PRIORITY_LEVELS);
+
+        auto& scratch = get_generation_scratch();
+        auto& chunk_heights = scratch.heights;
+        auto detail_spacing = static_cast<float>(1u << lod);
+
+        if(field.get_width() != sample_count) {
+            field = HeightField(sample_count, sample_count, HEIGHT_FORMAT);
+        }
+
+        auto key = TileCache::make_key(settings, origin, sample_count, HEIGHT_FORMAT, detail_spacing);
+        if(cache.find(key, field)) {
+            field.decode(chunk_heights);
+        } else {
+            TerrainGenerator::generate_chunk_heights(sample_count, origin, settings, chunk_heights, scratch.octave_offsets, detail_spacing);
+            field.encode(chunk_heights);
+            cache.insert(key, field);
+        }
+
+        // The apron only feeds the normals
+        auto range = glm::vec2(1.0f, 0.0f);
+        for(auto z = 1u; z <= patch_size + 1; z++) {
+            for(auto x = 1u; x <= patch_size + 1; x++) {
+                auto height = std::max(chunk_heights[z * sample_count + x], WATER_LEVEL);
+                range.x = std::min(range.x, height);
+                range.y = std::max(range.y, height);
+            }
+        }
+        return range;
+    }
+
+    // Generation works in floats before encoding, one scratch per thread so
+    // that chunks generate in parallel without float copies per chunk
+    struct GenerationScratch {
+        std::vector<float> heights;
+        std::vector<glm::vec2> octave_offsets;
+    };
+
+    static GenerationScratch& get_generation_scratch() {
+        thread_local GenerationScratch scratch;
+        return scratch;
+    }
+
+    // Packs the visible chunks to the front of the instance buffer, each
+    // instance carries its own layer so the order does not matter
+    void upload_instances() {
+        visible_instances.clear();
+        for(auto& instance : instances) {
+            if(chunk_visible[static_cast<std::size_t>(instance.placement.z)]) {
+                visible_instances.push_back(instance);
+            }
+        }
+
+        if(!visible_instances.empty()) {
+            instance_vbo.bind();
+            instance_vbo.update_data(visible_instances);
+            instance_vbo.unbind();
+        }
+
+        instances_dirty = false;
+    }
+
+    VertexBufferObject vbo;
+    VertexBufferObject instance_vbo;
+    VertexBufferObject ebo;
+    TextureArrayObject heights;
+    unsigned int draw_count;
+    VertexCacheReport vertex_cache;
+    unsigned int patch_size;
+    unsigned int chunks_per_side;
+    std::vector<PatchInstance> instances;
+    std::vector<PatchInstance> visible_instances;
+
+    // Normalized min and max height per layer
+    std::vector<glm::vec2> height_ranges;
+    std::vector<ChunkBounds> chunk_bounds;
+    std::vector<uint8_t> chunk_visible;
+    std::vector<uint8_t> next_visible;
+    bool instances_dirty;
+
+    // Resident heights of every chunk, in the texture's format
+    std::vector<HeightField> chunk_fields;
+
+    // LOD whose sample spacing each chunk's heights were generated, or are
+    // being refined, for
+    std::vector<unsigned int> chunk_details;
+
+    // Generation and upload jobs of the last update_impl()
+    std::vector<JobHandle> chunk_jobs;
+
+    // A chunk regenerating at finer detail into refined_fields[layer], at
+    // most one per layer
+    struct Refinement {
+        std::size_t layer;
+        JobHandle generate;
+        JobHandle swap;
+    };
+    std::vector<Refinement> refinements;
+    std::vector<HeightField> refined_fields;
+    std::vector<glm::vec2> refined_ranges;
+};
@@ -1,74 +1,44 @@
 #pragma once
 
 #include <cmath>
-#include <limits>
-#include <random>
 #include <tuple>
 
 #include "glm/glm.hpp"
 
 #include "../drawable.hpp"
-#include "../perlin.hpp"
-
-struct GenerationSettings {
-    int seed;
-    float scale; 
-    float height_scale;
-    int octaves;
-    float persistence; 
-    float lacunarity; 
-    glm::vec2 offset;
-
-    // Defaults
-    GenerationSettings() 
-        : seed(0xDEADBEEF),
-          scale(25.0f),
-          height_scale(13.50f),
-          octaves(5),
-          persistence(0.5f),
-          lacunarity(2.5f),
-          offset{0.0f, 0.0f}
-    {
-    }
-
-    bool operator==(const GenerationSettings& other) {
-        const auto epsilon = 0.001f;
-        return seed == other.seed &&
-               fabs(height_scale - other.height_scale) < epsilon &&
-               fabs(scale - other.scale) < epsilon &&
-               octaves == other.octaves &&
-               fabs(persistence - other.persistence) < epsilon &&
-               fabs(lacunarity - other.lacunarity) < epsilon &&
-               offset == other.offset;
-    }
-};
-
-namespace {
-    struct Vertex {
-        glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec3 color;
-    };
-
-    using VertexData = std::vector<Vertex>;
-    using TerrainData = std::tuple<VertexData, Indices, unsigned int>;
-}
-
+#include "../terrain_generator.hpp"
+
+// The vertex buffer holds every position, then every normal, then every
+// color, so that a stage that only changes one attribute only uploads that
+// attribute's range. While a refinement is in progress the mesh is drawn as
+// the lattice of samples computed so far instead: its vertices overwrite the
+// start of each attribute's range and its own index buffer is bound to the
+// VAO until the full mesh is rebuilt.
 class TerrainSquares : public Drawable<TerrainSquares> {
 public:
+    using Attribute = std::vector<glm::vec3>;
+
     explicit TerrainSquares(
-        VertexArrayObject&& t_vao, 
-        VertexBufferObject&& t_vbo, 
+        VertexArrayObject&& t_vao,
+        VertexBufferObject&& t_vbo,
         VertexBufferObject&& t_ebo,
+        VertexBufferObject&& t_preview_ebo,
         unsigned int t_draw_count,
         Indices&& t_indices,
+        VertexCacheReport t_vertex_cache,
         unsigned int t_grid_size
-    ) : Drawable(std::move(t_vao)), 
-        vbo(std::move(t_vbo)), 
+    ) : Drawable(std::move(t_vao)),
+        vbo(std::move(t_vbo)),
         ebo(std::move(t_ebo)),
+        preview_ebo(std::move(t_preview_ebo)),
         draw_count(t_draw_count),
         indices(std::move(t_indices)),
-        grid_size(t_grid_size)
+        vertex_cache(t_vertex_cache),
+        grid_size(t_grid_size),
+        progressive(t_grid_size),
+        shows_progressive(false),
+        shows_preview(false),
+        height_scale(0.0f)
     {
     }
 
@@ -76,268 +46,357 @@ public:
         auto terrain_vao = VertexArrayObject();
         auto terrain_vbo = VertexBufferObject(VertexBufferType::ARRAY);
         auto terrain_ebo = VertexBufferObject(VertexBufferType::ELEMENT);
+        auto preview_ebo = VertexBufferObject(VertexBufferType::ELEMENT);
 
-        auto [terrain_attributes, indices, draw_count] = generate_terrain(grid_size);
-        terrain_vao.bind();
-
-        terrain_vbo.bind();
-        terrain_vbo.send_data(terrain_attributes, VertexDrawType::DYNAMIC);
-
-        terrain_vbo.enable_attribute_pointer(0, 3, VertexDataType::FLOAT, 9, 0);
-        terrain_vbo.enable_attribute_pointer(1, 3, VertexDataType::FLOAT, 9, 3);
-        terrain_vbo.enable_attribute_pointer(2, 3, VertexDataType::FLOAT, 9, 6);
+        auto [indices, draw_count, vertex_cache] = generate_indices(grid_size);
 
-        terrain_ebo.bind();
-        terrain_ebo.send_data(indices, VertexDrawType::STATIC);
-
-        terrain_vbo.unbind();
-        terrain_vao.unbind();
-
-        return std::make_shared<TerrainSquares>(
-            std::move(terrain_vao), 
-            std::move(terrain_vbo), 
+        auto terrain = std::make_shared<TerrainSquares>(
+            std::move(terrain_vao),
+            std::move(terrain_vbo),
             std::move(terrain_ebo),
-            draw_count, 
+            std::move(preview_ebo),
+            draw_count,
             std::move(indices),
+            vertex_cache,
             grid_size
         );
+
+        GenerationSettings settings;
+        TerrainGenerator::generate_height_map(grid_size, settings, terrain->height_map, terrain->octave_offsets);
+        terrain->height_scale = settings.height_scale;
+        terrain->generate_positions(terrain->height_map, grid_size, identity, terrain->positions);
+        generate_normals(grid_size, terrain->positions, terrain->normals);
+        generate_colors(terrain->height_map, grid_size, terrain->colors);
+
+        auto vertex_count = grid_size * grid_size;
+
+        terrain->vao.bind();
+
+        terrain->vbo.bind();
+        terrain->vbo.send_data(Attribute(vertex_count * 3), VertexDrawType::DYNAMIC);
+        terrain->vbo.update_data(terrain->positions, 0);
+        terrain->vbo.update_data(terrain->normals, vertex_count);
+        terrain->vbo.update_data(terrain->colors, vertex_count * 2);
+
+        terrain->vbo.enable_attribute_pointer(0, 3, VertexDataType::FLOAT, 3, 0);
+        terrain->vbo.enable_attribute_pointer(1, 3, VertexDataType::FLOAT, 3, vertex_count * 3);
+        terrain->vbo.enable_attribute_pointer(2, 3, VertexDataType::FLOAT, 3, vertex_count * 6);
+
+        terrain->ebo.bind();
+        terrain->ebo.send_data(terrain->indices, VertexDrawType::STATIC);
+
+        terrain->vbo.unbind();
+        terrain->vao.unbind();
+
+        return terrain;
     }
 
+    // Regenerates into the buffers kept from the last update, so that
+    // steady-state regeneration does not touch the heap
     void update_impl(GenerationSettings& settings) {
-        auto updated_terrain = generate_terrain_data(grid_size, settings);
-        vao.bind();
-        vbo.bind();
-        vbo.update_data(updated_terrain);
-        vbo.unbind();        
-        vao.unbind();
+        update_stages(settings, GenerationStage::ALL);
+    }
+
+    // Reruns only the given GenerationStage stages, reusing the results of
+    // the others from the last update, and uploads only the attributes they
+    // changed. A refinement in progress keeps going unless the heights are
+    // regenerated.
+    void update_stages(const GenerationSettings& settings, const unsigned int stages) {
+        if(stages & GenerationStage::HEIGHTS) {
+            progressive.cancel();
+            shows_progressive = false;
+            TerrainGenerator::generate_height_map(grid_size, settings, height_map, octave_offsets);
+        }
+
+        height_scale = settings.height_scale;
+        rebuild(stages);
+    }
+
+    // Replaces the mesh with a coarse preview for settings right away, see
+    // ProgressiveHeightMap, and leaves the rest to refine(). The preview is
+    // a mesh of the computed samples only, MAX_PREVIEW_SAMPLES a side at
+    // most, so it costs a fraction of a full update.
+    void begin_refinement(const GenerationSettings& settings) {
+        height_scale = settings.height_scale;
+        shows_progressive = true;
+        progressive.restart(settings);
+        rebuild(GenerationStage::ALL);
+    }
+
+    // Continues the refinement for up to budget_ms and uploads the mesh if
+    // a finer level was finished. Returns true if the mesh changed. A
+    // finished level rebuilds and uploads only its own samples, a quarter of
+    // the next level's, and the full mesh is rebuilt once when the last
+    // level finishes.
+    bool refine(const double budget_ms) {
+        if(!progressive.refine(budget_ms)) {
+            return false;
+        }
+
+        rebuild(GenerationStage::ALL);
+        return true;
+    }
+
+    bool is_refined() const {
+        return progressive.is_complete();
+    }
+
+    // Sample spacing of the mesh currently shown by the refinement
+    unsigned int get_refinement_step() const {
+        return progressive.get_step();
+    }
+
+    // The heights of the full mesh, which a refinement only replaces once it
+    // is complete
+    HeightField get_height_field(const HeightFormat format) const {
+        HeightField field(grid_size, grid_size, format);
+        field.encode(shows_progressive ? progressive.get_heights() : height_map);
+        return field;
+    }
+
+    // Model space heights of the full mesh, water included, with the height
+    // at (x, z) at heights[z * grid_size + x]. A refinement only replaces
+    // them once it is complete.
+    void get_surface_heights(std::vector<float>& heights) const {
+        heights.resize(grid_size * grid_size);
+        for(auto x = 0u; x < grid_size; x++) {
+            for(auto z = 0u; z < grid_size; z++) {
+                heights[z * grid_size + x] = positions[x * grid_size + z].y;
+            }
+        }
+    }
+
+    unsigned int get_grid_size() const {
+        return grid_size;
+    }
+
+    const VertexCacheReport& get_vertex_cache_report() const {
+        return vertex_cache;
     }
 
     DrawType draw_impl() {
-        vao.bind();
         auto draw_type = DrawElements {
             VertexPrimitive::TRIANGLES,
-            draw_count,
+            shows_preview ? static_cast<unsigned int>(preview_indices.size()) : draw_count,
             VertexDataType::UNSIGNED_INT,
-            indices
+            shows_preview ? preview_indices : indices
         };
 
         return DrawType(draw_type);
     }
 
 private:
-    static TerrainData generate_terrain(const unsigned int grid_size) {
+    // Reordered for the post-transform vertex cache, the triangles
+    // themselves are unchanged so that the colors still match them
+    static std::tuple<Indices, unsigned int, VertexCacheReport> generate_indices(const unsigned int grid_size) {
         Indices indices;
-        indices.reserve(grid_size * grid_size * 2);
+        generate_grid_indices(grid_size, indices);
 
-        auto index = 0;
-        for(auto x = 0; x < grid_size; x++) {
-            for(auto z = 0; z < grid_size; z++) {
-                // Calculate indices
-                if(x < grid_size - 1 && z < grid_size - 1) {
+        auto draw_count = static_cast<unsigned int>(indices.size());
+        auto optimized = VertexCache::optimize_cached(indices, grid_size * grid_size);
+        return std::tuple(optimized->indices, draw_count, optimized->report);
+    }
+
+    // Two triangles per quad of a side x side grid of vertices, x major
+    static void generate_grid_indices(const unsigned int side, Indices& indices) {
+        indices.clear();
+        indices.reserve((side - 1) * (side - 1) * 6);
+
+        auto index = 0u;
+        for(auto x = 0u; x < side; x++) {
+            for(auto z = 0u; z < side; z++) {
+                if(x < side - 1 && z < side - 1) {
                     indices.push_back(index);
-                    indices.push_back(index + grid_size + 1);
-                    indices.push_back(index + grid_size);
+                    indices.push_back(index + side + 1);
+                    indices.push_back(index + side);
 
-                    indices.push_back(index + grid_size + 1);
+                    indices.push_back(index + side + 1);
                     indices.push_back(index);
                     indices.push_back(index + 1);
                 }
                 index++;
             }
         }
+    }
 
-        GenerationSettings settings;
+    static unsigned int identity(const unsigned int index) {
+        return index;
+    }
+
+    // Reruns the mesh stages in stages from the heights currently shown.
+    // A refinement in progress rebuilds its whole preview, which is cheap,
+    // and leaving a preview rebuilds the whole mesh it drew over.
+    void rebuild(unsigned int stages) {
+        if(shows_progressive && !progressive.is_complete()) {
+            rebuild_preview();
+            return;
+        }
+
+        if(shows_preview) {
+            shows_preview = false;
+            stages = GenerationStage::ALL;
+
+            vao.bind();
+            ebo.bind();
+            vao.unbind();
+        }
 
-        auto terrain_attributes = generate_terrain_data(grid_size, settings);
+        auto& normalized_heights = shows_progressive ? progressive.get_heights() : height_map;
 
-        return std::tuple(terrain_attributes, indices, indices.size());
+        if(stages & GenerationStage::POSITIONS) {
+            generate_positions(normalized_heights, grid_size, identity, positions);
+        }
+        if(stages & GenerationStage::NORMALS) {
+            generate_normals(grid_size, positions, normals);
+        }
+        if(stages & GenerationStage::COLORS) {
+            generate_colors(normalized_heights, grid_size, colors);
+        }
+
+        upload_attributes(stages);
     }
 
-    static std::vector<Vertex> generate_terrain_data(unsigned int grid_size, const GenerationSettings& settings) {
-        auto height_map = generate_height_map(grid_size, settings);
+    void rebuild_preview() {
+        auto side = progressive.get_lattice_side();
+        auto& lattice_heights = progressive.get_lattice_heights();
+        auto coordinate = [&](unsigned int index) {
+            return progressive.get_lattice_coordinate(index);
+        };
+
+        generate_positions(lattice_heights, side, coordinate, preview_positions);
+        generate_normals(side, preview_positions, preview_normals);
+        generate_colors(lattice_heights, side, preview_colors);
+        generate_grid_indices(side, preview_indices);
 
-        VertexData terrain_attributes(grid_size * grid_size, Vertex {
-            glm::vec3(0.0f, 0.0f, 0.0f),
-            glm::vec3(0.0f, 1.0f, 0.0f),
-            glm::vec3(1.0f, 1.0f, 1.0f)
-        });
+        auto vertex_count = grid_size * grid_size;
+
+        vao.bind();
+        vbo.bind();
+        vbo.update_data(preview_positions, 0);
+        vbo.update_data(preview_normals, vertex_count);
+        vbo.update_data(preview_colors, vertex_count * 2);
+        preview_ebo.bind();
+        preview_ebo.send_data(preview_indices, VertexDrawType::DYNAMIC);
+        vbo.unbind();
+        vao.unbind();
+
+        shows_preview = true;
+    }
 
-        auto va_index = 0;
-        for(auto x = 0; x < grid_size; x++) {
-            for(auto z = 0; z < grid_size; z++) {
+    void upload_attributes(const unsigned int stages) {
+        auto vertex_count = grid_size * grid_size;
+
+        vao.bind();
+        vbo.bind();
+        if(stages & GenerationStage::POSITIONS) {
+            vbo.update_data(positions, 0);
+        }
+        if(stages & GenerationStage::NORMALS) {
+            vbo.update_data(normals, vertex_count);
+        }
+        if(stages & GenerationStage::COLORS) {
+            vbo.update_data(colors, vertex_count * 2);
+        }
+        vbo.unbind();
+        vao.unbind();
+    }
+
+    // side x side vertices, vertex (x, z) at grid coordinates
+    // (coordinate(x), coordinate(z))
+    template <typename Coordinate>
+    void generate_positions(const std::vector<float>& normalized_heights, const unsigned int side, Coordinate coordinate, Attribute& out) const {
+        out.resize(side * side);
+
+        auto va_index = 0u;
+        for(auto x = 0u; x < side; x++) {
+            for(auto z = 0u; z < side; z++) {
                 // TODO: Make the water height more realistic
-                auto height = (height_map[va_index] > 0.35 ? height_map[va_index] : 0.35f);
-                terrain_attributes[va_index].position = glm::vec3(x, height * settings.height_scale, z);
+                auto height = (normalized_heights[va_index] > 0.35 ? normalized_heights[va_index] : 0.35f);
+                out[va_index] = glm::vec3(coordinate(x), height * height_scale, coordinate(z));
                 va_index++;
             }
         }
-        
-        // TODO: Put this somewhere
-        static auto heights = std::vector{0.3, 0.4, 0.45, 0.55, 0.6, 0.7, 0.9, 1.0};
-        static auto colors  = std::vector {
-            glm::vec3(0.12f, 0.29f, 0.72f),
-            glm::vec3(0.13f, 0.30f, 0.76f),
-            glm::vec3(0.77f, 0.80f, 0.28f),
-            glm::vec3(0.20f, 0.55f, 0.0f),
-            glm::vec3(0.14f, 0.36f, 0.0f),
-            glm::vec3(0.30f, 0.20f, 0.17f),
-            glm::vec3(0.23f, 0.18f, 0.16f),
-            glm::vec3(1.0f, 1.0f, 1.0f),
-        };
+    }
 
-        auto height_centroid = [](float height1, float height2, float height3) {
-            return (height1 + height2 + height3) / 3.0f;
+    // Flat shading, every vertex takes the normal of the last triangle
+    // written that uses it. Every vertex belongs to a triangle, so nothing
+    // from a previous update shows through.
+    static void generate_normals(const unsigned int side, const Attribute& positions, Attribute& normals) {
+        normals.resize(side * side, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        auto triangle_normal = [&](unsigned int a, unsigned int b, unsigned int c) {
+            auto normal = glm::normalize(glm::cross(positions[b] - positions[a], positions[c] - positions[a]));
+            normals[a] = normal;
+            normals[b] = normal;
+            normals[c] = normal;
         };
 
-        va_index = 0;
-        for(auto x = 0; x < grid_size; x++) {
-            for(auto z = 0; z < grid_size; z++) {
-                if(x < grid_size - 1 && z < grid_size - 1) {
-                    // Extract first triangle using same method to calculate indices
-                    auto& triangle1_va = terrain_attributes.at(va_index);
-                    auto& triangle1_vb = terrain_attributes.at(va_index + grid_size + 1);
-                    auto& triangle1_vc = terrain_attributes.at(va_index + grid_size);
-
-                    // Same with second triangle
-                    auto& triangle2_va = terrain_attributes.at(va_index + grid_size + 1);
-                    auto& triangle2_vb = terrain_attributes.at(va_index);
-                    auto& triangle2_vc = terrain_attributes.at(va_index + 1);
-
-                    // Recalculate surface normals
-                    auto triangle1_normal = glm::normalize(glm::cross(triangle1_vb.position - triangle1_va.position, triangle1_vc.position - triangle1_va.position));
-                    triangle1_va.normal = triangle1_normal;
-                    triangle1_vb.normal = triangle1_normal;
-                    triangle1_vc.normal = triangle1_normal;
-
-                    auto triangle2_normal = glm::normalize(glm::cross(triangle2_vb.position - triangle2_va.position, triangle2_vc.position - triangle2_va.position));
-                    triangle2_va.normal = triangle2_normal;
-                    triangle2_vb.normal = triangle2_normal;
-                    triangle2_vc.normal = triangle2_normal;
-
-                    // Recalculate colors
-                    //   Find triangle1 color
-                    // Extract first triangle using same method to calculate indices
-                    auto& triangle1_va_height = height_map[va_index];
-                    auto& triangle1_vb_height = height_map[va_index + grid_size + 1];
-                    auto& triangle1_vc_height = height_map[va_index + grid_size];
-
-                    // Same with second triangle
-                    auto& triangle2_va_height = height_map[va_index + grid_size + 1];
-                    auto& triangle2_vb_height = height_map[va_index];
-                    auto& triangle2_vc_height = height_map[va_index + 1];
-
-                    auto triangle1_centroid_height = height_centroid(triangle1_va_height, triangle1_vb_height, triangle1_vc_height);
-
-                    auto color = glm::vec3(1.0f, 1.0f, 1.0f);
-
-                    auto color_index = 0;
-                    auto height = triangle1_centroid_height;
-                    for(auto &segment_color : colors) {
-                        if(height <= heights[color_index]) {
-                            color = segment_color;
-                            break;
-                        }
-                        color_index++;
-                    }
-
-                    triangle1_va.color = color;
-                    triangle1_vb.color = color;
-                    triangle1_vc.color = color;
-
-                    //   Find triangle2 color
-                    auto triangle2_centroid_height = height_centroid(triangle2_va_height, triangle2_vb_height, triangle2_vc_height);
-
-                    color_index = 0;
-                    height = triangle2_centroid_height;
-                    for(auto &segment_color : colors) {
-                        if(height <= heights[color_index]) {
-                            color = segment_color;
-                            break;
-                        }
-                        color_index++;
-                    }
-
-                    triangle2_va.color = color;
-                    triangle2_vb.color = color;
-                    triangle2_vc.color = color;
+        auto va_index = 0u;
+        for(auto x = 0u; x < side; x++) {
+            for(auto z = 0u; z < side; z++) {
+                if(x < side - 1 && z < side - 1) {
+                    // Same triangles as generate_grid_indices
+                    triangle_normal(va_index, va_index + side + 1, va_index + side);
+                    triangle_normal(va_index + side + 1, va_index, va_index + 1);
                 }
                 va_index++;
             }
         }
-
-        return terrain_attributes;
     }
 
-    static std::vector<float> generate_height_map(
-        const unsigned int grid_size,
-        const GenerationSettings& settings)
-    {
-		std::vector<float> noise_map(grid_size * grid_size);
-
-        // Generate octave noise
-        std::mt19937 gen(settings.seed);
-        std::uniform_int_distribution<> dis(-100000, 100000);
-		std::vector<glm::vec2> octave_offsets(settings.octaves);
-		for (int octave = 0; octave < settings.octaves; octave++) {
-			float offset_x = dis(gen) + settings.offset.x;
-			float offset_y = dis(gen) + settings.offset.y;
-			octave_offsets[octave] = glm::vec2(offset_x, offset_y);
-		}
-
-		float max_noise_height = std::numeric_limits<float>::min();
-		float min_noise_height = std::numeric_limits<float>::max();
-
-		float half_width = grid_size / 2.0f;
-		float half_height = grid_size / 2.0f;
-
-        auto index = 0;
-		for (int y = 0; y < grid_size; y++) {
-			for (int x = 0; x < grid_size; x++) {
-		
-				float amplitude = 1.0f;
-				float frequency = 1.0f;
-				float noise_height = 0.0f;
-
-				for (int i = 0; i < settings.octaves; i++) {
-					float sample_x = (x - half_width) / settings.scale * frequency + octave_offsets[i].x;
-					float sample_y = (y - half_height) / settings.scale * frequency + octave_offsets[i].y;
-
-					float perlin_value = Perlin::noise (sample_x, sample_y, sample_x + sample_y) * 2 - 1;
-					noise_height += perlin_value * amplitude;
-
-					amplitude *= settings.persistence;
-					frequency *= settings.lacunarity;
-				}
-
-				if (noise_height > max_noise_height) {
-					max_noise_height = noise_height;
-				} else if (noise_height < min_noise_height) {
-					min_noise_height = noise_height;
-				}
-
-				noise_map[index] = noise_height;
-                index++;
-			}
-		}
+    // Colors every triangle by its centroid height, overwriting vertices
+    // shared with earlier triangles like generate_normals
+    static void generate_colors(const std::vector<float>& normalized_heights, const unsigned int side, Attribute& colors) {
+        colors.resize(side * side, glm::vec3(1.0f, 1.0f, 1.0f));
 
-        auto inverse_lerp = [](float a, float b, float x) {
-            return (x - a) / (b - a);
-        };
+        auto triangle_color = [&](unsigned int a, unsigned int b, unsigned int c) {
+            auto height = (normalized_heights[a] + normalized_heights[b] + normalized_heights[c]) / 3.0f;
+            auto color = TerrainGenerator::get_palette_color(height);
 
-        index = 0;
-		for (int y = 0; y < grid_size; y++) {
-			for (int x = 0; x < grid_size; x++) {
-				noise_map[index] = inverse_lerp(min_noise_height, max_noise_height, noise_map[index]);
-                index++;
-			}
-		}
+            colors[a] = color;
+            colors[b] = color;
+            colors[c] = color;
+        };
 
-		return noise_map;
+        auto va_index = 0u;
+        for(auto x = 0u; x < side; x++) {
+            for(auto z = 0u; z < side; z++) {
+                if(x < side - 1 && z < side - 1) {
+                    triangle_color(va_index, va_index + side + 1, va_index + side);
+                    triangle_color(va_index + side + 1, va_index, va_index + 1);
+                }
+                va_index++;
+            }
+        }
     }
 
     VertexBufferObject vbo;
     VertexBufferObject ebo;
+    VertexBufferObject preview_ebo;
     unsigned int draw_count;
     Indices indices;
+    VertexCacheReport vertex_cache;
     unsigned int grid_size;
-};
\ No newline at end of file
+
+    // Results of every stage, kept so that a later update can rerun only
+    // some of them. Sized to the grid on the first update.
+    std::vector<float> height_map;
+    std::vector<glm::vec2> octave_offsets;
+    Attribute positions;
+    Attribute normals;
+    Attribute colors;
+
+    ProgressiveHeightMap progressive;
+
+    // The refinement's preview mesh, rebuilt per level
+    Attribute preview_positions;
+    Attribute preview_normals;
+    Attribute preview_colors;
+    Indices preview_indices;
+
+    // Whether the mesh shows the refinement's heights rather than height_map,
+    // and whether the preview mesh is bound in place of the full one
+    bool shows_progressive;
+    bool shows_preview;
+    float height_scale;
+};
@@ -0,0 +1,186 @@
+#include "flythrough.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+Flythrough::Flythrough(const std::string& name)
+    : m_name(name)
+{
+}
+
+Flythrough Flythrough::load(const std::string& path) {
+    std::ifstream file(path);
+    if(!file) {
+        throw std::runtime_error("Failed to open flythrough script " + path);
+    }
+
+    auto flythrough = Flythrough(path);
+
+    std::string line;
+    auto line_number = 0;
+    while(std::getline(file, line)) {
+        line_number++;
+
+        std::istringstream stream(line);
+        std::string kind;
+        if(!(stream >> kind) || kind[0] == '#') {
+            continue;
+        }
+
+        auto error = [&](const std::string& message) {
+            return std::runtime_error(path + ":" + std::to_string(line_number) + ": " + message);
+        };
+
+        if(kind == "camera") {
+            CameraKeyframe keyframe{};
+            if(!(stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.yaw >> keyframe.pitch)) {
+                throw error("expected camera <time> <x> <y> <z> <yaw> <pitch>");
+            }
+            flythrough.add_keyframe(keyframe);
+        } else if(kind == "set") {
+            SettingsChange change{};
+            if(!(stream >> change.time >> change.field >> change.value)) {
+                throw error("expected set <time> <field> <value>");
+            }
+            auto field = TerrainGenerator::find_settings_field(change.field);
+            if(!field) {
+                throw error("unknown settings field " + change.field);
+            }
+
+            // Fields are bounded on their own, so a change is checked
+            // against the defaults
+            if(!field->accepts(change.value)) {
+                throw error("invalid " + change.field + " " + std::to_string(change.value));
+            }
+            GenerationSettings settings;
+            field->set(settings, change.value);
+            auto invalid = TerrainGenerator::check_settings(settings);
+            if(!invalid.empty()) {
+                throw error(invalid);
+            }
+            flythrough.m_changes.push_back(change);
+        } else {
+            throw error("unknown entry " + kind);
+        }
+    }
+
+    if(flythrough.m_keyframes.empty()) {
+        throw std::runtime_error("Flythrough script " + path + " has no camera keyframes");
+    }
+
+    // Scripts may list entries in any order
+    std::stable_sort(flythrough.m_keyframes.begin(), flythrough.m_keyframes.end(), [](auto& a, auto& b) { return a.time < b.time; });
+    std::stable_sort(flythrough.m_changes.begin(), flythrough.m_changes.end(), [](auto& a, auto& b) { return a.time < b.time; });
+
+    return flythrough;
+}
+
+Flythrough Flythrough::make_default(const float grid_size) {
+    auto flythrough = Flythrough("default");
+
+    // Circle the terrain center once, looking inwards and slightly down
+    constexpr auto DURATION = 20.0f;
+    constexpr auto STEPS = 16;
+    auto center = glm::vec3(grid_size / 2.0f, 0.0f, grid_size / 2.0f);
+    auto radius = grid_size * 0.75f;
+
+    for(auto step = 0; step <= STEPS; step++) {
+        auto angle = glm::radians(360.0f * step / STEPS);
+        auto position = center + glm::vec3(-std::cos(angle) * radius, 45.0f + 15.0f * std::sin(2.0f * angle), -std::sin(angle) * radius);
+        auto yaw = glm::degrees(angle);
+        flythrough.add_keyframe(CameraKeyframe{DURATION * step / STEPS, position, yaw, -30.0f});
+    }
+
+    flythrough.m_changes = {
+        {4.0f, "seed", 1234.0},
+        {8.0f, "octaves", 7.0},
+        {12.0f, "height_scale", 25.0},
+        {16.0f, "offset_x", 20.0},
+    };
+
+    return flythrough;
+}
+
+void Flythrough::save(const std::string& path) const {
+    std::ofstream file(path);
+    file << "# time x y z yaw pitch\n";
+    for(auto& keyframe : m_keyframes) {
+        file << "camera " << keyframe.time << " "
+             << keyframe.position.x << " " << keyframe.position.y << " " << keyframe.position.z << " "
+             << keyframe.yaw << " " << keyframe.pitch << "\n";
+    }
+
+    file << "# time field value\n";
+    for(auto& change : m_changes) {
+        auto field = TerrainGenerator::find_settings_field(change.field);
+        file << "set " << change.time << " " << change.field << " " << field->format(change.value) << "\n";
+    }
+
+    if(!file) {
+        throw std::runtime_error("Failed to write flythrough script " + path);
+    }
+}
+
+void Flythrough::add_keyframe(const CameraKeyframe& keyframe) {
+    m_keyframes.push_back(keyframe);
+}
+
+void Flythrough::add_changes(float time, const GenerationSettings& before, const GenerationSettings& after) {
+    for(auto& field : TerrainGenerator::get_settings_fields()) {
+        if(field.get(before) != field.get(after)) {
+            m_changes.push_back(SettingsChange{time, field.name, field.get(after)});
+        }
+    }
+}
+
+CameraKeyframe Flythrough::sample(float time) const {
+    if(time <= m_keyframes.front().time) {
+        return m_keyframes.front();
+    }
+
+    if(time >= m_keyframes.back().time) {
+        return m_keyframes.back();
+    }
+
+    auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time, [](float t, auto& keyframe) { return t < keyframe.time; });
+    auto& to = *next;
+    auto& from = *(next - 1);
+
+    auto span = to.time - from.time;
+    auto t = span > 0.0f ? (time - from.time) / span : 1.0f;
+
+    return CameraKeyframe {
+        time,
+        glm::mix(from.position, to.position, t),
+        glm::mix(from.yaw, to.yaw, t),
+        glm::mix(from.pitch, to.pitch, t)
+    };
+}
+
+bool Flythrough::apply_changes(float from, float to, GenerationSettings& settings) const {
+    auto applied = false;
+    for(auto& change : m_changes) {
+        if(change.time > from && change.time <= to) {
+            TerrainGenerator::find_settings_field(change.field)->set(settings, change.value);
+            applied = true;
+        }
+    }
+
+    return applied;
+}
+
+float Flythrough::get_duration() const {
+    auto duration = m_keyframes.empty() ? 0.0f : m_keyframes.back().time;
+    if(!m_changes.empty()) {
+        duration = std::max(duration, m_changes.back().time);
+    }
+
+    return duration;
+}
+
+const std::string& Flythrough::get_name() const {
+    return m_name;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "terrain_generator.hpp"
+
+struct CameraKeyframe {
+    float time;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+};
+
+// Sets one GenerationSettings field, see Flythrough::apply_changes for the names
+struct SettingsChange {
+    float time;
+    std::string field;
+    double value;
+};
+
+// A camera path of keyframes plus GenerationSettings changes scheduled along
+// it, replayed at a fixed timestep so that runs are comparable. Scripts are
+// plain text, one entry per line, times in seconds and angles in degrees:
+//
+//     # time  x  y  z  yaw  pitch
+//     camera 0.0 -50 60 75 0 -35
+//     # time  field  value
+//     set 2.5 octaves 6
+//
+// Lines starting with # are comments.
+class Flythrough {
+public:
+    // An empty path, e.g. to record into
+    explicit Flythrough(const std::string& name);
+
+    static Flythrough load(const std::string& path);
+
+    // A loop around a grid_size terrain that changes the seed, octaves and
+    // height on the way, so both rendering and regeneration are covered
+    static Flythrough make_default(const float grid_size);
+
+    void save(const std::string& path) const;
+
+    void add_keyframe(const CameraKeyframe& keyframe);
+
+    // Records a change for every field that differs between the two settings
+    void add_changes(float time, const GenerationSettings& before, const GenerationSettings& after);
+
+    // Linearly interpolates the keyframes around time, clamping at both ends
+    CameraKeyframe sample(float time) const;
+
+    // Applies every change scheduled after from and up to and including to.
+    // Returns true if any was applied.
+    bool apply_changes(float from, float to, GenerationSettings& settings) const;
+
+    float get_duration() const;
+    const std::string& get_name() const;
+
+private:
+    std::string m_name;
+    std::vector<CameraKeyframe> m_keyframes;
+    std::vector<SettingsChange> m_changes;
+};
@@ -0,0 +1,187 @@
+#include "gl_diagnostics.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+// glad is generated for GL 4.1, which predates KHR_debug, so the few entry
+// points and enums needed for the debug callback are declared here
+#ifndef GL_DEBUG_OUTPUT
+#define GL_DEBUG_OUTPUT 0x92E0
+#endif
+#ifndef GL_DEBUG_OUTPUT_SYNCHRONOUS
+#define GL_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
+#endif
+#ifndef GL_DEBUG_TYPE_ERROR
+#define GL_DEBUG_TYPE_ERROR 0x824C
+#endif
+#ifndef GL_DEBUG_SEVERITY_HIGH
+#define GL_DEBUG_SEVERITY_HIGH 0x9146
+#endif
+#ifndef GL_DEBUG_SEVERITY_MEDIUM
+#define GL_DEBUG_SEVERITY_MEDIUM 0x9147
+#endif
+#ifndef GL_DEBUG_SEVERITY_NOTIFICATION
+#define GL_DEBUG_SEVERITY_NOTIFICATION 0x826B
+#endif
+
+namespace {
+    using DebugProc = void (APIENTRY *)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *user_param);
+    using DebugMessageCallbackProc = void (APIENTRY *)(DebugProc callback, const void *user_param);
+
+    std::deque<GlCallCounter> counters;
+    std::unordered_map<std::string, GlCallCounter*> counter_lookup;
+
+    GlDebugStats debug_stats{0, 0, 0, ""};
+    bool debug_callback_installed = false;
+    uint64_t last_frame_calls = 0;
+
+    void APIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *user_param) {
+        if(severity == GL_DEBUG_SEVERITY_NOTIFICATION) {
+            debug_stats.notifications++;
+            return;
+        }
+
+        if(type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH) {
+            debug_stats.errors++;
+        } else {
+            debug_stats.warnings++;
+        }
+
+        debug_stats.last_message = std::string(message, length > 0 ? length : std::strlen(message));
+        std::cerr << "GL DEBUG " << debug_stats.last_message << std::endl;
+    }
+
+    bool has_extension(const char *name) {
+        auto count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for(auto index = 0; index < count; index++) {
+            auto extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, index));
+            if(extension && std::strcmp(extension, name) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::string error_name(GLenum error) {
+        switch(error) {
+            case GL_INVALID_ENUM: return "GL_INVALID_ENUM";
+            case GL_INVALID_VALUE: return "GL_INVALID_VALUE";
+            case GL_INVALID_OPERATION: return "GL_INVALID_OPERATION";
+            case GL_INVALID_FRAMEBUFFER_OPERATION: return "GL_INVALID_FRAMEBUFFER_OPERATION";
+            case GL_OUT_OF_MEMORY: return "GL_OUT_OF_MEMORY";
+            default: return std::to_string(error);
+        }
+    }
+}
+
+namespace GlDiagnostics {
+    namespace detail {
+        uint64_t frame_calls = 0;
+    }
+
+    const char* mode_name() {
+        switch(MODE) {
+            case GL_DIAGNOSTICS_OFF: return "off";
+            case GL_DIAGNOSTICS_CALLBACK: return "debug callback";
+            case GL_DIAGNOSTICS_SYNC: return "synchronous check";
+            default: return "unknown";
+        }
+    }
+
+    void initialize(ProcLoader loader) {
+        if(MODE == GL_DIAGNOSTICS_OFF) {
+            return;
+        }
+
+        auto major = 0;
+        auto minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+        // glXGetProcAddress hands out pointers for any name, so the entry
+        // point is only looked up once the driver advertises it
+        DebugMessageCallbackProc debug_message_callback = nullptr;
+        if(major > 4 || (major == 4 && minor >= 3) || has_extension("GL_KHR_debug")) {
+            debug_message_callback = reinterpret_cast<DebugMessageCallbackProc>(loader("glDebugMessageCallback"));
+        } else if(has_extension("GL_ARB_debug_output")) {
+            debug_message_callback = reinterpret_cast<DebugMessageCallbackProc>(loader("glDebugMessageCallbackARB"));
+        }
+
+        if(!debug_message_callback) {
+            return;
+        }
+
+        glEnable(GL_DEBUG_OUTPUT);
+        if(MODE == GL_DIAGNOSTICS_SYNC) {
+            // Report messages from inside the offending call
+            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        }
+        debug_message_callback(debug_callback, nullptr);
+        debug_callback_installed = true;
+    }
+
+    bool has_debug_callback() {
+        return debug_callback_installed;
+    }
+
+    GlCallCounter& register_call(const char *call) {
+        // Strip the arguments, "glBindBuffer(type, vbo)" counts as glBindBuffer
+        auto entry_point = std::string(call);
+        entry_point = entry_point.substr(0, entry_point.find('('));
+
+        auto counter = counter_lookup.find(entry_point);
+        if(counter == counter_lookup.end()) {
+            counters.push_back(GlCallCounter{entry_point, 0, 0, 0});
+            counter = counter_lookup.emplace(entry_point, &counters.back()).first;
+        }
+
+        return *counter->second;
+    }
+
+    void end_frame() {
+        for(auto& counter : counters) {
+            counter.total_calls += counter.frame_calls;
+            counter.last_frame_calls = counter.frame_calls;
+            counter.frame_calls = 0;
+        }
+
+        last_frame_calls = detail::frame_calls;
+        detail::frame_calls = 0;
+
+        if(MODE == GL_DIAGNOSTICS_CALLBACK && !debug_callback_installed) {
+            while(GLenum error = glGetError()) {
+                debug_stats.errors++;
+                debug_stats.last_message = "GL ERROR " + error_name(error) + " during frame";
+                std::cerr << debug_stats.last_message << std::endl;
+            }
+        }
+    }
+
+    uint64_t get_frame_calls() {
+        return last_frame_calls;
+    }
+
+    const std::deque<GlCallCounter>& get_counters() {
+        return counters;
+    }
+
+    const GlDebugStats& get_debug_stats() {
+        return debug_stats;
+    }
+
+    void check_error(const char *call, int line, const char *function) {
+        if(GLenum error = glGetError()) {
+            debug_stats.errors++;
+            debug_stats.last_message = "GL ERROR "
+                + error_name(error)
+                + " at line "
+                + std::to_string(line)
+                + " in " + call + " at "
+                + std::string(function);
+            throw std::runtime_error(debug_stats.last_message);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Selects how GL_CHECK reports errors. The mode is fixed at compile time
+// (see GL_DIAGNOSTICS in src/CMakeLists.txt) so that disabled checks cost
+// nothing:
+//   OFF      - GL_CHECK expands to the bare call
+//   CALLBACK - errors arrive through glDebugMessageCallback, calls are counted
+//   SYNC     - glGetError is polled after every call, calls are counted
+#define GL_DIAGNOSTICS_OFF 0
+#define GL_DIAGNOSTICS_CALLBACK 1
+#define GL_DIAGNOSTICS_SYNC 2
+
+#ifndef GL_DIAGNOSTICS_MODE
+#define GL_DIAGNOSTICS_MODE GL_DIAGNOSTICS_OFF
+#endif
+
+// Logs every wrapped call to stdout when diagnostics are enabled
+#ifndef GL_API_DUMP
+#define GL_API_DUMP 0
+#endif
+
+struct GlCallCounter {
+    std::string entry_point;
+    uint64_t total_calls;
+    uint64_t frame_calls;
+    uint64_t last_frame_calls;
+};
+
+struct GlDebugStats {
+    uint64_t errors;
+    uint64_t warnings;
+    uint64_t notifications;
+    std::string last_message;
+};
+
+namespace GlDiagnostics {
+    using ProcLoader = void* (*)(const char *name);
+
+    constexpr int MODE = GL_DIAGNOSTICS_MODE;
+
+    // Drivers only guarantee debug messages on a debug context, and may
+    // validate more and run slower on one, so it is only requested by the
+    // modes that report errors
+    constexpr bool DEBUG_CONTEXT = MODE != GL_DIAGNOSTICS_OFF;
+
+    const char* mode_name();
+
+    // Installs the debug message callback when the driver exposes KHR_debug
+    // (or ARB_debug_output). Must be called with a current context.
+    void initialize(ProcLoader loader);
+    bool has_debug_callback();
+
+    // Every GL_CHECK call site registers once and keeps the returned counter.
+    // Call sites of the same entry point share one counter.
+    GlCallCounter& register_call(const char *call);
+
+    // Rolls the per-frame counters over. Without a debug callback this is
+    // also where CALLBACK mode polls glGetError, once per frame.
+    void end_frame();
+
+    uint64_t get_frame_calls();
+    const std::deque<GlCallCounter>& get_counters();
+    const GlDebugStats& get_debug_stats();
+
+    void check_error(const char *call, int line, const char *function);
+
+    namespace detail {
+        extern uint64_t frame_calls;
+    }
+
+    // Single threaded like the rest of the GL code, so plain increments suffice
+    inline void count(GlCallCounter& counter) {
+        counter.frame_calls++;
+        detail::frame_calls++;
+    }
+}
+
+#if GL_DIAGNOSTICS_MODE == GL_DIAGNOSTICS_OFF
+
+#define GL_CHECK(func) func
+
+#else
+
+#if GL_DIAGNOSTICS_MODE == GL_DIAGNOSTICS_SYNC
+#define GL_CHECK_ERROR(func) GlDiagnostics::check_error(#func, __LINE__, __PRETTY_FUNCTION__)
+#else
+#define GL_CHECK_ERROR(func)
+#endif
+
+#define GL_CHECK(func) func;                                                \
+{                                                                           \
+    static GlCallCounter& gl_call_counter = GlDiagnostics::register_call(#func); \
+    GlDiagnostics::count(gl_call_counter);                                  \
+    if(GL_API_DUMP) {                                                       \
+        std::cout << #func << std::endl;                                    \
+    }                                                                       \
+    GL_CHECK_ERROR(func);                                                   \
+}
+
+#endif
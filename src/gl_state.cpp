@@ -0,0 +1,160 @@
+#include "gl_state.hpp"
+
+#include "gl_diagnostics.hpp"
+
+namespace {
+    // No GL name can be this value, so it marks a binding that is not known
+    constexpr GLuint UNKNOWN = ~0u;
+
+    struct BufferBinding {
+        GLenum target;
+        GLuint buffer;
+    };
+
+    GLuint current_program = UNKNOWN;
+    GLuint current_vertex_array = UNKNOWN;
+    BufferBinding current_buffers[] = {
+        {GL_ARRAY_BUFFER, UNKNOWN},
+        {GL_ELEMENT_ARRAY_BUFFER, UNKNOWN},
+        {GL_UNIFORM_BUFFER, UNKNOWN},
+    };
+
+    // Texture units above this are bound directly
+    constexpr GLuint TRACKED_TEXTURE_UNITS = 8;
+
+    struct TextureBinding {
+        GLenum target;
+        GLuint texture;
+    };
+
+    GLuint current_texture_unit = UNKNOWN;
+    TextureBinding current_textures[TRACKED_TEXTURE_UNITS] = {};
+
+    GlStateStats frame_stats{};
+    GlStateStats last_frame_stats{};
+
+    BufferBinding* find_binding(GLenum target) {
+        for(auto& binding : current_buffers) {
+            if(binding.target == target) {
+                return &binding;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool changes(GLuint& current, GLuint value, GlBindStats& stats) {
+        if(current == value) {
+            stats.skipped++;
+            return false;
+        }
+
+        current = value;
+        stats.issued++;
+        return true;
+    }
+}
+
+namespace GlState {
+    void use_program(GLuint program) {
+        if(changes(current_program, program, frame_stats.programs)) {
+            GL_CHECK(glUseProgram(program));
+        }
+    }
+
+    void bind_vertex_array(GLuint vao) {
+        if(changes(current_vertex_array, vao, frame_stats.vertex_arrays)) {
+            GL_CHECK(glBindVertexArray(vao));
+
+            // The element buffer binding is part of the VAO
+            find_binding(GL_ELEMENT_ARRAY_BUFFER)->buffer = UNKNOWN;
+        }
+    }
+
+    void bind_buffer(GLenum target, GLuint buffer) {
+        auto binding = find_binding(target);
+        if(!binding) {
+            frame_stats.buffers.issued++;
+            GL_CHECK(glBindBuffer(target, buffer));
+            return;
+        }
+
+        if(changes(binding->buffer, buffer, frame_stats.buffers)) {
+            GL_CHECK(glBindBuffer(target, buffer));
+        }
+    }
+
+    void bind_texture(GLuint unit, GLenum target, GLuint texture) {
+        // The unit is selected even when the texture is already bound there,
+        // since callers upload to the texture right after binding it
+        if(current_texture_unit != unit) {
+            current_texture_unit = unit;
+            GL_CHECK(glActiveTexture(GL_TEXTURE0 + unit));
+        }
+
+        if(unit < TRACKED_TEXTURE_UNITS 
+            && current_textures[unit].target == target 
+            && current_textures[unit].texture == texture) {
+            frame_stats.textures.skipped++;
+            return;
+        }
+
+        GL_CHECK(glBindTexture(target, texture));
+        frame_stats.textures.issued++;
+
+        if(unit < TRACKED_TEXTURE_UNITS) {
+            current_textures[unit] = TextureBinding{target, texture};
+        }
+    }
+
+    void forget_program(GLuint program) {
+        if(current_program == program) {
+            current_program = UNKNOWN;
+        }
+    }
+
+    void forget_vertex_array(GLuint vao) {
+        if(current_vertex_array == vao) {
+            current_vertex_array = UNKNOWN;
+            find_binding(GL_ELEMENT_ARRAY_BUFFER)->buffer = UNKNOWN;
+        }
+    }
+
+    void forget_buffer(GLuint buffer) {
+        for(auto& binding : current_buffers) {
+            if(binding.buffer == buffer) {
+                binding.buffer = UNKNOWN;
+            }
+        }
+    }
+
+    void forget_texture(GLuint texture) {
+        for(auto& binding : current_textures) {
+            if(binding.texture == texture) {
+                binding = TextureBinding{};
+            }
+        }
+    }
+
+    void invalidate() {
+        current_program = UNKNOWN;
+        current_vertex_array = UNKNOWN;
+        for(auto& binding : current_buffers) {
+            binding.buffer = UNKNOWN;
+        }
+
+        current_texture_unit = UNKNOWN;
+        for(auto& binding : current_textures) {
+            binding = TextureBinding{};
+        }
+    }
+
+    void end_frame() {
+        last_frame_stats = frame_stats;
+        frame_stats = GlStateStats{};
+    }
+
+    const GlStateStats& get_frame_stats() {
+        return last_frame_stats;
+    }
+}
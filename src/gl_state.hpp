@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glad/glad.h>
+
+struct GlBindStats {
+    uint64_t issued;
+    uint64_t skipped;
+};
+
+struct GlStateStats {
+    GlBindStats programs;
+    GlBindStats vertex_arrays;
+    GlBindStats buffers;
+    GlBindStats textures;
+};
+
+// Shadow copy of the binding state the renderer touches. Every program, VAO,
+// buffer and texture bind goes through here so that binds of what is already bound
+// never reach the driver. Code that changes bindings behind its back (e.g.
+// a third party renderer) must call invalidate() afterwards.
+namespace GlState {
+    void use_program(GLuint program);
+    void bind_vertex_array(GLuint vao);
+    void bind_buffer(GLenum target, GLuint buffer);
+
+    // Also leaves unit active, bound already or not, so that the texture
+    // can be uploaded to right after
+    void bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+    // Deleting a bound object resets its binding to 0, and its name may be
+    // handed out again, so deletions must be reported
+    void forget_program(GLuint program);
+    void forget_vertex_array(GLuint vao);
+    void forget_buffer(GLuint buffer);
+    void forget_texture(GLuint texture);
+
+    void invalidate();
+
+    // Rolls the per-frame statistics over
+    void end_frame();
+    const GlStateStats& get_frame_stats();
+}
@@ -0,0 +1,190 @@
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler()
+    : m_supported(false),
+      m_enabled(false),
+      m_in_frame(false),
+      m_frame_index(0),
+      m_frames{},
+      m_frame_stats{"frame", 0.0f, 0.0f, 0.0f, 0}
+{
+    // Timer queries are core since 3.3, but a zero-bit counter means the
+    // implementation cannot actually measure anything
+    auto counter_bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &counter_bits);
+    m_supported = counter_bits > 0;
+}
+
+GpuProfiler::~GpuProfiler() {
+    for(auto& frame : m_frames) {
+        if(!frame.queries.empty()) {
+            glDeleteQueries(frame.queries.size(), frame.queries.data());
+        }
+    }
+}
+
+bool GpuProfiler::is_supported() const {
+    return m_supported;
+}
+
+bool GpuProfiler::is_enabled() const {
+    return m_enabled;
+}
+
+void GpuProfiler::set_enabled(bool enabled) {
+    if(m_in_frame) {
+        throw std::runtime_error("GpuProfiler cannot be toggled inside a frame");
+    }
+
+    m_enabled = enabled && m_supported;
+}
+
+void GpuProfiler::begin_frame() {
+    if(!m_enabled) {
+        return;
+    }
+
+    // This slot was last used FRAME_LATENCY frames ago
+    auto& frame = m_frames[m_frame_index % FRAME_LATENCY];
+    collect(frame);
+
+    frame.used_queries = 0;
+    frame.sections.clear();
+    frame.begin_query = acquire_query(frame);
+    frame.end_query = 0;
+    glQueryCounter(frame.begin_query, GL_TIMESTAMP);
+
+    m_open_sections.clear();
+    m_in_frame = true;
+}
+
+void GpuProfiler::end_frame() {
+    if(!m_in_frame) {
+        return;
+    }
+
+    if(!m_open_sections.empty()) {
+        throw std::runtime_error("GpuProfiler frame ended with open sections");
+    }
+
+    auto& frame = m_frames[m_frame_index % FRAME_LATENCY];
+    frame.end_query = acquire_query(frame);
+    glQueryCounter(frame.end_query, GL_TIMESTAMP);
+    frame.pending = true;
+
+    m_in_frame = false;
+    m_frame_index++;
+}
+
+void GpuProfiler::begin(const std::string& label) {
+    if(!m_in_frame) {
+        return;
+    }
+
+    auto stat = m_stat_lookup.find(label);
+    if(stat == m_stat_lookup.end()) {
+        stat = m_stat_lookup.emplace(label, m_stats.size()).first;
+        m_stats.push_back(GpuTimingStats{label, 0.0f, 0.0f, 0.0f, 0});
+    }
+
+    auto& frame = m_frames[m_frame_index % FRAME_LATENCY];
+    auto query = acquire_query(frame);
+    glQueryCounter(query, GL_TIMESTAMP);
+
+    m_open_sections.push_back(frame.sections.size());
+    frame.sections.push_back(Section{stat->second, query, 0});
+}
+
+void GpuProfiler::end() {
+    if(!m_in_frame) {
+        return;
+    }
+
+    if(m_open_sections.empty()) {
+        throw std::runtime_error("GpuProfiler::end called without matching begin");
+    }
+
+    auto& frame = m_frames[m_frame_index % FRAME_LATENCY];
+    auto query = acquire_query(frame);
+    glQueryCounter(query, GL_TIMESTAMP);
+
+    frame.sections[m_open_sections.back()].end_query = query;
+    m_open_sections.pop_back();
+}
+
+void GpuProfiler::reset_stats() {
+    m_frame_stats = GpuTimingStats{"frame", 0.0f, 0.0f, 0.0f, 0};
+    for(auto& stats : m_stats) {
+        stats = GpuTimingStats{stats.label, 0.0f, 0.0f, 0.0f, 0};
+    }
+}
+
+const GpuTimingStats& GpuProfiler::get_frame_stats() const {
+    return m_frame_stats;
+}
+
+const std::vector<GpuTimingStats>& GpuProfiler::get_stats() const {
+    return m_stats;
+}
+
+GLuint GpuProfiler::acquire_query(Frame& frame) {
+    if(frame.used_queries == frame.queries.size()) {
+        // Grow the pool geometrically so steady state never generates queries
+        auto grow_by = std::max<std::size_t>(frame.queries.size(), 16);
+        frame.queries.resize(frame.queries.size() + grow_by);
+        glGenQueries(grow_by, frame.queries.data() + frame.used_queries);
+    }
+
+    return frame.queries[frame.used_queries++];
+}
+
+void GpuProfiler::collect(Frame& frame) {
+    if(!frame.pending) {
+        return;
+    }
+    frame.pending = false;
+
+    // Counters complete in submission order, so once the last one is
+    // available every earlier one is too. If it is not, the GPU is more than
+    // FRAME_LATENCY frames behind and the sample is dropped instead of waiting.
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(frame.end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(available != GL_TRUE) {
+        return;
+    }
+
+    auto read_ns = [](GLuint query) {
+        GLuint64 time = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &time);
+        return time;
+    };
+
+    auto frame_ns = read_ns(frame.end_query) - read_ns(frame.begin_query);
+    record(m_frame_stats, frame_ns / 1.0e6f);
+
+    // A label drawn several times per frame reports its summed time
+    std::vector<double> totals(m_stats.size(), -1.0);
+    for(auto& section : frame.sections) {
+        auto elapsed_ns = read_ns(section.end_query) - read_ns(section.begin_query);
+        auto& total = totals[section.stat_index];
+        total = std::max(total, 0.0) + elapsed_ns / 1.0e6;
+    }
+
+    for(std::size_t index = 0; index < totals.size(); index++) {
+        if(totals[index] >= 0.0) {
+            record(m_stats[index], static_cast<float>(totals[index]));
+        }
+    }
+}
+
+void GpuProfiler::record(GpuTimingStats& stats, float ms) {
+    stats.last_ms = ms;
+    stats.max_ms = std::max(stats.max_ms, ms);
+    stats.average_ms = stats.samples == 0
+        ? ms
+        : stats.average_ms + (ms - stats.average_ms) * SMOOTHING;
+    stats.samples++;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+struct GpuTimingStats {
+    std::string label;
+    float last_ms;
+    float average_ms;
+    float max_ms;
+    uint64_t samples;
+};
+
+// Measures GPU time per labelled section and per frame using GL_TIMESTAMP
+// counters. Elapsed-time queries cannot be nested, timestamps can, so the
+// frame and every section inside it are bracketed with a pair of counters.
+// Results are read back FRAME_LATENCY frames after they were issued and only
+// if the driver reports them available, so the pipeline never stalls.
+class GpuProfiler {
+public:
+    static constexpr std::size_t FRAME_LATENCY = 4;
+
+    // Running average weight of the newest sample
+    static constexpr float SMOOTHING = 0.1f;
+
+    GpuProfiler();
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    bool is_supported() const;
+    bool is_enabled() const;
+    void set_enabled(bool enabled);
+
+    void begin_frame();
+    void end_frame();
+
+    void begin(const std::string& label);
+    void end();
+
+    void reset_stats();
+
+    const GpuTimingStats& get_frame_stats() const;
+    const std::vector<GpuTimingStats>& get_stats() const;
+
+private:
+    struct Section {
+        std::size_t stat_index;
+        GLuint begin_query;
+        GLuint end_query;
+    };
+
+    struct Frame {
+        std::vector<GLuint> queries;
+        std::size_t used_queries;
+        std::vector<Section> sections;
+        GLuint begin_query;
+        GLuint end_query;
+        bool pending;
+    };
+
+    GLuint acquire_query(Frame& frame);
+    void collect(Frame& frame);
+    static void record(GpuTimingStats& stats, float ms);
+
+    bool m_supported;
+    bool m_enabled;
+    bool m_in_frame;
+    uint64_t m_frame_index;
+
+    Frame m_frames[FRAME_LATENCY];
+    std::vector<std::size_t> m_open_sections;
+
+    GpuTimingStats m_frame_stats;
+    std::vector<GpuTimingStats> m_stats;
+    std::unordered_map<std::string, std::size_t> m_stat_lookup;
+};
+
+// Times everything issued during its lifetime as one section. A null profiler
+// makes the scope a no-op.
+class GpuTimerScope {
+public:
+    GpuTimerScope(GpuProfiler* profiler, const std::string& label)
+        : m_profiler(profiler)
+    {
+        if(m_profiler) {
+            m_profiler->begin(label);
+        }
+    }
+
+    ~GpuTimerScope() {
+        if(m_profiler) {
+            m_profiler->end();
+        }
+    }
+
+    GpuTimerScope(const GpuTimerScope&) = delete;
+    GpuTimerScope& operator=(const GpuTimerScope&) = delete;
+
+private:
+    GpuProfiler* m_profiler;
+};
@@ -0,0 +1,258 @@
+#include "height_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t MAGIC = 0x31544648; // "HFT1"
+
+    // Samples sharing one Rice parameter
+    constexpr unsigned int BLOCK_SIZE = 32;
+
+    // Quotients from this on are escaped and followed by the raw residual
+    constexpr unsigned int ESCAPE = 24;
+    constexpr unsigned int RESIDUAL_BITS = 17;
+    constexpr unsigned int PARAMETER_BITS = 5;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        float min;
+        float max;
+    };
+
+    // Bits are written least significant first, which lets the reader find
+    // the end of a unary run with a single count of trailing ones
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& t_out) : out(t_out), buffer(0), count(0) {}
+
+        void write(uint64_t value, unsigned int bits) {
+            buffer |= value << count;
+            count += bits;
+            while(count >= 8) {
+                out.push_back(static_cast<uint8_t>(buffer));
+                buffer >>= 8;
+                count -= 8;
+            }
+        }
+
+        void write_ones(unsigned int bits) {
+            while(bits > 32) {
+                write(0xffffffffull, 32);
+                bits -= 32;
+            }
+            write((1ull << bits) - 1, bits);
+        }
+
+        void flush() {
+            if(count > 0) {
+                out.push_back(static_cast<uint8_t>(buffer));
+            }
+            buffer = 0;
+            count = 0;
+        }
+
+    private:
+        std::vector<uint8_t>& out;
+        uint64_t buffer;
+        unsigned int count;
+    };
+
+    class BitReader {
+    public:
+        BitReader(const uint8_t* t_data, std::size_t t_size) : data(t_data), size(t_size), position(0), buffer(0), count(0) {}
+
+        // Keeps at least 57 bits buffered, zeros past the end of the data
+        void refill() {
+            while(count <= 56) {
+                auto byte = position < size ? data[position] : 0;
+                buffer |= static_cast<uint64_t>(byte) << count;
+                position++;
+                count += 8;
+            }
+        }
+
+        uint32_t read(unsigned int bits) {
+            refill();
+            auto value = static_cast<uint32_t>(buffer & ((1ull << bits) - 1));
+            buffer >>= bits;
+            count -= bits;
+            return value;
+        }
+
+        // Length of a run of ones and its terminating zero, capped at ESCAPE
+        unsigned int read_unary() {
+            refill();
+            auto zeros = ~buffer;
+            auto ones = zeros ? static_cast<unsigned int>(__builtin_ctzll(zeros)) : 64u;
+            if(ones >= ESCAPE) {
+                buffer >>= ESCAPE;
+                count -= ESCAPE;
+                return ESCAPE;
+            }
+            buffer >>= ones + 1;
+            count -= ones + 1;
+            return ones;
+        }
+
+        // Reading into the zero padding is fine, reading past it is not
+        bool overran() const {
+            return position > size + 8;
+        }
+
+    private:
+        const uint8_t* data;
+        std::size_t size;
+        std::size_t position;
+        uint64_t buffer;
+        unsigned int count;
+    };
+
+    // Median of left, up and the gradient left + up - upper_left
+    inline int predict(const uint16_t* samples, unsigned int width, unsigned int x, unsigned int y) {
+        if(y == 0) {
+            return x == 0 ? 0 : samples[x - 1];
+        }
+
+        auto index = y * width + x;
+        int up = samples[index - width];
+        if(x == 0) {
+            return up;
+        }
+
+        int left = samples[index - 1];
+        int upper_left = samples[index - width - 1];
+        if(upper_left >= std::max(left, up)) {
+            return std::min(left, up);
+        }
+        if(upper_left <= std::min(left, up)) {
+            return std::max(left, up);
+        }
+        return left + up - upper_left;
+    }
+
+    inline uint32_t zigzag(int value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    inline int unzigzag(uint32_t value) {
+        return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+    }
+
+    // Smallest k for which the block's quotients stay short, from the mean
+    unsigned int rice_parameter(const uint32_t* residuals, unsigned int count) {
+        uint64_t sum = 0;
+        for(auto index = 0u; index < count; index++) {
+            sum += residuals[index];
+        }
+
+        auto parameter = 0u;
+        while(parameter < RESIDUAL_BITS && (static_cast<uint64_t>(count) << parameter) < sum) {
+            parameter++;
+        }
+        return parameter;
+    }
+}
+
+namespace HeightCodec {
+    void compress(const HeightField& field, std::vector<uint8_t>& out) {
+        auto samples = field.get_samples16();
+        if(!samples) {
+            throw std::runtime_error("Only 16 bit height fields can be compressed");
+        }
+
+        Header header{MAGIC, field.get_width(), field.get_height(), static_cast<uint32_t>(field.get_format()), field.get_min(), field.get_max()};
+        auto header_offset = out.size();
+        out.resize(header_offset + sizeof(header));
+        std::memcpy(out.data() + header_offset, &header, sizeof(header));
+
+        auto width = field.get_width();
+        auto sample_count = static_cast<std::size_t>(width) * field.get_height();
+
+        BitWriter writer(out);
+        uint32_t residuals[BLOCK_SIZE];
+        auto x = 0u;
+        auto y = 0u;
+        for(auto first = std::size_t{0}; first < sample_count; first += BLOCK_SIZE) {
+            auto count = static_cast<unsigned int>(std::min<std::size_t>(BLOCK_SIZE, sample_count - first));
+            for(auto offset = 0u; offset < count; offset++) {
+                residuals[offset] = zigzag(samples[first + offset] - predict(samples, width, x, y));
+                if(++x == width) {
+                    x = 0;
+                    y++;
+                }
+            }
+
+            auto parameter = rice_parameter(residuals, count);
+            writer.write(parameter, PARAMETER_BITS);
+            for(auto offset = 0u; offset < count; offset++) {
+                auto quotient = residuals[offset] >> parameter;
+                if(quotient >= ESCAPE) {
+                    writer.write_ones(ESCAPE);
+                    writer.write(residuals[offset], RESIDUAL_BITS);
+                    continue;
+                }
+
+                // Unary quotient terminated by a zero, then the remainder
+                writer.write_ones(quotient);
+                writer.write(0, 1);
+                writer.write(residuals[offset] & ((1u << parameter) - 1), parameter);
+            }
+        }
+        writer.flush();
+    }
+
+    void decompress(const std::vector<uint8_t>& data, HeightField& field) {
+        Header header{};
+        if(data.size() < sizeof(header)) {
+            throw std::runtime_error("Compressed height field is truncated");
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        auto samples = field.get_samples16();
+        if(header.magic != MAGIC
+            || header.width != field.get_width()
+            || header.height != field.get_height()
+            || header.format != static_cast<uint32_t>(field.get_format())
+            || !samples) {
+            throw std::runtime_error("Compressed height field does not match its destination");
+        }
+
+        auto width = header.width;
+        auto sample_count = static_cast<std::size_t>(width) * header.height;
+
+        BitReader reader(data.data() + sizeof(header), data.size() - sizeof(header));
+        auto x = 0u;
+        auto y = 0u;
+        for(auto first = std::size_t{0}; first < sample_count; first += BLOCK_SIZE) {
+            auto count = static_cast<unsigned int>(std::min<std::size_t>(BLOCK_SIZE, sample_count - first));
+            auto parameter = reader.read(PARAMETER_BITS);
+            if(parameter > RESIDUAL_BITS) {
+                throw std::runtime_error("Compressed height field is corrupt");
+            }
+
+            for(auto offset = 0u; offset < count; offset++) {
+                auto quotient = reader.read_unary();
+                auto residual = quotient == ESCAPE
+                    ? reader.read(RESIDUAL_BITS)
+                    : (quotient << parameter) | reader.read(parameter);
+
+                samples[first + offset] = static_cast<uint16_t>(predict(samples, width, x, y) + unzigzag(residual));
+                if(++x == width) {
+                    x = 0;
+                    y++;
+                }
+            }
+        }
+
+        if(reader.overran()) {
+            throw std::runtime_error("Compressed height field is truncated");
+        }
+
+        field.set_range(header.min, header.max);
+    }
+}
@@ -0,0 +1,287 @@
+#include "height_field.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    constexpr float UNORM16_SCALE = 65535.0f;
+
+    uint16_t encode_unorm16(float value) {
+        return static_cast<uint16_t>(std::clamp(value, 0.0f, 1.0f) * UNORM16_SCALE + 0.5f);
+    }
+
+    float decode_unorm16(uint16_t value) {
+        return value * (1.0f / UNORM16_SCALE);
+    }
+
+    // Round to nearest even, overflow goes to infinity and NaN stays NaN
+    uint16_t encode_float16(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        auto magnitude = bits & 0x7fffffff;
+
+        if(magnitude >= 0x7f800000) {
+            return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+        }
+        if(magnitude >= 0x477ff000) {
+            return sign | 0x7c00;
+        }
+        if(magnitude < 0x38800000) {
+            // Subnormal in half precision, let the FPU do the rounding
+            float absolute;
+            std::memcpy(&absolute, &magnitude, sizeof(absolute));
+            return sign | static_cast<uint16_t>(std::nearbyint(absolute * 16777216.0f));
+        }
+
+        auto rounded = magnitude + 0xfff + ((magnitude >> 13) & 1);
+        return sign | static_cast<uint16_t>((rounded - 0x38000000) >> 13);
+    }
+
+    float decode_float16(uint16_t value) {
+        auto sign = static_cast<uint32_t>(value & 0x8000) << 16;
+        auto exponent = (value >> 10) & 0x1f;
+        auto mantissa = static_cast<uint32_t>(value & 0x3ff);
+
+        uint32_t bits;
+        if(exponent == 0x1f) {
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        } else if(exponent == 0) {
+            // Zero or subnormal, exactly representable as a float
+            auto magnitude = mantissa / 16777216.0f;
+            std::memcpy(&bits, &magnitude, sizeof(bits));
+            bits |= sign;
+        } else {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    void decode_unorm16(const uint16_t* in, std::size_t count, float* out) {
+        auto index = std::size_t{0};
+#ifdef __SSE2__
+        const auto zero = _mm_setzero_si128();
+        const auto scale = _mm_set1_ps(1.0f / UNORM16_SCALE);
+        for(; index + 8 <= count; index += 8) {
+            auto packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index));
+            auto low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, zero));
+            auto high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(packed, zero));
+            _mm_storeu_ps(out + index, _mm_mul_ps(low, scale));
+            _mm_storeu_ps(out + index + 4, _mm_mul_ps(high, scale));
+        }
+#endif
+        for(; index < count; index++) {
+            out[index] = decode_unorm16(in[index]);
+        }
+    }
+
+#ifdef __SSE2__
+    // Four halves in the low 16 bits of each lane to floats. Shifting the
+    // exponent and mantissa into place and scaling by 2^112 rebiases the
+    // exponent and normalizes subnormals in one multiply.
+    __m128 decode_float16x4(__m128i halves) {
+        const auto magnitude_mask = _mm_set1_epi32(0x7fff);
+        const auto rebias = _mm_castsi128_ps(_mm_set1_epi32(0x77800000));
+        const auto infinity_threshold = _mm_set1_epi32(0x7bff << 13);
+        const auto float_infinity = _mm_set1_epi32(0x7f800000);
+
+        auto shifted = _mm_slli_epi32(_mm_and_si128(halves, magnitude_mask), 13);
+        auto scaled = _mm_mul_ps(_mm_castsi128_ps(shifted), rebias);
+
+        // Infinities and NaNs keep their mantissa but need a full exponent
+        auto special = _mm_cmpgt_epi32(shifted, infinity_threshold);
+        auto magnitude = _mm_or_si128(_mm_castps_si128(scaled), _mm_and_si128(special, float_infinity));
+
+        auto sign = _mm_slli_epi32(_mm_andnot_si128(magnitude_mask, halves), 16);
+        return _mm_castsi128_ps(_mm_or_si128(magnitude, sign));
+    }
+#endif
+
+    void decode_float16(const uint16_t* in, std::size_t count, float* out) {
+        auto index = std::size_t{0};
+#ifdef __SSE2__
+        const auto zero = _mm_setzero_si128();
+        for(; index + 8 <= count; index += 8) {
+            auto packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index));
+            _mm_storeu_ps(out + index, decode_float16x4(_mm_unpacklo_epi16(packed, zero)));
+            _mm_storeu_ps(out + index + 4, decode_float16x4(_mm_unpackhi_epi16(packed, zero)));
+        }
+#endif
+        for(; index < count; index++) {
+            out[index] = decode_float16(in[index]);
+        }
+    }
+}
+
+HeightField::HeightField()
+    : HeightField(0, 0, HeightFormat::FLOAT32)
+{
+}
+
+HeightField::HeightField(const unsigned int width, const unsigned int height, const HeightFormat format)
+    : m_width(width),
+      m_height(height),
+      m_format(format),
+      m_min(0.0f),
+      m_max(0.0f),
+      m_floats(),
+      m_samples16()
+{
+    auto count = static_cast<std::size_t>(width) * height;
+    if(format == HeightFormat::FLOAT32) {
+        m_floats.resize(count);
+    } else {
+        m_samples16.resize(count);
+    }
+}
+
+std::size_t HeightField::get_sample_size(const HeightFormat format) {
+    return format == HeightFormat::FLOAT32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+void HeightField::encode(const std::vector<float>& samples) {
+    if(samples.size() != static_cast<std::size_t>(m_width) * m_height) {
+        throw std::runtime_error("Height field of " + std::to_string(m_width) + "x" + std::to_string(m_height)
+            + " cannot encode " + std::to_string(samples.size()) + " samples");
+    }
+
+    m_min = std::numeric_limits<float>::max();
+    m_max = std::numeric_limits<float>::lowest();
+    for(auto sample : samples) {
+        m_min = std::min(m_min, sample);
+        m_max = std::max(m_max, sample);
+    }
+
+    switch(m_format) {
+        case HeightFormat::FLOAT32:
+            std::copy(samples.begin(), samples.end(), m_floats.begin());
+            break;
+        case HeightFormat::UNORM16:
+            std::transform(samples.begin(), samples.end(), m_samples16.begin(), [](float sample) {
+                return encode_unorm16(sample);
+            });
+            break;
+        case HeightFormat::FLOAT16:
+            std::transform(samples.begin(), samples.end(), m_samples16.begin(), [](float sample) {
+                return encode_float16(sample);
+            });
+            break;
+    }
+}
+
+void HeightField::decode(std::vector<float>& samples) const {
+    samples.resize(static_cast<std::size_t>(m_width) * m_height);
+    decode(0, samples.size(), samples.data());
+}
+
+void HeightField::decode(const std::size_t first, const std::size_t count, float* out) const {
+    switch(m_format) {
+        case HeightFormat::FLOAT32:
+            std::copy_n(m_floats.data() + first, count, out);
+            break;
+        case HeightFormat::UNORM16:
+            decode_unorm16(m_samples16.data() + first, count, out);
+            break;
+        case HeightFormat::FLOAT16:
+            decode_float16(m_samples16.data() + first, count, out);
+            break;
+    }
+}
+
+float HeightField::get(const unsigned int x, const unsigned int y) const {
+    auto index = static_cast<std::size_t>(y) * m_width + x;
+    switch(m_format) {
+        case HeightFormat::UNORM16:
+            return decode_unorm16(m_samples16[index]);
+        case HeightFormat::FLOAT16:
+            return decode_float16(m_samples16[index]);
+        default:
+            return m_floats[index];
+    }
+}
+
+unsigned int HeightField::get_width() const {
+    return m_width;
+}
+
+unsigned int HeightField::get_height() const {
+    return m_height;
+}
+
+HeightFormat HeightField::get_format() const {
+    return m_format;
+}
+
+float HeightField::get_min() const {
+    return m_min;
+}
+
+float HeightField::get_max() const {
+    return m_max;
+}
+
+const void* HeightField::get_data() const {
+    if(m_format == HeightFormat::FLOAT32) {
+        return m_floats.data();
+    }
+    return m_samples16.data();
+}
+
+const uint16_t* HeightField::get_samples16() const {
+    return m_samples16.empty() ? nullptr : m_samples16.data();
+}
+
+uint16_t* HeightField::get_samples16() {
+    return m_samples16.empty() ? nullptr : m_samples16.data();
+}
+
+void HeightField::set_range(const float min, const float max) {
+    m_min = min;
+    m_max = max;
+}
+
+std::size_t HeightField::get_byte_size() const {
+    return static_cast<std::size_t>(m_width) * m_height * get_sample_size(m_format);
+}
+
+void HeightField::save_pgm(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if(!file) {
+        throw std::runtime_error("Cannot write height field to " + path);
+    }
+
+    write_pgm(file);
+
+    if(!file) {
+        throw std::runtime_error("Failed writing height field to " + path);
+    }
+}
+
+void HeightField::write_pgm(std::ostream& out) const {
+    out << "P5\n" << m_width << " " << m_height << "\n65535\n";
+
+    // Decoded a row at a time, PGM samples are big endian
+    std::vector<float> row(m_width);
+    std::vector<unsigned char> bytes(m_width * 2);
+    for(auto y = 0u; y < m_height; y++) {
+        decode(static_cast<std::size_t>(y) * m_width, m_width, row.data());
+        for(auto x = 0u; x < m_width; x++) {
+            auto sample = encode_unorm16(row[x]);
+            bytes[x * 2] = static_cast<unsigned char>(sample >> 8);
+            bytes[x * 2 + 1] = static_cast<unsigned char>(sample & 0xff);
+        }
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class HeightFormat {
+    FLOAT32,
+    // Unsigned normalized over [0, 1], values outside are clamped
+    UNORM16,
+    // IEEE 754 half precision
+    FLOAT16
+};
+
+// A width x height grid of heights, row major, in one of the HeightFormat
+// storage formats. The 16 bit formats take half the memory of float32 and
+// can be uploaded to the GPU as they are. encode() records the range of the
+// samples so that bounds are known without decoding.
+class HeightField {
+public:
+    HeightField();
+    HeightField(const unsigned int width, const unsigned int height, const HeightFormat format);
+
+    static std::size_t get_sample_size(const HeightFormat format);
+
+    // samples must hold width * height values
+    void encode(const std::vector<float>& samples);
+
+    // Resizes samples to width * height
+    void decode(std::vector<float>& samples) const;
+
+    // Decodes count samples starting at sample first into out
+    void decode(const std::size_t first, const std::size_t count, float* out) const;
+
+    float get(const unsigned int x, const unsigned int y) const;
+
+    unsigned int get_width() const;
+    unsigned int get_height() const;
+    HeightFormat get_format() const;
+
+    // Of the samples passed to the last encode(), before quantization
+    float get_min() const;
+    float get_max() const;
+
+    // Raw samples in the storage format
+    const void* get_data() const;
+    std::size_t get_byte_size() const;
+
+    // Raw samples of the 16 bit formats, null for float32. Whoever writes
+    // them directly, e.g. a codec, must restore the range with set_range().
+    const uint16_t* get_samples16() const;
+    uint16_t* get_samples16();
+    void set_range(const float min, const float max);
+
+    // Writes a 16 bit binary PGM with [0, 1] mapped onto [0, 65535], the
+    // format most terrain tools import. Throws std::runtime_error on failure.
+    void save_pgm(const std::string& path) const;
+
+    // save_pgm() into a stream, e.g. a network response
+    void write_pgm(std::ostream& out) const;
+
+private:
+    unsigned int m_width;
+    unsigned int m_height;
+    HeightFormat m_format;
+    float m_min;
+    float m_max;
+
+    // Only the one matching m_format is used
+    std::vector<float> m_floats;
+    std::vector<uint16_t> m_samples16;
+};
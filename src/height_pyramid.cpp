@@ -0,0 +1,92 @@
+#include "height_pyramid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+HeightPyramid::HeightPyramid()
+    : m_width(0),
+      m_depth(0),
+      m_sizes(),
+      m_levels()
+{
+}
+
+HeightPyramid::HeightPyramid(const unsigned int width, const unsigned int depth, const std::vector<float>& heights)
+    : m_width(width),
+      m_depth(depth),
+      m_sizes(),
+      m_levels()
+{
+    if(width < 2 || depth < 2) {
+        throw std::runtime_error("Height pyramid needs at least 2x2 heights");
+    }
+
+    auto size = glm::uvec2(width - 1, depth - 1);
+    do {
+        size = (size + 1u) / 2u;
+        m_sizes.push_back(size);
+        m_levels.emplace_back(static_cast<std::size_t>(size.x) * size.y);
+    } while(size.x > 1 || size.y > 1);
+
+    build(heights);
+}
+
+void HeightPyramid::build(const std::vector<float>& heights) {
+    // A level 0 block spans the 3x3 samples of its four cells
+    auto& first_level = m_levels[0];
+    for(auto z = 0u; z < m_sizes[0].y; z++) {
+        for(auto x = 0u; x < m_sizes[0].x; x++) {
+            auto bounds = Bounds(heights[static_cast<std::size_t>(2 * z) * m_width + 2 * x]);
+            for(auto sample_z = 2 * z; sample_z <= std::min(2 * z + 2, m_depth - 1); sample_z++) {
+                auto row = heights.data() + static_cast<std::size_t>(sample_z) * m_width;
+                for(auto sample_x = 2 * x; sample_x <= std::min(2 * x + 2, m_width - 1); sample_x++) {
+                    bounds.x = std::min(bounds.x, row[sample_x]);
+                    bounds.y = std::max(bounds.y, row[sample_x]);
+                }
+            }
+            first_level[static_cast<std::size_t>(z) * m_sizes[0].x + x] = bounds;
+        }
+    }
+
+    for(auto level = 1u; level < m_levels.size(); level++) {
+        auto children_size = m_sizes[level - 1];
+        auto& children = m_levels[level - 1];
+        auto& blocks = m_levels[level];
+        for(auto z = 0u; z < m_sizes[level].y; z++) {
+            for(auto x = 0u; x < m_sizes[level].x; x++) {
+                auto bounds = Bounds(children[static_cast<std::size_t>(2 * z) * children_size.x + 2 * x]);
+
+                // Blocks on the far edges may have only one child per side
+                for(auto child_z = 2 * z; child_z < std::min(2 * z + 2, children_size.y); child_z++) {
+                    for(auto child_x = 2 * x; child_x < std::min(2 * x + 2, children_size.x); child_x++) {
+                        auto child = children[static_cast<std::size_t>(child_z) * children_size.x + child_x];
+                        bounds.x = std::min(bounds.x, child.x);
+                        bounds.y = std::max(bounds.y, child.y);
+                    }
+                }
+
+                blocks[static_cast<std::size_t>(z) * m_sizes[level].x + x] = bounds;
+            }
+        }
+    }
+}
+
+unsigned int HeightPyramid::get_level_count() const {
+    return static_cast<unsigned int>(m_levels.size());
+}
+
+glm::uvec2 HeightPyramid::get_level_size(const unsigned int level) const {
+    return m_sizes[level];
+}
+
+HeightPyramid::Bounds HeightPyramid::get_bounds(const unsigned int level, const unsigned int x, const unsigned int z) const {
+    return m_levels[level][static_cast<std::size_t>(z) * m_sizes[level].x + x];
+}
+
+std::size_t HeightPyramid::get_byte_size() const {
+    auto bytes = std::size_t{0};
+    for(auto& level : m_levels) {
+        bytes += level.size() * sizeof(Bounds);
+    }
+    return bytes;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// Minimum and maximum height over square blocks of cells of a height grid,
+// a cell being the square between four neighbouring samples. Level 0 bounds
+// 2x2 blocks of cells, every level above bounds 2x2 blocks of the level
+// below, up to a single block covering the whole grid. Rays that miss a
+// block's bounds skip everything in it. Single cells are cheaper to bound
+// from their samples when needed than to store, which would take twice the
+// memory of the heights.
+class HeightPyramid {
+public:
+    // (min, max) of one block
+    using Bounds = glm::vec2;
+
+    HeightPyramid();
+
+    // heights[z * width + x], at least 2x2 samples
+    HeightPyramid(const unsigned int width, const unsigned int depth, const std::vector<float>& heights);
+
+    unsigned int get_level_count() const;
+
+    // Blocks per side at level, each block covers 2^(level + 1) cells a side
+    glm::uvec2 get_level_size(const unsigned int level) const;
+
+    Bounds get_bounds(const unsigned int level, const unsigned int x, const unsigned int z) const;
+
+    // Bytes held by all levels
+    std::size_t get_byte_size() const;
+
+private:
+    void build(const std::vector<float>& heights);
+
+    unsigned int m_width;
+    unsigned int m_depth;
+    std::vector<glm::uvec2> m_sizes;
+    std::vector<std::vector<Bounds>> m_levels;
+};
@@ -0,0 +1,258 @@
+#include "horizon_culler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    // Points this close to the camera plane cannot be projected reliably
+    constexpr float MIN_W = 1e-4f;
+
+    glm::vec3 corner(const ChunkBounds& bounds, unsigned int index) {
+        return glm::vec3(
+            index & 1 ? bounds.max.x : bounds.min.x,
+            index & 2 ? bounds.max.y : bounds.min.y,
+            index & 4 ? bounds.max.z : bounds.min.z
+        );
+    }
+
+    float nearest_distance(const ChunkBounds& bounds, const glm::vec3& camera_position) {
+        auto dx = std::max({bounds.min.x - camera_position.x, 0.0f, camera_position.x - bounds.max.x});
+        auto dz = std::max({bounds.min.z - camera_position.z, 0.0f, camera_position.z - bounds.max.z});
+        return std::sqrt(dx * dx + dz * dz);
+    }
+
+    float farthest_distance(const ChunkBounds& bounds, const glm::vec3& camera_position) {
+        auto dx = std::max(std::abs(bounds.min.x - camera_position.x), std::abs(bounds.max.x - camera_position.x));
+        auto dz = std::max(std::abs(bounds.min.z - camera_position.z), std::abs(bounds.max.z - camera_position.z));
+        return std::sqrt(dx * dx + dz * dz);
+    }
+
+    float cross(const glm::vec2& o, const glm::vec2& a, const glm::vec2& b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    }
+
+    // Andrew's monotone chain, counter-clockwise without repeating the first point
+    void convex_hull(std::vector<glm::vec2>& points, std::vector<glm::vec2>& hull) {
+        std::sort(points.begin(), points.end(), [](auto& a, auto& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+        hull.clear();
+        for(auto pass = 0; pass < 2; pass++) {
+            auto start = hull.size();
+            for(auto& point : points) {
+                while(hull.size() >= start + 2 && cross(hull[hull.size() - 2], hull.back(), point) <= 0.0f) {
+                    hull.pop_back();
+                }
+                hull.push_back(point);
+            }
+            hull.pop_back();
+            std::reverse(points.begin(), points.end());
+        }
+    }
+
+    // Vertical extent of a convex polygon along the line x = column_x
+    bool hull_interval(const std::vector<glm::vec2>& hull, float column_x, float& low, float& high) {
+        low = std::numeric_limits<float>::max();
+        high = std::numeric_limits<float>::lowest();
+
+        for(auto index = 0u; index < hull.size(); index++) {
+            auto& a = hull[index];
+            auto& b = hull[(index + 1) % hull.size()];
+            if((column_x < a.x && column_x < b.x) || (column_x > a.x && column_x > b.x)) {
+                continue;
+            }
+
+            auto y = a.x == b.x ? std::min(a.y, b.y) : a.y + (b.y - a.y) * (column_x - a.x) / (b.x - a.x);
+            auto y_top = a.x == b.x ? std::max(a.y, b.y) : y;
+            low = std::min(low, y);
+            high = std::max(high, y_top);
+        }
+
+        return low <= high;
+    }
+
+    unsigned int column_of(float ndc_x) {
+        auto column = std::floor((ndc_x * 0.5f + 0.5f) * HorizonCuller::COLUMNS);
+        return static_cast<unsigned int>(std::clamp(column, 0.0f, HorizonCuller::COLUMNS - 1.0f));
+    }
+}
+
+HorizonCuller::HorizonCuller()
+    : m_view_projection(1.0f),
+      m_horizon(COLUMNS),
+      m_occlusion_enabled(true),
+      m_stats{0, 0, 0}
+{
+}
+
+void HorizonCuller::cull(
+    const glm::mat4& view_projection,
+    const glm::vec3& camera_position,
+    const float terrain_bottom,
+    const std::vector<ChunkBounds>& chunks,
+    std::vector<uint8_t>& visible)
+{
+    m_view_projection = view_projection;
+
+    // Gribb and Hartmann, planes point inwards
+    auto row = [&](int index) {
+        return glm::vec4(view_projection[0][index], view_projection[1][index], view_projection[2][index], view_projection[3][index]);
+    };
+    m_planes[0] = row(3) + row(0);
+    m_planes[1] = row(3) - row(0);
+    m_planes[2] = row(3) + row(1);
+    m_planes[3] = row(3) - row(1);
+    m_planes[4] = row(3) + row(2);
+    m_planes[5] = row(3) - row(2);
+
+    std::fill(m_horizon.begin(), m_horizon.end(), -1.0f);
+    visible.assign(chunks.size(), 1);
+    m_stats = CullingStats{0, 0, 0};
+
+    m_test_order.clear();
+    m_occluder_order.clear();
+    for(auto index = 0u; index < chunks.size(); index++) {
+        m_test_order.emplace_back(nearest_distance(chunks[index], camera_position), index);
+        m_occluder_order.emplace_back(farthest_distance(chunks[index], camera_position), index);
+    }
+    std::sort(m_test_order.begin(), m_test_order.end());
+    std::sort(m_occluder_order.begin(), m_occluder_order.end());
+
+    auto next_occluder = m_occluder_order.begin();
+    for(auto& [distance, index] : m_test_order) {
+        auto& bounds = chunks[index];
+
+        if(outside_frustum(bounds)) {
+            visible[index] = 0;
+            m_stats.frustum_culled++;
+            continue;
+        }
+
+        if(m_occlusion_enabled) {
+            for(; next_occluder != m_occluder_order.end() && next_occluder->first <= distance; ++next_occluder) {
+                add_occluder(chunks[next_occluder->second], terrain_bottom);
+            }
+
+            if(below_horizon(bounds)) {
+                visible[index] = 0;
+                m_stats.occluded++;
+                continue;
+            }
+        }
+
+        m_stats.visible++;
+    }
+}
+
+bool HorizonCuller::outside_frustum(const ChunkBounds& bounds) const {
+    for(auto& plane : m_planes) {
+        // The corner furthest along the plane normal
+        auto positive = glm::vec3(
+            plane.x >= 0.0f ? bounds.max.x : bounds.min.x,
+            plane.y >= 0.0f ? bounds.max.y : bounds.min.y,
+            plane.z >= 0.0f ? bounds.max.z : bounds.min.z
+        );
+
+        if(glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool HorizonCuller::below_horizon(const ChunkBounds& bounds) const {
+    auto min_x = std::numeric_limits<float>::max();
+    auto max_x = std::numeric_limits<float>::lowest();
+    auto max_y = std::numeric_limits<float>::lowest();
+
+    for(auto index = 0u; index < 8; index++) {
+        auto clip = m_view_projection * glm::vec4(corner(bounds, index), 1.0f);
+        if(clip.w < MIN_W) {
+            return false;
+        }
+
+        min_x = std::min(min_x, clip.x / clip.w);
+        max_x = std::max(max_x, clip.x / clip.w);
+        max_y = std::max(max_y, clip.y / clip.w);
+    }
+
+    for(auto column = column_of(min_x); column <= column_of(max_x); column++) {
+        if(max_y >= m_horizon[column]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void HorizonCuller::add_occluder(const ChunkBounds& bounds, const float terrain_bottom) {
+    if(bounds.min.y <= terrain_bottom) {
+        return;
+    }
+
+    auto occluder = ChunkBounds{
+        glm::vec3(bounds.min.x, terrain_bottom, bounds.min.z),
+        glm::vec3(bounds.max.x, bounds.min.y, bounds.max.z)
+    };
+
+    m_points.clear();
+    for(auto index = 0u; index < 8; index++) {
+        auto clip = m_view_projection * glm::vec4(corner(occluder, index), 1.0f);
+        if(clip.w < MIN_W) {
+            return;
+        }
+
+        m_points.emplace_back(clip.x / clip.w, clip.y / clip.w);
+    }
+
+    convex_hull(m_points, m_hull);
+    if(m_hull.size() < 3) {
+        return;
+    }
+
+    auto min_x = m_hull[0].x;
+    auto max_x = m_hull[0].x;
+    for(auto& point : m_hull) {
+        min_x = std::min(min_x, point.x);
+        max_x = std::max(max_x, point.x);
+    }
+
+    // A column counts as covered where the hull spans its whole width. The
+    // hull is convex, so its lower edge is highest and its upper edge lowest
+    // at one of the column's two sides.
+    constexpr auto COLUMN_WIDTH = 2.0f / COLUMNS;
+    for(auto column = column_of(min_x); column <= column_of(max_x); column++) {
+        auto left = -1.0f + column * COLUMN_WIDTH;
+        auto right = left + COLUMN_WIDTH;
+        if(left < min_x || right > max_x) {
+            continue;
+        }
+
+        float left_low, left_high, right_low, right_high;
+        if(!hull_interval(m_hull, left, left_low, left_high) || !hull_interval(m_hull, right, right_low, right_high)) {
+            continue;
+        }
+
+        auto low = std::max(left_low, right_low);
+        auto high = std::min(left_high, right_high);
+
+        // Only coverage connected to what is already covered from the
+        // bottom of the screen up may raise the horizon
+        if(low <= m_horizon[column] && high > m_horizon[column]) {
+            m_horizon[column] = high;
+        }
+    }
+}
+
+void HorizonCuller::set_occlusion_enabled(bool enabled) {
+    m_occlusion_enabled = enabled;
+}
+
+bool HorizonCuller::is_occlusion_enabled() const {
+    return m_occlusion_enabled;
+}
+
+const CullingStats& HorizonCuller::get_stats() const {
+    return m_stats;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// World space bounds of one terrain chunk
+struct ChunkBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct CullingStats {
+    unsigned int visible;
+    unsigned int occluded;
+    unsigned int frustum_culled;
+};
+
+// Conservative frustum and occlusion culling for heightfield chunks.
+//
+// Everything below a heightfield's surface is hidden from a camera above it,
+// so the box spanning a chunk's footprint from the bottom of the terrain up
+// to the chunk's minimum height is an occluder. Its screen coverage is merged
+// into a per-column horizon: the NDC height below which the whole column is
+// known to be covered, growing up from the bottom of the screen. A chunk
+// whose bounding box projects entirely below the horizon in every column it
+// spans is hidden.
+//
+// Chunks are tested front to back by their nearest horizontal distance to the
+// camera, and an occluder only joins the horizon once the farthest point of
+// its footprint is nearer than the chunk being tested. Horizontal distance
+// only grows along a view ray, so every occluder in the horizon is in front
+// of whatever it hides.
+class HorizonCuller {
+public:
+    static constexpr unsigned int COLUMNS = 256;
+
+    HorizonCuller();
+
+    // Writes 1 to visible[i] for every chunk that may be visible and 0 for
+    // the rest. terrain_bottom is the lowest height any chunk reaches.
+    void cull(
+        const glm::mat4& view_projection,
+        const glm::vec3& camera_position,
+        const float terrain_bottom,
+        const std::vector<ChunkBounds>& chunks,
+        std::vector<uint8_t>& visible);
+
+    void set_occlusion_enabled(bool enabled);
+    bool is_occlusion_enabled() const;
+
+    const CullingStats& get_stats() const;
+
+private:
+    bool outside_frustum(const ChunkBounds& bounds) const;
+    bool below_horizon(const ChunkBounds& bounds) const;
+    void add_occluder(const ChunkBounds& bounds, const float terrain_bottom);
+
+    glm::mat4 m_view_projection;
+    glm::vec4 m_planes[6];
+
+    std::vector<float> m_horizon;
+
+    // Scratch kept between frames so culling does not allocate
+    std::vector<std::pair<float, unsigned int>> m_test_order;
+    std::vector<std::pair<float, unsigned int>> m_occluder_order;
+    std::vector<glm::vec2> m_points;
+    std::vector<glm::vec2> m_hull;
+
+    bool m_occlusion_enabled;
+    CullingStats m_stats;
+};
@@ -0,0 +1,318 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    // Set on worker threads, so that jobs they submit land in their own queues
+    thread_local const JobSystem* worker_owner = nullptr;
+    thread_local unsigned int worker_index = 0;
+
+    thread_local const Job* current_job = nullptr;
+}
+
+void Job::cancel() {
+    m_cancelled = true;
+}
+
+bool Job::is_cancelled() const {
+    return m_cancelled;
+}
+
+bool Job::is_done() const {
+    return m_done.load(std::memory_order_acquire);
+}
+
+JobSystem::JobSystem(unsigned int worker_count)
+    : m_workers(),
+      m_main_thread(std::this_thread::get_id()),
+      m_queued(0),
+      m_next_worker(0),
+      m_stopping(false),
+      m_executed(0),
+      m_steals(0),
+      m_cancelled(0)
+{
+    if(worker_count == 0) {
+        auto hardware_threads = std::thread::hardware_concurrency();
+        worker_count = std::max(hardware_threads, 2u) - 1;
+    }
+
+    // All workers must exist before any of them starts stealing
+    for(auto index = 0u; index < worker_count; index++) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for(auto index = 0u; index < worker_count; index++) {
+        m_workers[index]->thread = std::thread(&JobSystem::worker_loop, this, index);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for(auto& worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+JobHandle JobSystem::submit(
+    std::function<void()> work,
+    JobPriority priority,
+    const std::vector<JobHandle>& dependencies,
+    JobAffinity affinity)
+{
+    auto job = std::make_shared<Job>();
+    job->m_work = std::move(work);
+    job->m_priority = priority;
+    job->m_affinity = affinity;
+    job->m_pending = 1;
+    job->m_cancelled = false;
+    job->m_done = false;
+
+    for(auto& dependency : dependencies) {
+        std::lock_guard lock(dependency->m_mutex);
+        if(dependency->is_done()) {
+            if(dependency->is_cancelled() || dependency->m_exception) {
+                job->cancel();
+            }
+            continue;
+        }
+
+        job->m_pending++;
+        dependency->m_dependents.push_back(job);
+    }
+
+    if(--job->m_pending == 0) {
+        schedule(job);
+    }
+
+    return job;
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    while(!job->is_done()) {
+        auto next = is_main_thread() ? pop_main_thread() : nullptr;
+        if(!next && worker_owner == this) {
+            next = pop(worker_index);
+        }
+        if(!next) {
+            next = steal(worker_owner == this ? worker_index : static_cast<unsigned int>(m_workers.size()));
+        }
+
+        if(next) {
+            execute(next);
+            continue;
+        }
+
+        // Nothing to help with, so the job runs on a worker or waits for a
+        // dependency that does. The timeout catches main thread jobs queued
+        // by other threads, which do not signal.
+        std::unique_lock lock(m_sleep_mutex);
+        m_finished.wait_for(lock, std::chrono::milliseconds(1), [&] {
+            return job->is_done();
+        });
+    }
+
+    if(job->m_exception) {
+        std::rethrow_exception(job->m_exception);
+    }
+}
+
+void JobSystem::run_main_thread_jobs(double budget_ms) {
+    auto start = std::chrono::steady_clock::now();
+    while(auto job = pop_main_thread()) {
+        execute(job);
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(elapsed >= budget_ms) {
+            break;
+        }
+    }
+}
+
+unsigned int JobSystem::get_worker_count() const {
+    return static_cast<unsigned int>(m_workers.size());
+}
+
+JobSystemStats JobSystem::get_stats() const {
+    JobSystemStats stats{{}, 0, m_executed, m_steals, m_cancelled};
+
+    for(auto& worker : m_workers) {
+        std::lock_guard lock(worker->mutex);
+        auto depth = std::size_t{0};
+        for(auto& queue : worker->queues) {
+            depth += queue.size();
+        }
+        stats.queue_depths.push_back(depth);
+    }
+
+    std::lock_guard lock(m_main_mutex);
+    for(auto& queue : m_main_queues) {
+        stats.main_thread_depth += queue.size();
+    }
+
+    return stats;
+}
+
+bool JobSystem::is_current_job_cancelled() {
+    return current_job && current_job->is_cancelled();
+}
+
+void JobSystem::worker_loop(unsigned int index) {
+    worker_owner = this;
+    worker_index = index;
+
+    while(!m_stopping) {
+        auto job = pop(index);
+        if(!job) {
+            job = steal(index);
+        }
+
+        if(job) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_wake.wait(lock, [&] {
+            return m_stopping || m_queued > 0;
+        });
+    }
+}
+
+void JobSystem::schedule(const JobHandle& job) {
+    auto band = static_cast<std::size_t>(job->m_priority);
+
+    if(job->m_affinity == JobAffinity::MAIN_THREAD) {
+        {
+            std::lock_guard lock(m_main_mutex);
+            m_main_queues[band].push_back(job);
+        }
+
+        // Wake a main thread blocked in wait()
+        std::lock_guard lock(m_sleep_mutex);
+        m_finished.notify_all();
+        return;
+    }
+
+    auto index = worker_owner == this
+        ? worker_index
+        : m_next_worker++ % static_cast<unsigned int>(m_workers.size());
+
+    {
+        auto& worker = *m_workers[index];
+        std::lock_guard lock(worker.mutex);
+        worker.queues[band].push_back(job);
+        m_queued++;
+    }
+
+    // Taking the lock orders the push before a worker's check of m_queued,
+    // so the notification cannot fall between its check and its sleep
+    std::lock_guard lock(m_sleep_mutex);
+    m_wake.notify_one();
+}
+
+JobHandle JobSystem::pop(unsigned int index) {
+    auto& worker = *m_workers[index];
+    std::lock_guard lock(worker.mutex);
+
+    // Newest first, its data is the most likely to still be in cache
+    for(auto& queue : worker.queues) {
+        if(!queue.empty()) {
+            auto job = std::move(queue.back());
+            queue.pop_back();
+            m_queued--;
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+JobHandle JobSystem::steal(unsigned int thief) {
+    auto worker_count = static_cast<unsigned int>(m_workers.size());
+
+    // Start next to the thief so that thieves spread over the victims
+    for(auto offset = 0u; offset < worker_count; offset++) {
+        auto victim = (thief + 1 + offset) % worker_count;
+        if(victim == thief) {
+            continue;
+        }
+
+        auto& worker = *m_workers[victim];
+        std::lock_guard lock(worker.mutex);
+        for(auto& queue : worker.queues) {
+            if(!queue.empty()) {
+                auto job = std::move(queue.front());
+                queue.pop_front();
+                m_queued--;
+                m_steals++;
+                return job;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+JobHandle JobSystem::pop_main_thread() {
+    std::lock_guard lock(m_main_mutex);
+    for(auto& queue : m_main_queues) {
+        if(!queue.empty()) {
+            auto job = std::move(queue.front());
+            queue.pop_front();
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::execute(const JobHandle& job) {
+    if(job->is_cancelled()) {
+        m_cancelled++;
+    } else {
+        auto previous = current_job;
+        current_job = job.get();
+        try {
+            job->m_work();
+        } catch(...) {
+            job->m_exception = std::current_exception();
+        }
+        current_job = previous;
+        m_executed++;
+    }
+
+    // Release whatever the work captured now rather than with the last handle
+    job->m_work = nullptr;
+    finish(job);
+}
+
+void JobSystem::finish(const JobHandle& job) {
+    std::vector<JobHandle> dependents;
+    {
+        std::lock_guard lock(job->m_mutex);
+        job->m_done.store(true, std::memory_order_release);
+        dependents.swap(job->m_dependents);
+    }
+
+    for(auto& dependent : dependents) {
+        if(job->is_cancelled() || job->m_exception) {
+            dependent->cancel();
+        }
+        if(--dependent->m_pending == 0) {
+            schedule(dependent);
+        }
+    }
+
+    std::lock_guard lock(m_sleep_mutex);
+    m_finished.notify_all();
+}
+
+bool JobSystem::is_main_thread() const {
+    return std::this_thread::get_id() == m_main_thread;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Coarse priority bands, most urgent first. Terrain work maps a chunk's LOD,
+// i.e. its distance from the camera, onto these.
+enum class JobPriority {
+    IMMEDIATE,
+    HIGH,
+    NORMAL,
+    BACKGROUND
+};
+
+// Jobs that touch the GL context must run on the thread that owns it
+enum class JobAffinity {
+    ANY_THREAD,
+    MAIN_THREAD
+};
+
+struct JobSystemStats {
+    // Jobs waiting in each worker's queues
+    std::vector<std::size_t> queue_depths;
+    std::size_t main_thread_depth;
+    uint64_t executed;
+    uint64_t steals;
+    uint64_t cancelled;
+};
+
+class JobSystem;
+
+// A unit of work submitted to a JobSystem. Handles stay valid after the job
+// has finished, and are what other jobs name as their dependencies.
+class Job {
+public:
+    // A job cancelled before it starts never runs, and neither does anything
+    // depending on it. A running job may poll JobSystem::is_current_job_cancelled().
+    void cancel();
+    bool is_cancelled() const;
+
+    // Finished running, or dropped after a cancellation
+    bool is_done() const;
+
+private:
+    friend class JobSystem;
+
+    std::function<void()> m_work;
+    JobPriority m_priority;
+    JobAffinity m_affinity;
+
+    // Dependencies still running, plus one while the job is being submitted
+    std::atomic<unsigned int> m_pending;
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_done;
+    std::exception_ptr m_exception;
+
+    // Guards m_dependents against a concurrent finish
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<Job>> m_dependents;
+};
+
+using JobHandle = std::shared_ptr<Job>;
+
+// Work-stealing scheduler. Every worker owns a deque per priority band and
+// runs its newest job of the most urgent band first; an idle worker steals
+// the oldest job of the most urgent band from the other workers. Priorities
+// are therefore only honoured per worker, not globally.
+//
+// Jobs with MAIN_THREAD affinity are kept apart and only run from
+// run_main_thread_jobs() or wait() on the thread that created the system.
+class JobSystem {
+public:
+    static constexpr std::size_t PRIORITY_LEVELS = 4;
+
+    // 0 starts one worker per hardware thread besides the main thread
+    explicit JobSystem(unsigned int worker_count = 0);
+
+    // Queued jobs are dropped, running ones are finished
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // The job becomes runnable once every dependency has finished. A
+    // dependency that was cancelled or threw cancels the job as well.
+    JobHandle submit(
+        std::function<void()> work,
+        JobPriority priority = JobPriority::NORMAL,
+        const std::vector<JobHandle>& dependencies = {},
+        JobAffinity affinity = JobAffinity::ANY_THREAD);
+
+    // Blocks until job is done, running queued jobs in the meantime, and
+    // rethrows anything the job threw
+    void wait(const JobHandle& job);
+
+    // Runs main thread jobs until there are none left or budget_ms is spent.
+    // Must be called from the thread that created the system.
+    void run_main_thread_jobs(double budget_ms);
+
+    unsigned int get_worker_count() const;
+    JobSystemStats get_stats() const;
+
+    static bool is_current_job_cancelled();
+
+private:
+    struct Worker {
+        mutable std::mutex mutex;
+        std::deque<JobHandle> queues[PRIORITY_LEVELS];
+        std::thread thread;
+    };
+
+    void worker_loop(unsigned int index);
+    void schedule(const JobHandle& job);
+    JobHandle pop(unsigned int index);
+    JobHandle steal(unsigned int thief);
+    JobHandle pop_main_thread();
+    void execute(const JobHandle& job);
+    void finish(const JobHandle& job);
+    bool is_main_thread() const;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::thread::id m_main_thread;
+
+    mutable std::mutex m_main_mutex;
+    std::deque<JobHandle> m_main_queues[PRIORITY_LEVELS];
+
+    // Sleeping workers wait for m_queued, waiters for finished jobs
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_finished;
+
+    std::atomic<std::size_t> m_queued;
+    std::atomic<unsigned int> m_next_worker;
+    std::atomic<bool> m_stopping;
+
+    std::atomic<uint64_t> m_executed;
+    std::atomic<uint64_t> m_steals;
+    std::atomic<uint64_t> m_cancelled;
+};
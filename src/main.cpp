@@ -1,5 +1,12 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <thread>
 
 #include "glm/glm.hpp"
 #include "imgui.h"
@@ -8,11 +15,20 @@
 
 #include "camera.hpp"
 #include "drawable.hpp"
-#include "shader.hpp"
+#include "allocation_counter.hpp"
+#include "benchmark.hpp"
+#include "flythrough.hpp"
+#include "gl_diagnostics.hpp"
+#include "gl_state.hpp"
+#include "gpu_profiler.hpp"
+#include "options.hpp"
+#include "parameter_sweep.hpp"
+#include "program_cache.hpp"
+#include "scene.hpp"
+#include "tile_pyramid.hpp"
+#include "tile_server.hpp"
 #include "window.hpp"
-
-#include "drawables/cube.hpp"
-#include "drawables/terrain_squares.hpp"
+#include "drawables/terrain_patches.hpp"
 
 // settings
 constexpr auto WINDOW_WIDTH = 1440;
@@ -20,10 +36,18 @@ constexpr auto WINDOW_HEIGHT = 900;
 
 constexpr auto GRID_SIZE = 150;
 
+// Instanced terrain: PATCH_CHUNKS x PATCH_CHUNKS chunks of PATCH_SIZE quads
+constexpr auto PATCH_SIZE = 32;
+constexpr auto PATCH_CHUNKS = 8;
+
+// Compressed tiles the tile server keeps
+constexpr std::size_t TILE_SERVER_CACHE_BYTES = 256 * 1024 * 1024;
+
 auto camera_settings = CameraSettings(CameraDefault::ZOOM, WINDOW_WIDTH / WINDOW_HEIGHT, 0.1, 1000.0);
 auto camera = Camera<Perspective>(camera_settings, glm::vec3(-50.0f, 60.0f, GRID_SIZE / 2.0f), glm::vec3(0.0, 1.0, 0.0), 0.0, -35.0);
 
-Window window(WINDOW_WIDTH, WINDOW_HEIGHT, "Procedural Terrain Generation");
+// Created in main, once it is known whether to run headless
+std::unique_ptr<Window> window;
 
 bool focus = true;
 
@@ -34,48 +58,48 @@ void process_input(float delta_time)
 {
     using namespace Keyboard;
 
-    if(window.get_key(Key::KEY_ESCAPE) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_ESCAPE) == KeyState::PRESSED) {
         focus = false;
-        window.set_mouse_mode(MouseMode::NORMAL);
+        window->set_mouse_mode(MouseMode::NORMAL);
     }
 
-    if(window.get_key(Key::KEY_W) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_W) == KeyState::PRESSED) {
         camera.process_keyboard(CameraMovement::FORWARD, delta_time);
     }
 
-    if(window.get_key(Key::KEY_A) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_A) == KeyState::PRESSED) {
         camera.process_keyboard(CameraMovement::LEFT, delta_time);
     }
 
-    if(window.get_key(Key::KEY_S) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_S) == KeyState::PRESSED) {
         camera.process_keyboard(CameraMovement::BACKWARD, delta_time);
     }
 
-    if(window.get_key(Key::KEY_D) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_D) == KeyState::PRESSED) {
         camera.process_keyboard(CameraMovement::RIGHT, delta_time);
     }
 
-    if(window.get_key(Key::KEY_Q) == KeyState::PRESSED) {
-        window.polygon_mode(PolygonMode::FILL);
+    if(window->get_key(Key::KEY_Q) == KeyState::PRESSED) {
+        window->polygon_mode(PolygonMode::FILL);
     }
 
-    if(window.get_key(Key::KEY_E) == KeyState::PRESSED) {
-        window.polygon_mode(PolygonMode::LINE);
+    if(window->get_key(Key::KEY_E) == KeyState::PRESSED) {
+        window->polygon_mode(PolygonMode::LINE);
     }
 
-    if(window.get_key(Key::KEY_LEFT) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_LEFT) == KeyState::PRESSED) {
         settings.offset.x -= 0.01;
     }
 
-    if(window.get_key(Key::KEY_RIGHT) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_RIGHT) == KeyState::PRESSED) {
         settings.offset.x += 0.01;
     }
 
-    if(window.get_key(Key::KEY_UP) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_UP) == KeyState::PRESSED) {
         settings.offset.y += 0.01;
     }
 
-    if(window.get_key(Key::KEY_DOWN) == KeyState::PRESSED) {
+    if(window->get_key(Key::KEY_DOWN) == KeyState::PRESSED) {
         settings.offset.y -= 0.01;
     }
 
@@ -84,7 +108,7 @@ void process_input(float delta_time)
 void process_mouse_button(GLFWwindow* glfw_window, int button, int action, int mods) {
     if(button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && focus == false && !ImGui::GetIO().WantCaptureMouse) {
         focus = true;
-        window.set_mouse_mode(MouseMode::DISABLED);
+        window->set_mouse_mode(MouseMode::DISABLED);
     }
 }
 
@@ -111,18 +135,265 @@ void process_mouse_movement(GLFWwindow* glfw_window, double xpos, double ypos) {
     }
 }
 
-int main() try {
-    window.set_mouse_callback(process_mouse_button, process_mouse_movement);
-    window.set_mouse_mode(MouseMode::DISABLED);
-    window.enable_capability(Capability::DEPTH_TEST);
+void log_startup() {
+    // Time since the context was created, warm starts load programs from
+    // the binary cache instead of compiling them
+    auto& cache_stats = ProgramCache::get_stats();
+    std::cout << "Startup took " << window->get_elapsed_time() * 1000.0f << " ms ("
+              << cache_stats.hits << " programs from cache in " << cache_stats.load_ms << " ms, "
+              << cache_stats.misses << " compiled in " << cache_stats.compile_ms << " ms)" << std::endl;
+}
+
+// Averages per section, once the profiler has read some frames back
+void log_gpu_stats(const GpuProfiler& gpu_profiler) {
+    if(!gpu_profiler.is_enabled()) {
+        return;
+    }
+
+    auto& frame_stats = gpu_profiler.get_frame_stats();
+    std::cout << "GPU " << frame_stats.label << " average " << frame_stats.average_ms << " ms, max " << frame_stats.max_ms << " ms" << std::endl;
+    for(auto& stats : gpu_profiler.get_stats()) {
+        std::cout << "GPU " << stats.label << " average " << stats.average_ms << " ms, max " << stats.max_ms << " ms" << std::endl;
+    }
+}
+
+void write_ppm(const std::string& path, unsigned int width, unsigned int height, const std::vector<uint8_t>& pixels) {
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+    if(!file) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+// Renders a fixed number of frames offscreen and reports how long they took.
+// There is no input, the camera stays where it starts.
+int run_headless(const Options& options) {
+    window = Window::create_headless(options.width, options.height);
+    window->enable_capability(Capability::DEPTH_TEST);
+
+    Scene scene(GRID_SIZE, PATCH_SIZE, PATCH_CHUNKS);
+    scene.set_instanced_terrain(options.instanced);
+    scene.set_progressive(options.progressive);
+    scene.set_baked_lighting(options.baked_lighting);
+
+    log_startup();
+
+    // Starts disabled for the interactive checkbox
+    auto& gpu_profiler = scene.get_gpu_profiler();
+    gpu_profiler.set_enabled(true);
+
+    // The first frame generates the terrain, keep it out of the average
+    auto generation_start = window->get_elapsed_time();
+    scene.update(settings);
+    scene.finish_lighting_bake();
+    auto generation_ms = (window->get_elapsed_time() - generation_start) * 1000.0f;
+
+    auto render_start = window->get_elapsed_time();
+    for(auto frame = 0u; frame < options.frames; frame++) {
+        gpu_profiler.begin_frame();
+
+        window->clear_screen();
+
+        scene.update(settings);
+        scene.render(camera.get_projection(), camera.get_view_matrix(), camera.get_position());
+
+        gpu_profiler.end_frame();
+        GlDiagnostics::end_frame();
+        GlState::end_frame();
+
+        window->swap_and_poll();
+    }
+
+    // Count the frames as done once the GPU has finished them
+    glFinish();
+    auto render_ms = (window->get_elapsed_time() - render_start) * 1000.0f;
+
+    const char *backend = window->get_backend() == WindowBackend::EGL_SURFACELESS ? "EGL surfaceless" : "hidden GLFW window";
+    std::cout << "Headless (" << backend << ", " << glGetString(GL_RENDERER) << ") "
+              << options.width << "x" << options.height << ", "
+              << (scene.is_instanced_terrain() ? "instanced chunks" : "terrain squares") << std::endl;
+    std::cout << "Generation took " << generation_ms << " ms" << std::endl;
+    if(scene.is_baked_lighting()) {
+        std::cout << "Lighting bake took " << scene.get_baked_lighting().get_bake_ms() << " ms" << std::endl;
+    }
+
+    auto& vertex_cache = scene.get_vertex_cache_report();
+    std::cout << "Vertex cache (" << VertexCache::CACHE_SIZE << " entries): ACMR "
+              << vertex_cache.before.acmr << " -> " << vertex_cache.after.acmr << ", ATVR "
+              << vertex_cache.before.atvr << " -> " << vertex_cache.after.atvr << std::endl;
+    std::cout << options.frames << " frames took " << render_ms << " ms ("
+              << (options.frames ? render_ms / options.frames : 0.0f) << " ms/frame)" << std::endl;
+
+    log_gpu_stats(gpu_profiler);
+
+    if(!options.readback_path.empty()) {
+        write_ppm(options.readback_path, options.width, options.height, window->read_pixels());
+        std::cout << "Wrote " << options.readback_path << std::endl;
+    }
+
+    if(!options.export_heights_path.empty()) {
+        scene.get_height_field().save_pgm(options.export_heights_path);
+        std::cout << "Wrote " << options.export_heights_path << std::endl;
+    }
+
+    if(!options.export_pyramid_prefix.empty()) {
+        TilePyramid pyramid(glm::ivec2(0, 0), PATCH_CHUNKS * PATCH_SIZE + 1, TerrainPatches::MAX_LOD + 1, TerrainPatches::HEIGHT_FORMAT);
+        pyramid.generate(settings, scene.get_jobs());
+        for(auto level = 0u; level < pyramid.get_level_count(); level++) {
+            auto path = options.export_pyramid_prefix + "_" + std::to_string(level) + ".pgm";
+            pyramid.get_level(level).save_pgm(path);
+            std::cout << "Wrote " << path << " (" << pyramid.get_level_size(level) << " samples a side, "
+                      << pyramid.get_generation_ms(level) << " ms)" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// Replays a flythrough at a fixed timestep, so every run renders the same
+// frames, and reports frame time and regeneration latency percentiles.
+// Each frame waits for the GPU so its time covers the GPU work as well.
+int run_flythrough(const Options& options) {
+    if(options.headless) {
+        window = Window::create_headless(options.width, options.height);
+    } else {
+        window = std::make_unique<Window>(WINDOW_WIDTH, WINDOW_HEIGHT, "Procedural Terrain Generation");
+    }
+    window->enable_capability(Capability::DEPTH_TEST);
+
+    auto flythrough = options.flythrough_path == "default"
+        ? Flythrough::make_default(GRID_SIZE)
+        : Flythrough::load(options.flythrough_path);
+
+    Scene scene(GRID_SIZE, PATCH_SIZE, PATCH_CHUNKS);
+    scene.set_instanced_terrain(options.instanced);
+    scene.set_progressive(options.progressive);
+
+    log_startup();
+
+    auto& gpu_profiler = scene.get_gpu_profiler();
+    gpu_profiler.set_enabled(true);
+
+    // Changes at time 0 are part of the starting terrain, which is generated
+    // before timing starts
+    flythrough.apply_changes(-1.0f, 0.0f, settings);
+    scene.update(settings);
+    glFinish();
+
+    auto frame_count = static_cast<unsigned int>(std::ceil(flythrough.get_duration() / options.timestep)) + 1;
+
+    std::vector<double> frame_ms;
+    std::vector<double> regeneration_ms;
+    frame_ms.reserve(frame_count);
+
+    // The first regeneration sizes the scratch buffers, the rest should not allocate
+    auto regeneration_allocations = AllocationStats{0, 0};
+
+    auto previous_time = 0.0f;
+    for(auto frame = 0u; frame < frame_count && !window->should_close(); frame++) {
+        auto time = frame * options.timestep;
+
+        flythrough.apply_changes(previous_time, time, settings);
+        previous_time = time;
+
+        auto pose = flythrough.sample(time);
+        camera.set_pose(pose.position, pose.yaw, pose.pitch);
+
+        auto frame_start = window->get_elapsed_time();
+
+        gpu_profiler.begin_frame();
+
+        window->clear_screen();
+
+        auto regeneration_start = window->get_elapsed_time();
+        if(scene.update(settings)) {
+            regeneration_ms.push_back((window->get_elapsed_time() - regeneration_start) * 1000.0);
+            regeneration_allocations.allocations += scene.get_regeneration_stats().allocations.allocations;
+            regeneration_allocations.bytes += scene.get_regeneration_stats().allocations.bytes;
+        }
+
+        scene.render(camera.get_projection(), camera.get_view_matrix(), camera.get_position());
+
+        gpu_profiler.end_frame();
+        GlDiagnostics::end_frame();
+        GlState::end_frame();
+
+        window->swap_and_poll();
+        glFinish();
+
+        frame_ms.push_back((window->get_elapsed_time() - frame_start) * 1000.0);
+    }
+
+    auto report = BenchmarkReport {
+        flythrough.get_name(),
+        reinterpret_cast<const char *>(glGetString(GL_RENDERER)),
+        window->is_headless() ? options.width : WINDOW_WIDTH,
+        window->is_headless() ? options.height : WINDOW_HEIGHT,
+        options.timestep,
+        Benchmark::summarize(frame_ms),
+        Benchmark::summarize(regeneration_ms)
+    };
+
+    auto print_summary = [](const char *name, const TimingSummary& summary) {
+        std::cout << name << ": " << summary.count << " samples, mean " << summary.mean
+                  << " ms, p50 " << summary.p50 << " ms, p95 " << summary.p95
+                  << " ms, p99 " << summary.p99 << " ms, max " << summary.max << " ms" << std::endl;
+    };
+
+    std::cout << "Flythrough " << report.name << " (" << report.renderer << ", "
+              << (scene.is_instanced_terrain() ? "instanced chunks" : "terrain squares") << ")" << std::endl;
+    print_summary("frames", report.frame_ms);
+    print_summary("regenerations", report.regeneration_ms);
+    log_gpu_stats(gpu_profiler);
+    if(AllocationCounter::is_enabled()) {
+        std::cout << "regenerations allocated " << regeneration_allocations.allocations << " times, "
+                  << regeneration_allocations.bytes << " bytes" << std::endl;
+    }
+
+    if(!options.report_path.empty()) {
+        Benchmark::write_report(options.report_path, report);
+        std::cout << "Wrote " << options.report_path << std::endl;
+    }
+
+    if(!options.readback_path.empty() && window->is_headless()) {
+        write_ppm(options.readback_path, options.width, options.height, window->read_pixels());
+        std::cout << "Wrote " << options.readback_path << std::endl;
+    }
+
+    if(!options.baseline_path.empty()) {
+        auto baseline = Benchmark::read_report(options.baseline_path);
+        if(baseline.name != report.name || baseline.renderer != report.renderer) {
+            std::cout << "Warning: baseline was recorded with " << baseline.name << " on " << baseline.renderer << std::endl;
+        }
+
+        auto regressions = Benchmark::compare(baseline, report, options.threshold);
+        for(auto& regression : regressions) {
+            std::cout << "Regression: " << regression << std::endl;
+        }
+
+        if(!regressions.empty()) {
+            return 2;
+        }
+
+        std::cout << "No regressions against " << options.baseline_path << " (threshold " << options.threshold * 100.0f << "%)" << std::endl;
+    }
+
+    return 0;
+}
+
+int run_interactive(const Options& options) {
+    window = std::make_unique<Window>(WINDOW_WIDTH, WINDOW_HEIGHT, "Procedural Terrain Generation");
+    window->set_mouse_callback(process_mouse_button, process_mouse_movement);
+    window->set_mouse_mode(MouseMode::DISABLED);
+    window->enable_capability(Capability::DEPTH_TEST);
 
-    auto mvm_shader = Shader::create<Shaders::Mvm>();
-    auto terrain_shader = Shader::create<Shaders::Terrain>();
+    Scene scene(GRID_SIZE, PATCH_SIZE, PATCH_CHUNKS);
 
-    auto light = Cube::create();
-    auto light_position = glm::vec3(GRID_SIZE / 2.0f, 100.0f, GRID_SIZE / 2.0f);
+    // Dragging a slider should never wait for a full regeneration
+    scene.set_progressive(true);
 
-    auto terrain = TerrainSquares::create(GRID_SIZE);
+    auto& gpu_profiler = scene.get_gpu_profiler();
 
     auto delta_time = 0.0f;
     auto last_frame = 0.0f;
@@ -134,16 +405,34 @@ int main() try {
 
     ImGui::StyleColorsDark();
 
-    ImGui_ImplGlfw_InitForOpenGL(window.get_window(), true);
+    ImGui_ImplGlfw_InitForOpenGL(window->get_window(), true);
     ImGui_ImplOpenGL3_Init("#version 330");
 
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
-    GenerationSettings last_settings;
+    log_startup();
+
+    // Keyframes every RECORD_INTERVAL seconds, settings changes as they happen
+    constexpr auto RECORD_INTERVAL = 0.25f;
+    auto recording = Flythrough(options.record_path);
+    auto recorded_settings = settings;
+    auto record_start = window->get_elapsed_time();
+    auto next_keyframe = 0.0f;
+
+    // Walk mode, keeps the camera this far above the terrain under it
+    auto keep_above_ground = false;
+    auto ground_clearance = 2.0f;
 
-    while (!window.should_close())
+    std::vector<ViewshedObserver> observers;
+    auto observer_height = 2.0f;
+    auto observer_radius = 0.0f;
+    auto viewshed_target_height = 0.0f;
+    auto viewshed_ms = 0.0;
+    auto viewshed_visible = 0.0;
+
+    while (!window->should_close())
     {
-        auto current_frame = window.get_elapsed_time();
+        auto current_frame = window->get_elapsed_time();
         delta_time = current_frame - last_frame;
         last_frame = current_frame;
 
@@ -154,10 +443,9 @@ int main() try {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        window.clear_screen();
+        gpu_profiler.begin_frame();
 
-        glm::mat4 view = camera.get_view_matrix();
-        glm::mat4 projection = camera.get_projection();
+        window->clear_screen();
 
         ImGui::Begin("Procedural Generation Renderer");
 
@@ -172,43 +460,362 @@ int main() try {
         ImGui::SliderFloat("X Offset", &settings.offset.x, -100.0f, 100.0f);
         ImGui::SliderFloat("Y Offset", &settings.offset.y, -100.0f, 100.0f);
 
+        auto instanced_terrain = scene.is_instanced_terrain();
+        if(ImGui::Checkbox("instanced chunks", &instanced_terrain)) {
+            scene.set_instanced_terrain(instanced_terrain);
+        }
+
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+
+        if(ImGui::CollapsingHeader("GPU Timings")) {
+            if(gpu_profiler.is_supported()) {
+                auto profiling = gpu_profiler.is_enabled();
+                if(ImGui::Checkbox("enable timer queries", &profiling)) {
+                    gpu_profiler.set_enabled(profiling);
+                }
+
+                ImGui::SameLine();
+                if(ImGui::Button("reset")) {
+                    gpu_profiler.reset_stats();
+                }
+
+                auto& frame_stats = gpu_profiler.get_frame_stats();
+                ImGui::Text("%-12s %8.3f ms (avg %.3f, max %.3f)", frame_stats.label.c_str(), frame_stats.last_ms, frame_stats.average_ms, frame_stats.max_ms);
+                for(auto& stats : gpu_profiler.get_stats()) {
+                    ImGui::Text("%-12s %8.3f ms (avg %.3f, max %.3f)", stats.label.c_str(), stats.last_ms, stats.average_ms, stats.max_ms);
+                }
+            } else {
+                ImGui::Text("Timer queries are not supported by this driver");
+            }
+        }
+
+        if(ImGui::CollapsingHeader("Render Queue")) {
+            auto& queue_stats = scene.get_render_stats();
+            ImGui::Text("%zu packets, %zu state changes", queue_stats.packets, queue_stats.state_changes);
+
+            auto& vertex_cache = scene.get_vertex_cache_report();
+            ImGui::Text("vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+                vertex_cache.before.acmr, vertex_cache.after.acmr, vertex_cache.before.atvr, vertex_cache.after.atvr);
+
+            auto& state_stats = GlState::get_frame_stats();
+            auto show_binds = [](const char *name, const GlBindStats& stats) {
+                ImGui::Text("%-14s %6llu issued %6llu skipped", name, 
+                    static_cast<unsigned long long>(stats.issued), 
+                    static_cast<unsigned long long>(stats.skipped));
+            };
+            show_binds("programs", state_stats.programs);
+            show_binds("vertex arrays", state_stats.vertex_arrays);
+            show_binds("buffers", state_stats.buffers);
+        }
+
+        if(ImGui::CollapsingHeader("Regeneration")) {
+            auto progressive = scene.is_progressive();
+            if(ImGui::Checkbox("progressive", &progressive)) {
+                scene.set_progressive(progressive);
+            }
+
+            auto refine_budget = static_cast<float>(scene.get_refine_budget());
+            if(ImGui::SliderFloat("budget (ms)", &refine_budget, 0.5f, 16.0f)) {
+                scene.set_refine_budget(refine_budget);
+            }
+
+            ImGui::SliderFloat("octave epsilon", &settings.octave_epsilon, 0.0f, 0.01f, "%.6f", 4.0f);
+            ImGui::Text("octaves evaluated: %d at full detail, %d at LOD %u",
+                TerrainGenerator::count_octaves(settings, 1.0f),
+                TerrainGenerator::count_octaves(settings, static_cast<float>(1u << TerrainPatches::MAX_LOD)),
+                TerrainPatches::MAX_LOD);
+
+            auto& regeneration = scene.get_regeneration_stats();
+            ImGui::Text("last pass %.3f ms, sample step %u", regeneration.ms, regeneration.step);
+            ImGui::Text("stages:%s%s%s%s",
+                regeneration.stages & GenerationStage::HEIGHTS ? " heights" : "",
+                regeneration.stages & GenerationStage::POSITIONS ? " positions" : "",
+                regeneration.stages & GenerationStage::NORMALS ? " normals" : "",
+                regeneration.stages & GenerationStage::COLORS ? " colors" : "");
+            if(AllocationCounter::is_enabled()) {
+                ImGui::Text("%llu allocations, %llu bytes", 
+                    static_cast<unsigned long long>(regeneration.allocations.allocations), 
+                    static_cast<unsigned long long>(regeneration.allocations.bytes));
+            } else {
+                ImGui::Text("Configure with -DCOUNT_ALLOCATIONS=ON to count allocations");
+            }
+        }
+
+        if(ImGui::CollapsingHeader("Jobs")) {
+            auto jobs = scene.get_jobs().get_stats();
+            ImGui::Text("%u workers", scene.get_jobs().get_worker_count());
+            for(auto index = 0u; index < jobs.queue_depths.size(); index++) {
+                ImGui::Text("worker %u: %zu queued", index, jobs.queue_depths[index]);
+            }
+            ImGui::Text("main thread: %zu queued", jobs.main_thread_depth);
+            ImGui::Text("%llu executed, %llu stolen, %llu cancelled",
+                static_cast<unsigned long long>(jobs.executed),
+                static_cast<unsigned long long>(jobs.steals),
+                static_cast<unsigned long long>(jobs.cancelled));
+        }
+
+        if(ImGui::CollapsingHeader("Tile cache")) {
+            auto& tile_cache = scene.get_tile_cache();
+            auto cache = tile_cache.get_stats();
+            auto lookups = cache.hits + cache.misses;
+            ImGui::Text("%zu tiles, %.2f of %.2f MiB", cache.entries,
+                cache.compressed_bytes / (1024.0 * 1024.0),
+                tile_cache.get_budget() / (1024.0 * 1024.0));
+            ImGui::Text("compression ratio %.2f", cache.compressed_bytes ? static_cast<double>(cache.raw_bytes) / cache.compressed_bytes : 0.0);
+            ImGui::Text("hit rate %.1f%% of %llu lookups, %llu evictions",
+                lookups ? 100.0 * cache.hits / lookups : 0.0,
+                static_cast<unsigned long long>(lookups),
+                static_cast<unsigned long long>(cache.evictions));
+            ImGui::Text("compress %.1f ms, decompress %.1f ms total", cache.compress_ms, cache.decompress_ms);
+            if(ImGui::Button("clear")) {
+                tile_cache.clear();
+            }
+        }
+
+        if(ImGui::CollapsingHeader("Terrain query")) {
+            ImGui::Checkbox("keep camera above ground", &keep_above_ground);
+            ImGui::SliderFloat("clearance", &ground_clearance, 0.5f, 20.0f);
+
+            auto position = camera.get_position();
+            auto query = scene.get_terrain_query();
+            ImGui::Text("ground %.2f, slope %.1f deg",
+                query->get_height(position.x, position.z),
+                glm::degrees(query->get_slope(position.x, position.z)));
+
+            auto look = query->intersect(TerrainRay{position, camera.get_front(), 1000.0f});
+            if(look.hit) {
+                ImGui::Text("looking at (%.1f, %.1f, %.1f), %.1f away", look.position.x, look.position.y, look.position.z, look.distance);
+            } else {
+                ImGui::Text("looking at no terrain");
+            }
+        }
+
+        if(ImGui::CollapsingHeader("Viewshed")) {
+            ImGui::SliderFloat("eye height", &observer_height, 0.0f, 50.0f);
+            ImGui::SliderFloat("radius (0 for any)", &observer_radius, 0.0f, 500.0f);
+            auto recompute = ImGui::SliderFloat("target height", &viewshed_target_height, 0.0f, 20.0f);
+
+            auto query = scene.get_terrain_query();
+            if(ImGui::Button("add observer where looking")) {
+                auto look = query->intersect(TerrainRay{camera.get_position(), camera.get_front(), 1000.0f});
+                if(look.hit) {
+                    observers.push_back(ViewshedObserver{
+                        glm::vec2(look.position.x, look.position.z),
+                        observer_height,
+                        observer_radius > 0.0f ? observer_radius : std::numeric_limits<float>::infinity()});
+                    recompute = true;
+                }
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("clear observers")) {
+                observers.clear();
+                scene.clear_viewshed_overlay();
+            }
+            if(ImGui::Button("recompute for current terrain")) {
+                recompute = true;
+            }
+
+            if(recompute && !observers.empty()) {
+                auto start = std::chrono::steady_clock::now();
+                auto viewshed = Viewshed::compute(*query, observers, viewshed_target_height, scene.get_jobs());
+                viewshed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                viewshed_visible = 100.0 * viewshed.count_visible() / (static_cast<double>(viewshed.get_width()) * viewshed.get_depth());
+                scene.set_viewshed_overlay(viewshed);
+            }
+
+            ImGui::Text("%zu observers", observers.size());
+            if(scene.has_viewshed_overlay()) {
+                ImGui::Text("%.1f%% visible, computed in %.2f ms", viewshed_visible, viewshed_ms);
+            }
+        }
+
+        if(ImGui::CollapsingHeader("Lighting")) {
+            auto baked = scene.is_baked_lighting();
+            if(ImGui::Checkbox("baked occlusion and sun shadows", &baked)) {
+                scene.set_baked_lighting(baked);
+            }
+
+            // The sun as angles in degrees, converted back on every change
+            auto bake_settings = scene.get_lighting_bake_settings();
+            auto sun = glm::normalize(bake_settings.sun_direction);
+            auto azimuth = glm::degrees(std::atan2(sun.z, sun.x));
+            auto elevation = glm::degrees(std::asin(sun.y));
+            auto directions = static_cast<int>(bake_settings.directions);
+
+            auto changed = ImGui::SliderFloat("sun azimuth", &azimuth, -180.0f, 180.0f);
+            changed = ImGui::SliderFloat("sun elevation", &elevation, 1.0f, 90.0f) || changed;
+            changed = ImGui::SliderInt("occlusion directions", &directions, 4, 32) || changed;
+            changed = ImGui::SliderFloat("search distance", &bake_settings.max_distance, 4.0f, 128.0f) || changed;
+            if(changed) {
+                auto across = std::cos(glm::radians(elevation));
+                bake_settings.sun_direction = glm::vec3(
+                    across * std::cos(glm::radians(azimuth)),
+                    std::sin(glm::radians(elevation)),
+                    across * std::sin(glm::radians(azimuth)));
+                bake_settings.directions = static_cast<unsigned int>(directions);
+                scene.set_lighting_bake_settings(bake_settings);
+            }
+
+            if(scene.is_baked_lighting()) {
+                auto& lighting = scene.get_baked_lighting();
+                ImGui::Text("%ux%u samples baked in %.2f ms", lighting.get_width(), lighting.get_depth(), lighting.get_bake_ms());
+            }
+        }
+
+        if(ImGui::CollapsingHeader("Culling")) {
+            auto& culler = scene.get_culler();
+            auto occlusion = culler.is_occlusion_enabled();
+            if(ImGui::Checkbox("horizon occlusion", &occlusion)) {
+                culler.set_occlusion_enabled(occlusion);
+            }
+
+            if(scene.is_instanced_terrain()) {
+                auto& culling_stats = culler.get_stats();
+                ImGui::Text("%u visible, %u occluded, %u outside the frustum", culling_stats.visible, culling_stats.occluded, culling_stats.frustum_culled);
+            } else {
+                ImGui::Text("Only the instanced chunks are culled");
+            }
+        }
+
+        if(ImGui::CollapsingHeader("GL Calls")) {
+            ImGui::Text("diagnostics: %s%s", GlDiagnostics::mode_name(), GlDiagnostics::has_debug_callback() ? " (KHR_debug)" : "");
+
+            auto& debug_stats = GlDiagnostics::get_debug_stats();
+            ImGui::Text("errors %llu, warnings %llu", 
+                static_cast<unsigned long long>(debug_stats.errors), 
+                static_cast<unsigned long long>(debug_stats.warnings));
+            if(!debug_stats.last_message.empty()) {
+                ImGui::TextWrapped("last: %s", debug_stats.last_message.c_str());
+            }
+
+            ImGui::Text("%llu calls last frame", static_cast<unsigned long long>(GlDiagnostics::get_frame_calls()));
+            for(auto& counter : GlDiagnostics::get_counters()) {
+                ImGui::Text("%-28s %6llu", counter.entry_point.c_str(), static_cast<unsigned long long>(counter.last_frame_calls));
+            }
+        }
+
         ImGui::End();
 
         ImGui::Render();
 
-        if(!(settings == last_settings)) {
-            last_settings = settings;
-            terrain->update(settings);
-        }
-
-        ///////////////////////////////////////////////////////////////////////
-        //
-        // Draw the light cube
-        //
-        ///////////////////////////////////////////////////////////////////////
-        mvm_shader.use();
-        mvm_shader.set_vec3("object_color", glm::vec3(1.0f, 1.0f, 1.0f));
-        mvm_shader.set_mat4("projection", projection);
-        mvm_shader.set_mat4("view", view);
-        mvm_shader.set_mat4("model", glm::translate(glm::mat4x4(1.0), light_position));
-        light->draw();
-        
-        terrain_shader.use();
-        terrain_shader.set_vec3("light_color", glm::vec3(1.0, 1.0, 1.0));
-        terrain_shader.set_vec3("light_pos", light_position);
-        terrain_shader.set_mat4("projection", projection);
-        terrain_shader.set_mat4("view", view);
-        terrain_shader.set_mat4("model", glm::translate(glm::mat4x4(1.0), glm::vec3(0.0f, -1.0f, 0.0f)));
-        terrain->draw();
-
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if(!options.record_path.empty()) {
+            auto record_time = current_frame - record_start;
+            if(record_time >= next_keyframe) {
+                recording.add_keyframe(CameraKeyframe{record_time, camera.get_position(), camera.get_yaw(), camera.get_pitch()});
+                next_keyframe = record_time + RECORD_INTERVAL;
+            }
+
+            if(!(recorded_settings == settings)) {
+                recording.add_changes(record_time, recorded_settings, settings);
+                recorded_settings = settings;
+            }
+        }
+
+        scene.update(settings);
+
+        if(keep_above_ground) {
+            auto position = camera.get_position();
+            auto ground = scene.get_terrain_query()->get_height(position.x, position.z) + ground_clearance;
+            if(position.y < ground) {
+                camera.set_pose(glm::vec3(position.x, ground, position.z), camera.get_yaw(), camera.get_pitch());
+            }
+        }
+
+        scene.render(camera.get_projection(), camera.get_view_matrix(), camera.get_position());
+
+        {
+            GpuTimerScope timer(&gpu_profiler, "imgui");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        // The ImGui backend binds its own program, VAO and buffers
+        GlState::invalidate();
+
+        gpu_profiler.end_frame();
+        GlDiagnostics::end_frame();
+        GlState::end_frame();
 
         // swap buffers and poll events
-        window.swap_and_poll();
+        window->swap_and_poll();
+    }
+
+    if(!options.record_path.empty()) {
+        recording.save(options.record_path);
+        std::cout << "Recorded flythrough to " << options.record_path << std::endl;
     }
 
     return 0;
+}
+
+// Set while run_server() runs, for the signal handler
+TileServer* tile_server = nullptr;
+
+int run_server(const Options& options) {
+    JobSystem jobs;
+    TileServer server(jobs, TILE_SERVER_CACHE_BYTES, std::max(4u, std::thread::hardware_concurrency()));
+
+    if(options.serve) {
+        server.listen_tcp(static_cast<uint16_t>(options.serve_port));
+        std::cout << "Serving tiles on http://127.0.0.1:" << server.get_port() << std::endl;
+    }
+    if(!options.serve_socket_path.empty()) {
+        server.listen_unix(options.serve_socket_path);
+        std::cout << "Serving tiles on " << options.serve_socket_path << std::endl;
+    }
+
+    tile_server = &server;
+    auto on_signal = [](int) {
+        if(tile_server) {
+            tile_server->stop();
+        }
+    };
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+#ifdef SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    server.run();
+    tile_server = nullptr;
+
+    std::cout << "Stopped serving tiles" << std::endl;
+    return 0;
+}
+
+int run_sweep(const Options& options) {
+    auto sweep = ParameterSweep::load(options.sweep_path);
+    std::cout << "Sweeping " << sweep.get_variant_count() << " variants of " << options.sweep_path << std::endl;
+
+    JobSystem jobs;
+    auto report = sweep.run(jobs, options.sweep_prefix);
+
+    std::cout << report.maps << " maps took " << report.total_ms << " ms on " << report.threads << " threads ("
+              << report.maps_per_second << " maps/s, " << report.samples_per_second / 1e6 << " M samples/s)" << std::endl;
+    std::cout << "Wrote " << options.sweep_prefix << "_index.csv" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv) try {
+    auto options = parse_options(argc, argv);
+
+    if(!options.sweep_path.empty()) {
+        return run_sweep(options);
+    }
+
+    if(options.serve || !options.serve_socket_path.empty()) {
+        return run_server(options);
+    }
+
+    if(!options.flythrough_path.empty()) {
+        return run_flythrough(options);
+    }
+
+    if(options.headless) {
+        return run_headless(options);
+    }
+
+    return run_interactive(options);
 } catch (const std::exception& e) {
     std::cout << e.what() << std::endl;
+    return 1;
 }
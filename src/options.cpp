@@ -0,0 +1,141 @@
+#include "options.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    float parse_float(const std::string& option, const std::string& value) {
+        try {
+            std::size_t parsed = 0;
+            auto number = std::stof(value, &parsed);
+            if(parsed == value.size()) {
+                return number;
+            }
+        } catch(const std::exception&) {
+        }
+
+        throw std::runtime_error("Invalid value '" + value + "' for " + option + "\n" + options_usage());
+    }
+
+    unsigned int parse_unsigned(const std::string& option, const std::string& value) {
+        try {
+            std::size_t parsed = 0;
+            auto number = std::stoul(value, &parsed);
+            if(parsed == value.size()) {
+                return static_cast<unsigned int>(number);
+            }
+        } catch(const std::exception&) {
+        }
+
+        throw std::runtime_error("Invalid value '" + value + "' for " + option + "\n" + options_usage());
+    }
+}
+
+Options parse_options(int argc, char **argv) {
+    Options options;
+
+    for(auto index = 1; index < argc; index++) {
+        std::string option = argv[index];
+
+        auto next_value = [&]() {
+            if(index + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + option + "\n" + options_usage());
+            }
+            return std::string(argv[++index]);
+        };
+
+        if(option == "--headless") {
+            options.headless = true;
+        } else if(option == "--size") {
+            auto value = next_value();
+            auto separator = value.find('x');
+            if(separator == std::string::npos) {
+                throw std::runtime_error("Expected WIDTHxHEIGHT for --size\n" + std::string(options_usage()));
+            }
+            options.width = parse_unsigned(option, value.substr(0, separator));
+            options.height = parse_unsigned(option, value.substr(separator + 1));
+        } else if(option == "--frames") {
+            options.frames = parse_unsigned(option, next_value());
+        } else if(option == "--instanced") {
+            options.instanced = true;
+        } else if(option == "--progressive") {
+            options.progressive = true;
+        } else if(option == "--baked-lighting") {
+            options.baked_lighting = true;
+        } else if(option == "--readback") {
+            options.readback_path = next_value();
+        } else if(option == "--export-heights") {
+            options.export_heights_path = next_value();
+        } else if(option == "--export-pyramid") {
+            options.export_pyramid_prefix = next_value();
+        } else if(option == "--flythrough") {
+            options.flythrough_path = next_value();
+        } else if(option == "--timestep") {
+            options.timestep = parse_float(option, next_value());
+            if(!std::isfinite(options.timestep) || !(options.timestep > 0.0f)) {
+                throw std::runtime_error("--timestep must be positive and finite");
+            }
+        } else if(option == "--report") {
+            options.report_path = next_value();
+        } else if(option == "--baseline") {
+            options.baseline_path = next_value();
+        } else if(option == "--threshold") {
+            options.threshold = parse_float(option, next_value());
+            if(!std::isfinite(options.threshold) || options.threshold < 0.0f) {
+                throw std::runtime_error("--threshold must be a finite fraction of at least 0");
+            }
+        } else if(option == "--record") {
+            options.record_path = next_value();
+        } else if(option == "--serve") {
+            options.serve = true;
+            options.serve_port = parse_unsigned(option, next_value());
+            if(options.serve_port > 65535) {
+                throw std::runtime_error("--serve needs a port below 65536");
+            }
+        } else if(option == "--serve-socket") {
+            options.serve_socket_path = next_value();
+        } else if(option == "--sweep") {
+            options.sweep_path = next_value();
+        } else if(option == "--sweep-out") {
+            options.sweep_prefix = next_value();
+        } else {
+            throw std::runtime_error("Unknown option " + option + "\n" + options_usage());
+        }
+    }
+
+    return options;
+}
+
+const char *options_usage() {
+    return
+        "usage: procedural_terrain_generation [--headless] [--size WIDTHxHEIGHT]\n"
+        "                                     [--frames N] [--instanced] [--progressive] [--baked-lighting]\n"
+        "                                     [--readback FILE.ppm]\n"
+        "                                     [--export-heights FILE.pgm] [--export-pyramid PREFIX]\n"
+        "                                     [--flythrough FILE|default] [--timestep SECONDS]\n"
+        "                                     [--report FILE.json] [--baseline FILE.json] [--threshold FRACTION]\n"
+        "                                     [--record FILE]\n"
+        "                                     [--serve PORT] [--serve-socket PATH]\n"
+        "                                     [--sweep FILE] [--sweep-out PREFIX]\n"
+        "  --headless    render offscreen without a display, then exit\n"
+        "  --size        offscreen framebuffer size (default 1280x720)\n"
+        "  --frames      number of frames to render headless (default 300)\n"
+        "  --instanced   draw the instanced terrain chunks\n"
+        "  --progressive refine regenerated terrain over several frames, as the interactive mode does\n"
+        "  --baked-lighting light the terrain with baked ambient occlusion and sun shadows\n"
+        "  --readback    write the last headless frame to a binary PPM\n"
+        "  --export-heights write the terrain mesh's height map to a 16 bit PGM after a headless run\n"
+        "  --export-pyramid generate every LOD level of the instanced chunks' area directly and write\n"
+        "                level k to PREFIX_k.pgm after a headless run\n"
+        "  --flythrough  replay a camera path script, or the built-in one, at a fixed timestep\n"
+        "  --timestep    flythrough timestep (default 1/60 s)\n"
+        "  --report      write flythrough frame and regeneration percentiles as JSON\n"
+        "  --baseline    compare the flythrough against a previous report, exit with 2 on regressions\n"
+        "  --threshold   allowed slowdown against the baseline (default 0.1 = 10%)\n"
+        "  --record      save the interactive camera path and settings changes as a flythrough script\n"
+        "  --serve       serve height, normal and palette tiles over HTTP on 127.0.0.1:PORT until\n"
+        "                interrupted, 0 picks a free port\n"
+        "  --serve-socket serve tiles on a Unix domain socket, alone or besides --serve\n"
+        "  --sweep       generate every settings variant a sweep specification lists, then exit\n"
+        "  --sweep-out   prefix of the sweep's height maps, thumbnails and index (default sweep)\n";
+}
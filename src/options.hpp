@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+
+// Command line options. Without --headless the renderer opens its usual
+// window; --flythrough replays a path in either mode instead of taking input.
+struct Options {
+    bool headless;
+    unsigned int width;
+    unsigned int height;
+    unsigned int frames;
+    bool instanced;
+    bool progressive;
+    bool baked_lighting;
+    std::string readback_path;
+    std::string export_heights_path;
+    std::string export_pyramid_prefix;
+
+    // Flythrough benchmark, "default" selects the built-in path
+    std::string flythrough_path;
+    float timestep;
+    std::string report_path;
+    std::string baseline_path;
+    float threshold;
+
+    // Records the interactive session as a flythrough script
+    std::string record_path;
+
+    // Serves tiles instead of rendering, on a localhost port, a Unix
+    // socket or both
+    bool serve;
+    unsigned int serve_port;
+    std::string serve_socket_path;
+
+    // Generates every variant of a parameter sweep, see ParameterSweep
+    std::string sweep_path;
+    std::string sweep_prefix;
+
+    Options()
+        : headless(false),
+          width(1280),
+          height(720),
+          frames(300),
+          instanced(false),
+          progressive(false),
+          baked_lighting(false),
+          readback_path(),
+          export_heights_path(),
+          export_pyramid_prefix(),
+          flythrough_path(),
+          timestep(1.0f / 60.0f),
+          report_path(),
+          baseline_path(),
+          threshold(0.1f),
+          record_path(),
+          serve(false),
+          serve_port(0),
+          serve_socket_path(),
+          sweep_path(),
+          sweep_prefix("sweep")
+    {
+    }
+};
+
+// Throws std::runtime_error with the usage text on malformed arguments
+Options parse_options(int argc, char **argv);
+
+const char *options_usage();
@@ -0,0 +1,317 @@
+#include "parameter_sweep.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "height_field.hpp"
+#include "job_system.hpp"
+
+namespace {
+    // Keeps a mistyped range from queueing millions of maps
+    constexpr uint64_t MAX_VARIANTS = 100000;
+    constexpr unsigned int MAX_SIZE = 8193;
+
+    // As a double, which holds seeds beyond a float's 24 bits exactly
+    bool parse_number(const std::string& text, double& number) {
+        try {
+            std::size_t parsed = 0;
+            number = std::stod(text, &parsed);
+            return parsed == text.size() && std::isfinite(number);
+        } catch(const std::exception&) {
+            return false;
+        }
+    }
+
+    // Coarsest level whose samples still cover at most thumbnail pixels a
+    // side, or 0 when thumbnails are off
+    unsigned int get_thumbnail_level(const unsigned int size, const unsigned int thumbnail) {
+        auto level = 0u;
+        while(thumbnail > 0 && ((size - 1) >> level) + 1 > thumbnail) {
+            level++;
+        }
+        return level;
+    }
+
+    void write_thumbnail(const std::string& path, const unsigned int size, const std::vector<float>& heights, std::vector<uint8_t>& pixels) {
+        pixels.resize(heights.size() * 3);
+        for(auto index = std::size_t{0}; index < heights.size(); index++) {
+            auto color = TerrainGenerator::get_palette_color(heights[index]);
+            pixels[index * 3] = static_cast<uint8_t>(std::lround(std::clamp(color.x, 0.0f, 1.0f) * 255.0f));
+            pixels[index * 3 + 1] = static_cast<uint8_t>(std::lround(std::clamp(color.y, 0.0f, 1.0f) * 255.0f));
+            pixels[index * 3 + 2] = static_cast<uint8_t>(std::lround(std::clamp(color.z, 0.0f, 1.0f) * 255.0f));
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file << "P6\n" << size << " " << size << "\n255\n";
+        file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+        if(!file) {
+            throw std::runtime_error("Failed writing thumbnail to " + path);
+        }
+    }
+}
+
+ParameterSweep::ParameterSweep()
+    : m_size(257),
+      m_heights(true),
+      m_thumbnail(0),
+      m_axes()
+{
+}
+
+ParameterSweep ParameterSweep::load(const std::string& path) {
+    std::ifstream file(path);
+    if(!file) {
+        throw std::runtime_error("Failed to open sweep specification " + path);
+    }
+
+    ParameterSweep sweep;
+
+    std::string line;
+    auto line_number = 0;
+    while(std::getline(file, line)) {
+        line_number++;
+
+        std::istringstream stream(line);
+        std::string kind;
+        if(!(stream >> kind) || kind[0] == '#') {
+            continue;
+        }
+
+        auto error = [&](const std::string& message) {
+            return std::runtime_error(path + ":" + std::to_string(line_number) + ": " + message);
+        };
+
+        if(kind == "size") {
+            auto size = 0;
+            if(!(stream >> size) || size < 2 || size > static_cast<int>(MAX_SIZE)) {
+                throw error("expected size <samples>, from 2 to " + std::to_string(MAX_SIZE));
+            }
+            sweep.m_size = static_cast<unsigned int>(size);
+        } else if(kind == "heights") {
+            std::string value;
+            if(!(stream >> value) || (value != "on" && value != "off")) {
+                throw error("expected heights on|off");
+            }
+            sweep.m_heights = value == "on";
+        } else if(kind == "thumbnail") {
+            auto thumbnail = 0;
+            if(!(stream >> thumbnail) || thumbnail < 0 || thumbnail == 1) {
+                throw error("expected thumbnail <pixels>, 0 for none");
+            }
+            sweep.m_thumbnail = static_cast<unsigned int>(thumbnail);
+        } else if(auto field = TerrainGenerator::find_settings_field(kind)) {
+            auto listed = std::any_of(sweep.m_axes.begin(), sweep.m_axes.end(), [&](auto& axis) { return axis.field == field; });
+            if(listed) {
+                throw error(kind + " is listed twice");
+            }
+
+            SweepAxis axis{field, {}};
+            std::string token;
+            while(stream >> token) {
+                auto parts = std::vector<double>();
+                std::istringstream range(token);
+                std::string part;
+                while(std::getline(range, part, ':')) {
+                    auto number = 0.0;
+                    if(!parse_number(part, number)) {
+                        throw error("invalid value " + token);
+                    }
+                    parts.push_back(number);
+                }
+
+                if(parts.size() == 1) {
+                    axis.values.push_back(parts[0]);
+                    continue;
+                }
+
+                auto step = parts.size() == 3 ? parts[2] : 1.0;
+                if(parts.size() > 3 || !(step > 0.0) || parts[1] < parts[0]) {
+                    throw error("expected from:to[:step] with from <= to and a positive step, got " + token);
+                }
+
+                // Stepped from the start rather than accumulated, and a
+                // little tolerance keeps the end despite rounding
+                auto steps = std::floor((parts[1] - parts[0]) / step + 1e-4);
+                if(steps >= MAX_VARIANTS) {
+                    throw error("range " + token + " has too many values");
+                }
+                auto count = static_cast<uint64_t>(steps) + 1;
+                for(auto value = uint64_t{0}; value < count; value++) {
+                    axis.values.push_back(parts[0] + value * step);
+                }
+            }
+
+            if(axis.values.empty()) {
+                throw error("expected values for " + kind);
+            }
+
+            // Every field is bounded on its own, so checking each value
+            // against the defaults covers every combination
+            for(auto value : axis.values) {
+                if(!field->accepts(value)) {
+                    throw error("invalid " + kind + " " + std::to_string(value));
+                }
+
+                GenerationSettings settings;
+                field->set(settings, value);
+                auto invalid = TerrainGenerator::check_settings(settings);
+                if(!invalid.empty()) {
+                    throw error(invalid);
+                }
+            }
+
+            sweep.m_axes.push_back(std::move(axis));
+        } else {
+            throw error("unknown entry " + kind);
+        }
+    }
+
+    auto variants = uint64_t{1};
+    for(auto& axis : sweep.m_axes) {
+        variants *= axis.values.size();
+        if(variants > MAX_VARIANTS) {
+            throw std::runtime_error("Sweep " + path + " has more than " + std::to_string(MAX_VARIANTS) + " variants");
+        }
+    }
+
+    if(!sweep.m_heights && sweep.m_thumbnail == 0) {
+        throw std::runtime_error("Sweep " + path + " writes neither heights nor thumbnails");
+    }
+
+    return sweep;
+}
+
+unsigned int ParameterSweep::get_variant_count() const {
+    auto count = 1u;
+    for(auto& axis : m_axes) {
+        count *= static_cast<unsigned int>(axis.values.size());
+    }
+    return count;
+}
+
+GenerationSettings ParameterSweep::get_variant(const unsigned int index) const {
+    GenerationSettings settings;
+
+    // Mixed radix, the last axis is the least significant digit
+    auto rest = index;
+    for(auto axis = m_axes.rbegin(); axis != m_axes.rend(); ++axis) {
+        auto count = static_cast<unsigned int>(axis->values.size());
+        axis->field->set(settings, axis->values[rest % count]);
+        rest /= count;
+    }
+    return settings;
+}
+
+SweepReport ParameterSweep::run(JobSystem& jobs, const std::string& prefix) const {
+    auto start = std::chrono::steady_clock::now();
+
+    auto count = get_variant_count();
+    auto digits = std::to_string(count - 1).size();
+    auto file_name = [&](unsigned int index, const char *extension) {
+        auto number = std::to_string(index);
+        return prefix + "_" + std::string(digits - number.size(), '0') + number + extension;
+    };
+
+    auto level = get_thumbnail_level(m_size, m_thumbnail);
+    auto thumbnail_size = ((m_size - 1) >> level) + 1;
+
+    std::vector<double> generation_ms(count, 0.0);
+    std::vector<JobHandle> maps;
+    maps.reserve(count);
+    for(auto index = 0u; index < count; index++) {
+        maps.push_back(jobs.submit([&, index] {
+            // Grown by the first map a thread generates, reused after
+            thread_local std::vector<float> heights;
+            thread_local std::vector<float> thumbnail;
+            thread_local std::vector<glm::vec2> octave_offsets;
+            thread_local std::vector<uint8_t> pixels;
+            thread_local HeightField field;
+
+            auto settings = get_variant(index);
+            auto map_start = std::chrono::steady_clock::now();
+
+            // Thumbnails take every 2^level-th sample of the full map, a map
+            // generated at their spacing would be normalized over other
+            // extremes and color differently
+            TerrainGenerator::generate_height_map(m_size, settings, heights, octave_offsets);
+
+            if(m_thumbnail > 0) {
+                thumbnail.resize(static_cast<std::size_t>(thumbnail_size) * thumbnail_size);
+                for(auto z = 0u; z < thumbnail_size; z++) {
+                    for(auto x = 0u; x < thumbnail_size; x++) {
+                        thumbnail[z * thumbnail_size + x] = heights[static_cast<std::size_t>(z << level) * m_size + (x << level)];
+                    }
+                }
+            }
+
+            generation_ms[index] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - map_start).count();
+
+            if(m_heights) {
+                if(field.get_width() != m_size) {
+                    field = HeightField(m_size, m_size, HeightFormat::UNORM16);
+                }
+                field.encode(heights);
+                field.save_pgm(file_name(index, ".pgm"));
+            }
+            if(m_thumbnail > 0) {
+                write_thumbnail(file_name(index, ".ppm"), thumbnail_size, thumbnail, pixels);
+            }
+        }));
+    }
+
+    // Waiting runs maps on this thread as well. Every map is waited for, even
+    // after one failed, since the others still use this frame's locals.
+    std::exception_ptr failure;
+    for(auto& map : maps) {
+        try {
+            jobs.wait(map);
+        } catch(...) {
+            if(!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+    if(failure) {
+        std::rethrow_exception(failure);
+    }
+
+    auto index_path = prefix + "_index.csv";
+    std::ofstream index_file(index_path);
+    index_file.precision(7);
+    index_file << "index,heights,thumbnail";
+    for(auto& field : TerrainGenerator::get_settings_fields()) {
+        index_file << "," << field.name;
+    }
+    index_file << ",generation_ms\n";
+
+    for(auto index = 0u; index < count; index++) {
+        auto settings = get_variant(index);
+        index_file << index << ","
+                   << (m_heights ? file_name(index, ".pgm") : "") << ","
+                   << (m_thumbnail > 0 ? file_name(index, ".ppm") : "");
+        for(auto& field : TerrainGenerator::get_settings_fields()) {
+            index_file << "," << field.format(field.get(settings));
+        }
+        index_file << "," << generation_ms[index] << "\n";
+    }
+
+    if(!index_file) {
+        throw std::runtime_error("Failed writing sweep index to " + index_path);
+    }
+
+    auto total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    auto samples_per_map = static_cast<double>(m_size) * m_size;
+    return SweepReport {
+        count,
+        jobs.get_worker_count() + 1,
+        total_ms,
+        count / (total_ms / 1000.0),
+        count * samples_per_map / (total_ms / 1000.0)
+    };
+}
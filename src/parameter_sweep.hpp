@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "terrain_generator.hpp"
+
+class JobSystem;
+
+// Values one settings field takes across a sweep
+struct SweepAxis {
+    const SettingsField* field;
+    std::vector<double> values;
+};
+
+struct SweepReport {
+    unsigned int maps;
+    unsigned int threads;
+    double total_ms;
+    double maps_per_second;
+
+    // Height samples generated per second
+    double samples_per_second;
+};
+
+// Every combination of a few GenerationSettings fields, generated as a
+// batch. Specifications are plain text, one entry per line:
+//
+//     # side of every map in samples, 257 by default
+//     size 257
+//     # write 16 bit PGM heights, on by default
+//     heights on
+//     # write palette colored PPM thumbnails at most this wide, 0 for none
+//     thumbnail 64
+//     # field, then values: numbers and inclusive from:to[:step] ranges
+//     seed 1:16
+//     octaves 4 6 8
+//     persistence 0.4:0.6:0.05
+//
+// Fields not listed keep their defaults, the last listed field varies
+// fastest. Lines starting with # are comments.
+class ParameterSweep {
+public:
+    ParameterSweep();
+
+    static ParameterSweep load(const std::string& path);
+
+    unsigned int get_variant_count() const;
+    GenerationSettings get_variant(const unsigned int index) const;
+
+    // Generates every variant, one job each so that maps run side by side
+    // without synchronizing, with scratch memory kept per thread. Maps are
+    // generated like the terrain mesh's height map, and thumbnails sampled
+    // from them, also when only thumbnails are written. Writes
+    // prefix_N.pgm and prefix_N.ppm per variant and prefix_index.csv
+    // listing each variant's files and settings. Throws
+    // std::runtime_error if a file cannot be written.
+    SweepReport run(JobSystem& jobs, const std::string& prefix) const;
+
+private:
+    unsigned int m_size;
+    bool m_heights;
+    unsigned int m_thumbnail;
+    std::vector<SweepAxis> m_axes;
+};
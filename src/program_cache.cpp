@@ -0,0 +1,195 @@
+#include "program_cache.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace {
+    constexpr uint32_t MAGIC = 0x50524742; // "PRGB"
+    constexpr uint32_t VERSION = 1;
+
+    struct EntryHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    std::string cache_directory;
+    ProgramCacheStats stats{0, 0, 0, 0.0, 0.0};
+
+    uint64_t fnv1a(uint64_t hash, std::string_view data) {
+        for(auto byte : data) {
+            hash ^= static_cast<unsigned char>(byte);
+            hash *= 0x100000001b3ull;
+        }
+
+        // Separate fields so that ("ab", "c") and ("a", "bc") differ
+        hash ^= 0xff;
+        hash *= 0x100000001b3ull;
+        return hash;
+    }
+
+    std::string gl_string(GLenum name) {
+        auto value = reinterpret_cast<const char *>(glGetString(name));
+        return value ? value : "";
+    }
+
+    std::filesystem::path entry_path(uint64_t key) {
+        std::stringstream name;
+        name << std::hex << key << ".bin";
+        return std::filesystem::path(ProgramCache::get_directory()) / name.str();
+    }
+
+    double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+namespace ProgramCache {
+    void set_directory(const std::string& directory) {
+        cache_directory = directory;
+    }
+
+    const std::string& get_directory() {
+        if(cache_directory.empty()) {
+            auto from_env = std::getenv("TERRAIN_SHADER_CACHE");
+            cache_directory = from_env ? from_env : "shader_cache";
+        }
+
+        return cache_directory;
+    }
+
+    bool is_supported() {
+        auto format_count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+        return format_count > 0;
+    }
+
+    uint64_t make_key(std::string_view vert, std::string_view frag) {
+        auto hash = 0xcbf29ce484222325ull;
+        hash = fnv1a(hash, vert);
+        hash = fnv1a(hash, frag);
+        hash = fnv1a(hash, gl_string(GL_VENDOR));
+        hash = fnv1a(hash, gl_string(GL_RENDERER));
+        hash = fnv1a(hash, gl_string(GL_VERSION));
+        return hash;
+    }
+
+    GLuint load(uint64_t key) {
+        auto start = std::chrono::steady_clock::now();
+
+        if(!is_supported()) {
+            stats.misses++;
+            return 0;
+        }
+
+        auto path = entry_path(key);
+        std::error_code error;
+        auto file_size = std::filesystem::file_size(path, error);
+        std::ifstream file(path, std::ios::binary);
+        if(error || !file) {
+            stats.misses++;
+            return 0;
+        }
+
+        EntryHeader header{};
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+        // Trust the recorded length only if it accounts for the whole file
+        auto sized = file && header.length == file_size - sizeof(header);
+
+        std::vector<char> binary(sized ? header.length : 0);
+        file.read(binary.data(), binary.size());
+
+        auto valid = sized
+            && file
+            && header.magic == MAGIC
+            && header.version == VERSION
+            && header.key == key;
+
+        auto program = 0u;
+        if(valid) {
+            program = glCreateProgram();
+            glProgramBinary(program, header.format, binary.data(), binary.size());
+
+            // The driver rejects binaries of an unknown format or one it
+            // produced before an update, even if the key still matched
+            auto status = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            if(status != GL_TRUE) {
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+
+        if(!program) {
+            file.close();
+            std::filesystem::remove(path, error);
+            stats.rejected++;
+            stats.misses++;
+            return 0;
+        }
+
+        stats.hits++;
+        stats.load_ms += elapsed_ms(start);
+        return program;
+    }
+
+    void store(uint64_t key, GLuint program) {
+        if(!is_supported()) {
+            return;
+        }
+
+        auto length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0) {
+            return;
+        }
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(get_directory(), error);
+
+        // Write to a temporary and rename so a crash or a second instance
+        // never leaves a truncated entry behind
+        auto path = entry_path(key);
+        auto temporary = path;
+        temporary += ".tmp";
+
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if(!file) {
+            std::cout << "Shader cache: cannot write to " << get_directory() << std::endl;
+            return;
+        }
+
+        EntryHeader header{MAGIC, VERSION, key, format, static_cast<uint32_t>(length)};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        file.close();
+
+        error.clear();
+        if(file) {
+            std::filesystem::rename(temporary, path, error);
+        }
+        if(!file || error) {
+            std::filesystem::remove(temporary, error);
+        }
+    }
+
+    void record_compile(double ms) {
+        stats.compile_ms += ms;
+    }
+
+    const ProgramCacheStats& get_stats() {
+        return stats;
+    }
+}
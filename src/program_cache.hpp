@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <glad/glad.h>
+
+struct ProgramCacheStats {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int rejected;
+    double load_ms;
+    double compile_ms;
+};
+
+// On-disk cache of linked program binaries. Entries are keyed by a hash of
+// the shader sources and the driver's vendor, renderer and version strings,
+// and store the binary format next to the blob, so a driver update or a
+// different GPU simply misses. Any entry the driver refuses is deleted and
+// the caller compiles from source. I/O failures disable nothing but the
+// cache itself.
+namespace ProgramCache {
+    // Defaults to $TERRAIN_SHADER_CACHE, or "shader_cache" in the working directory
+    void set_directory(const std::string& directory);
+    const std::string& get_directory();
+
+    bool is_supported();
+
+    uint64_t make_key(std::string_view vert, std::string_view frag);
+
+    // Returns a linked program, or 0 if there is no usable entry
+    GLuint load(uint64_t key);
+
+    // program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    void store(uint64_t key, GLuint program);
+
+    void record_compile(double ms);
+    const ProgramCacheStats& get_stats();
+}
@@ -0,0 +1,112 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "gl_state.hpp"
+
+namespace {
+    const std::string NO_LABEL;
+}
+
+RenderQueue::RenderQueue()
+    : m_packets(),
+      m_uniforms(),
+      m_textures(),
+      m_order(),
+      m_stats{0, 0}
+{
+}
+
+RenderQueue& RenderQueue::submit(
+    const Shader& shader,
+    GLuint vao,
+    const DrawType& draw_type,
+    GpuProfiler* profiler,
+    const std::string* profile_label)
+{
+    m_packets.push_back(DrawPacket{
+        &shader,
+        vao,
+        draw_type,
+        m_uniforms.size(),
+        0,
+        m_textures.size(),
+        0,
+        profiler,
+        profile_label
+    });
+
+    return *this;
+}
+
+RenderQueue& RenderQueue::with_texture(GLuint unit, GLenum target, GLuint texture) {
+    auto& packet = get_last_packet();
+    m_textures.push_back(PacketTexture{unit, target, texture});
+    packet.texture_count++;
+    return *this;
+}
+
+void RenderQueue::flush() {
+    m_order.clear();
+    for(std::size_t index = 0; index < m_packets.size(); index++) {
+        m_order.emplace_back(sort_key(m_packets[index]), index);
+    }
+
+    // The index breaks ties, which keeps submission order for equal keys
+    std::sort(m_order.begin(), m_order.end());
+
+    m_stats = RenderQueueStats{m_packets.size(), 0};
+
+    const DrawPacket* previous = nullptr;
+    for(auto& [key, index] : m_order) {
+        auto& packet = m_packets[index];
+        if(!previous || previous->shader->get_program() != packet.shader->get_program() || previous->vao != packet.vao) {
+            m_stats.state_changes++;
+        }
+        previous = &packet;
+
+        GlState::use_program(packet.shader->get_program());
+        GlState::bind_vertex_array(packet.vao);
+
+        for(auto uniform = 0u; uniform < packet.uniform_count; uniform++) {
+            apply(*packet.shader, m_uniforms[packet.first_uniform + uniform]);
+        }
+
+        for(auto texture = 0u; texture < packet.texture_count; texture++) {
+            auto& binding = m_textures[packet.first_texture + texture];
+            GlState::bind_texture(binding.unit, binding.target, binding.texture);
+        }
+
+        GpuTimerScope timer(packet.profile_label ? packet.profiler : nullptr, packet.profile_label ? *packet.profile_label : NO_LABEL);
+        issue_draw(packet.draw_type);
+    }
+
+    m_packets.clear();
+    m_uniforms.clear();
+    m_textures.clear();
+}
+
+const RenderQueueStats& RenderQueue::get_stats() const {
+    return m_stats;
+}
+
+RenderQueue::DrawPacket& RenderQueue::get_last_packet() {
+    if(m_packets.empty()) {
+        throw std::runtime_error("Render queue packet state set before any packet was submitted");
+    }
+    return m_packets.back();
+}
+
+uint64_t RenderQueue::sort_key(const DrawPacket& packet) {
+    // Program changes are the most expensive, so they take the high bits
+    return (static_cast<uint64_t>(packet.shader->get_program()) << 32) | packet.vao;
+}
+
+void RenderQueue::apply(const Shader& shader, const PacketUniform& uniform) {
+    std::visit([&](const auto& value) {
+        using Type = std::decay_t<decltype(value)>;
+        shader.set(Uniform<Type>{uniform.location}, value);
+    }, uniform.value);
+}
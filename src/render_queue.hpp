@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "drawable.hpp"
+#include "gpu_profiler.hpp"
+#include "shader.hpp"
+
+struct RenderQueueStats {
+    std::size_t packets;
+    std::size_t state_changes;
+};
+
+// Collects draw packets during a frame and issues them sorted by program and
+// VAO, so packets sharing state are drawn back to back and the shadow state in
+// GlState drops the binds that would repeat. Packets with equal keys keep
+// their submission order.
+class RenderQueue {
+public:
+    using UniformValue = std::variant<int, float, glm::vec2, glm::vec3, glm::vec4, glm::mat4>;
+
+    RenderQueue();
+
+    template <typename Child>
+    RenderQueue& submit(const Shader& shader, Drawable<Child>& drawable) {
+        return submit(shader, drawable.get_vao(), drawable.get_draw_type(), drawable.get_profiler(), &drawable.get_profile_label());
+    }
+
+    RenderQueue& submit(
+        const Shader& shader,
+        GLuint vao,
+        const DrawType& draw_type,
+        GpuProfiler* profiler = nullptr,
+        const std::string* profile_label = nullptr
+    );
+
+    // Attaches a uniform value to the most recently submitted packet. Throws
+    // std::runtime_error if nothing was submitted since the last flush().
+    template <typename Type>
+    RenderQueue& with(Uniform<Type> uniform, const Type& value) {
+        auto& packet = get_last_packet();
+        m_uniforms.push_back(PacketUniform{uniform.location, UniformValue(value)});
+        packet.uniform_count++;
+        return *this;
+    }
+
+    // Binds a texture for the most recently submitted packet, throws like
+    // with()
+    RenderQueue& with_texture(GLuint unit, GLenum target, GLuint texture);
+
+    // Sorts and issues every packet, then empties the queue. Storage is kept
+    // so that steady-state frames do not allocate.
+    void flush();
+
+    const RenderQueueStats& get_stats() const;
+
+private:
+    struct PacketUniform {
+        GLint location;
+        UniformValue value;
+    };
+
+    struct PacketTexture {
+        GLuint unit;
+        GLenum target;
+        GLuint texture;
+    };
+
+    struct DrawPacket {
+        const Shader* shader;
+        GLuint vao;
+        DrawType draw_type;
+        std::size_t first_uniform;
+        std::size_t uniform_count;
+        std::size_t first_texture;
+        std::size_t texture_count;
+        GpuProfiler* profiler;
+        const std::string* profile_label;
+    };
+
+    DrawPacket& get_last_packet();
+
+    static uint64_t sort_key(const DrawPacket& packet);
+    static void apply(const Shader& shader, const PacketUniform& uniform);
+
+    std::vector<DrawPacket> m_packets;
+    std::vector<PacketUniform> m_uniforms;
+    std::vector<PacketTexture> m_textures;
+    std::vector<std::pair<uint64_t, std::size_t>> m_order;
+
+    RenderQueueStats m_stats;
+};
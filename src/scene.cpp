@@ -0,0 +1,435 @@
+#include "scene.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <utility>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "drawables/cube.hpp"
+#include "drawables/terrain_patches.hpp"
+#include "drawables/terrain_squares.hpp"
+
+namespace {
+    // Unit 0 holds the chunk height array
+    constexpr GLuint VIEWSHED_TEXTURE_UNIT = 1;
+    constexpr GLuint LIGHTING_TEXTURE_UNIT = 2;
+}
+
+Scene::Scene(const unsigned int grid_size, const unsigned int patch_size, const unsigned int patch_chunks)
+    : m_mvm_shader(Shader::create<Shaders::Mvm>()),
+      m_terrain_shader(Shader::create<Shaders::Terrain>()),
+      m_patch_shader(Shader::create<Shaders::TerrainPatch>()),
+      m_mvm_model(m_mvm_shader.get_uniform<glm::mat4>("model")),
+      m_mvm_object_color(m_mvm_shader.get_uniform<glm::vec3>("object_color")),
+      m_terrain_model(m_terrain_shader.get_uniform<glm::mat4>("model")),
+      m_patch_model(m_patch_shader.get_uniform<glm::mat4>("model")),
+      m_patch_height_scale(m_patch_shader.get_uniform<float>("height_scale")),
+      m_patch_heights(m_patch_shader.get_uniform<int>("heights")),
+      m_terrain_viewshed{
+          m_terrain_shader.get_uniform<int>("viewshed"),
+          m_terrain_shader.get_uniform<int>("viewshed_enabled"),
+          m_terrain_shader.get_uniform<glm::vec2>("viewshed_origin")},
+      m_patch_viewshed{
+          m_patch_shader.get_uniform<int>("viewshed"),
+          m_patch_shader.get_uniform<int>("viewshed_enabled"),
+          m_patch_shader.get_uniform<glm::vec2>("viewshed_origin")},
+      m_terrain_lighting{
+          m_terrain_shader.get_uniform<int>("baked_lighting"),
+          m_terrain_shader.get_uniform<int>("baked_lighting_enabled"),
+          m_terrain_shader.get_uniform<glm::vec2>("baked_lighting_origin"),
+          m_terrain_shader.get_uniform<glm::vec3>("sun_direction")},
+      m_patch_lighting{
+          m_patch_shader.get_uniform<int>("baked_lighting"),
+          m_patch_shader.get_uniform<int>("baked_lighting_enabled"),
+          m_patch_shader.get_uniform<glm::vec2>("baked_lighting_origin"),
+          m_patch_shader.get_uniform<glm::vec3>("sun_direction")},
+      m_frame_uniforms(UniformBlocks::FRAME),
+      m_light(Cube::create()),
+      m_light_position(grid_size / 2.0f, 100.0f, grid_size / 2.0f),
+      m_terrain(TerrainSquares::create(grid_size)),
+      m_terrain_patches(TerrainPatches::create(patch_size, patch_chunks)),
+      m_settings(),
+      m_instanced_terrain(false),
+      m_terrain_stages(GenerationStage::NONE),
+      m_patches_dirty(true),
+      m_progressive(false),
+      m_refine_budget_ms(4.0),
+      m_regeneration_stats{0.0, AllocationStats{0, 0}, 1, GenerationStage::NONE},
+      m_culler(),
+      m_render_queue(),
+      m_gpu_profiler(std::make_shared<GpuProfiler>()),
+      m_jobs(),
+      m_tile_cache(TILE_CACHE_BYTES),
+      m_viewshed_texture(),
+      m_viewshed_origin(0.0f, 0.0f),
+      m_bake_lighting(false),
+      m_lighting_settings(),
+      m_baked_lighting(),
+      m_lighting_texture(),
+      m_lighting_bake(),
+      m_lighting_swap(),
+      m_next_lighting(),
+      m_lighting_stale(false),
+      m_terrain_query(),
+      m_terrain_query_dirty(false)
+{
+    m_light->set_profiler(m_gpu_profiler, "light");
+    m_terrain->set_profiler(m_gpu_profiler, "terrain");
+    m_terrain_patches->set_profiler(m_gpu_profiler, "terrain patches");
+
+    publish_terrain_query();
+}
+
+Scene::~Scene() {
+    // Refining chunks use the tile cache, which goes before the job system
+    m_terrain_patches->cancel_refinement(m_jobs);
+
+    // A running bake waits for its tiles, which the job system would drop
+    if(m_lighting_swap) {
+        m_lighting_swap->cancel();
+        m_jobs.wait(m_lighting_swap);
+    }
+}
+
+bool Scene::update(const GenerationSettings& settings) {
+    m_jobs.run_main_thread_jobs(MAIN_THREAD_JOB_BUDGET_MS);
+    collect_lighting_bake();
+
+    auto stages = settings.invalidated_stages(m_settings);
+    if(stages != GenerationStage::NONE) {
+        m_settings = settings;
+        m_terrain_stages |= stages;
+
+        // The chunks only store heights, their height scale is a uniform
+        m_patches_dirty = m_patches_dirty || (stages & GenerationStage::HEIGHTS);
+        m_terrain_query_dirty = true;
+    }
+
+    // Chunks the camera came closer to need the octaves their old LOD left
+    // out. They are generated in the background and swapped in by the main
+    // thread jobs above once done.
+    auto refined_chunks = m_instanced_terrain && !m_patches_dirty && m_terrain_patches->refine_detail(m_settings, m_jobs, m_tile_cache);
+
+    auto regenerate_patches = m_instanced_terrain && m_patches_dirty;
+    auto regenerate_terrain = !m_instanced_terrain && m_terrain_stages != GenerationStage::NONE;
+    auto refine_terrain = !m_instanced_terrain && !regenerate_terrain && !m_terrain->is_refined();
+    if(!regenerate_patches && !regenerate_terrain && !refine_terrain && !refined_chunks && !m_terrain_query_dirty) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    AllocationScope allocations;
+
+    auto changed = true;
+    auto rerun = GenerationStage::ALL;
+    if(regenerate_patches) {
+        m_patches_dirty = false;
+        rerun = GenerationStage::HEIGHTS;
+        m_terrain_patches->update(m_settings, m_jobs, m_tile_cache);
+    } else if(regenerate_terrain) {
+        rerun = std::exchange(m_terrain_stages, GenerationStage::NONE);
+        if(m_progressive && (rerun & GenerationStage::HEIGHTS)) {
+            m_terrain->begin_refinement(m_settings);
+        } else {
+            m_terrain->update_stages(m_settings, rerun);
+        }
+    } else if(refine_terrain) {
+        // Finish what a refinement started, even if progressive updates
+        // were switched off since
+        changed = m_terrain->refine(m_progressive ? m_refine_budget_ms : std::numeric_limits<double>::infinity());
+    } else if(refined_chunks) {
+        // Generated in the background, only swapping them in and the
+        // query below are left to time here
+        rerun = GenerationStage::HEIGHTS;
+    } else {
+        // Only the query is stale, e.g. after switching terrains
+        changed = false;
+    }
+
+    // A copy of the whole surface plus its pyramid is too much to publish
+    // for every preview level or chunk as it lands, so the query waits for
+    // the terrain being drawn to be complete
+    m_terrain_query_dirty = m_terrain_query_dirty || changed;
+    auto complete = m_instanced_terrain ? !m_terrain_patches->is_refining() : m_terrain->is_refined();
+    if(m_terrain_query_dirty && complete) {
+        publish_terrain_query();
+    }
+
+    if(changed) {
+        m_regeneration_stats = RegenerationStats {
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+            allocations.get_stats(),
+            m_instanced_terrain ? 1 : m_terrain->get_refinement_step(),
+            rerun
+        };
+    }
+
+    return changed;
+}
+
+void Scene::render(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& camera_position) {
+    m_frame_uniforms.update(FrameUniforms {
+        projection,
+        view,
+        glm::vec4(camera_position, 1.0f),
+        glm::vec4(m_light_position, 1.0f),
+        glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)
+    });
+
+    ///////////////////////////////////////////////////////////////////////
+    //
+    // Draw the light cube
+    //
+    ///////////////////////////////////////////////////////////////////////
+    m_render_queue.submit(m_mvm_shader, *m_light)
+        .with(m_mvm_object_color, glm::vec3(1.0f, 1.0f, 1.0f))
+        .with(m_mvm_model, glm::translate(glm::mat4x4(1.0), m_light_position));
+
+    if(m_instanced_terrain) {
+        auto patch_model = glm::translate(glm::mat4x4(1.0), glm::vec3(0.0f, -1.0f, 0.0f));
+
+        m_terrain_patches->update_lods(camera_position);
+        m_terrain_patches->cull(m_culler, projection * view, patch_model, camera_position, m_settings.height_scale);
+
+        m_render_queue.submit(m_patch_shader, *m_terrain_patches)
+            .with(m_patch_model, patch_model)
+            .with(m_patch_height_scale, m_settings.height_scale)
+            .with(m_patch_heights, 0)
+            .with_texture(0, GL_TEXTURE_2D_ARRAY, m_terrain_patches->get_height_texture());
+        with_viewshed(m_patch_viewshed);
+        with_lighting(m_patch_lighting);
+    } else {
+        m_render_queue.submit(m_terrain_shader, *m_terrain)
+            .with(m_terrain_model, glm::translate(glm::mat4x4(1.0), glm::vec3(0.0f, -1.0f, 0.0f)));
+        with_viewshed(m_terrain_viewshed);
+        with_lighting(m_terrain_lighting);
+    }
+
+    m_render_queue.flush();
+}
+
+void Scene::set_instanced_terrain(bool instanced) {
+    m_terrain_query_dirty = m_terrain_query_dirty || m_instanced_terrain != instanced;
+    m_instanced_terrain = instanced;
+}
+
+bool Scene::is_instanced_terrain() const {
+    return m_instanced_terrain;
+}
+
+void Scene::set_progressive(bool progressive) {
+    m_progressive = progressive;
+}
+
+bool Scene::is_progressive() const {
+    return m_progressive;
+}
+
+void Scene::set_refine_budget(double budget_ms) {
+    m_refine_budget_ms = budget_ms;
+}
+
+double Scene::get_refine_budget() const {
+    return m_refine_budget_ms;
+}
+
+const RegenerationStats& Scene::get_regeneration_stats() const {
+    return m_regeneration_stats;
+}
+
+GpuProfiler& Scene::get_gpu_profiler() {
+    return *m_gpu_profiler;
+}
+
+const RenderQueueStats& Scene::get_render_stats() const {
+    return m_render_queue.get_stats();
+}
+
+const VertexCacheReport& Scene::get_vertex_cache_report() const {
+    if(m_instanced_terrain) {
+        return m_terrain_patches->get_vertex_cache_report();
+    }
+    return m_terrain->get_vertex_cache_report();
+}
+
+HorizonCuller& Scene::get_culler() {
+    return m_culler;
+}
+
+HeightField Scene::get_height_field() {
+    if(m_terrain_stages & GenerationStage::HEIGHTS) {
+        m_terrain->update_stages(m_settings, std::exchange(m_terrain_stages, GenerationStage::NONE));
+    }
+    if(!m_terrain->is_refined()) {
+        m_terrain->refine(std::numeric_limits<double>::infinity());
+    }
+
+    return m_terrain->get_height_field(HeightFormat::UNORM16);
+}
+
+JobSystem& Scene::get_jobs() {
+    return m_jobs;
+}
+
+TileCache& Scene::get_tile_cache() {
+    return m_tile_cache;
+}
+
+void Scene::set_viewshed_overlay(const Viewshed& viewshed) {
+    if(!m_viewshed_texture
+        || m_viewshed_texture->words_per_row != viewshed.get_words_per_row()
+        || m_viewshed_texture->rows != viewshed.get_depth()) {
+        m_viewshed_texture = std::make_unique<MaskTextureObject>(viewshed.get_words_per_row(), viewshed.get_depth());
+    }
+
+    m_viewshed_texture->update(viewshed.get_bits());
+    m_viewshed_origin = viewshed.get_origin();
+}
+
+void Scene::clear_viewshed_overlay() {
+    m_viewshed_texture.reset();
+}
+
+bool Scene::has_viewshed_overlay() const {
+    return m_viewshed_texture != nullptr;
+}
+
+void Scene::with_viewshed(const ViewshedUniforms& uniforms) {
+    // The sampler always points at its own unit, an unused sampler sharing
+    // unit 0 with the height array would fail the draw
+    m_render_queue
+        .with(uniforms.mask, static_cast<int>(VIEWSHED_TEXTURE_UNIT))
+        .with(uniforms.enabled, m_viewshed_texture ? 1 : 0);
+
+    if(m_viewshed_texture) {
+        m_render_queue
+            .with(uniforms.origin, m_viewshed_origin)
+            .with_texture(VIEWSHED_TEXTURE_UNIT, GL_TEXTURE_2D, m_viewshed_texture->texture);
+    }
+}
+
+void Scene::set_baked_lighting(bool enabled) {
+    m_bake_lighting = enabled;
+    if(enabled) {
+        bake_lighting();
+    } else {
+        m_lighting_texture.reset();
+    }
+}
+
+bool Scene::is_baked_lighting() const {
+    return m_bake_lighting;
+}
+
+void Scene::set_lighting_bake_settings(const LightingBakeSettings& settings) {
+    m_lighting_settings = settings;
+    if(m_bake_lighting) {
+        bake_lighting();
+    }
+}
+
+const LightingBakeSettings& Scene::get_lighting_bake_settings() const {
+    return m_lighting_settings;
+}
+
+const BakedLighting& Scene::get_baked_lighting() const {
+    return m_baked_lighting;
+}
+
+void Scene::finish_lighting_bake() {
+    while(m_lighting_swap) {
+        m_jobs.wait(m_lighting_swap);
+        collect_lighting_bake();
+    }
+}
+
+void Scene::bake_lighting() {
+    // One bake at a time, requests made meanwhile fold into the next one
+    if(m_lighting_swap) {
+        m_lighting_stale = true;
+        return;
+    }
+    m_lighting_stale = false;
+
+    // The query and settings are copied, both may change while baking
+    m_lighting_bake = m_jobs.submit([this, query = get_terrain_query(), settings = m_lighting_settings] {
+        m_next_lighting = BakedLighting::bake(*query, settings, m_jobs);
+    }, JobPriority::BACKGROUND);
+
+    m_lighting_swap = m_jobs.submit([this] {
+        if(!m_bake_lighting) {
+            return;
+        }
+
+        m_baked_lighting = std::move(m_next_lighting);
+        if(!m_lighting_texture
+            || m_lighting_texture->width != m_baked_lighting.get_width()
+            || m_lighting_texture->height != m_baked_lighting.get_depth()) {
+            m_lighting_texture = std::make_unique<LightingTextureObject>(m_baked_lighting.get_width(), m_baked_lighting.get_depth());
+        }
+
+        m_lighting_texture->update(m_baked_lighting.get_texels());
+    }, JobPriority::NORMAL, {m_lighting_bake}, JobAffinity::MAIN_THREAD);
+}
+
+void Scene::collect_lighting_bake() {
+    if(!m_lighting_swap || !m_lighting_swap->is_done()) {
+        return;
+    }
+
+    auto bake = std::exchange(m_lighting_bake, nullptr);
+    m_lighting_swap.reset();
+
+    // Rethrows a failed bake
+    m_jobs.wait(bake);
+
+    if(m_lighting_stale && m_bake_lighting) {
+        bake_lighting();
+    }
+}
+
+void Scene::with_lighting(const LightingUniforms& uniforms) {
+    // As with the viewshed, the sampler keeps a unit of its own
+    m_render_queue
+        .with(uniforms.map, static_cast<int>(LIGHTING_TEXTURE_UNIT))
+        .with(uniforms.enabled, m_lighting_texture ? 1 : 0);
+
+    if(m_lighting_texture) {
+        m_render_queue
+            .with(uniforms.origin, m_baked_lighting.get_origin())
+            .with(uniforms.sun_direction, m_baked_lighting.get_sun_direction())
+            .with_texture(LIGHTING_TEXTURE_UNIT, GL_TEXTURE_2D, m_lighting_texture->texture);
+    }
+}
+
+std::shared_ptr<const TerrainQuery> Scene::get_terrain_query() const {
+    return std::atomic_load(&m_terrain_query);
+}
+
+void Scene::publish_terrain_query() {
+    m_terrain_query_dirty = false;
+
+    std::vector<float> heights;
+    auto side = 0u;
+    if(m_instanced_terrain) {
+        m_terrain_patches->get_surface_heights(m_settings.height_scale, heights);
+        side = m_terrain_patches->get_chunks_per_side() * m_terrain_patches->get_patch_size() + 1;
+    } else {
+        m_terrain->get_surface_heights(heights);
+        side = m_terrain->get_grid_size();
+    }
+
+    // Both terrains are drawn one unit down, see render()
+    for(auto& height : heights) {
+        height -= 1.0f;
+    }
+
+    std::atomic_store(&m_terrain_query, std::shared_ptr<const TerrainQuery>(
+        std::make_shared<TerrainQuery>(side, side, glm::vec2(0.0f, 0.0f), std::move(heights))));
+
+    if(m_bake_lighting) {
+        bake_lighting();
+    }
+}
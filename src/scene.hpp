@@ -0,0 +1,229 @@
+#pragma once
+
+#include <memory>
+
+#include <glm/glm.hpp>
+
+#include "allocation_counter.hpp"
+#include "baked_lighting.hpp"
+#include "gpu_profiler.hpp"
+#include "height_field.hpp"
+#include "horizon_culler.hpp"
+#include "job_system.hpp"
+#include "terrain_query.hpp"
+#include "tile_cache.hpp"
+#include "render_queue.hpp"
+#include "viewshed.hpp"
+#include "shader.hpp"
+#include "terrain_generator.hpp"
+#include "uniform_buffer.hpp"
+
+// Cost of the most recent regeneration or refinement pass, publishing the
+// terrain query included
+struct RegenerationStats {
+    double ms;
+    AllocationStats allocations;
+
+    // Sample spacing of the terrain now shown, 1 at full resolution
+    unsigned int step;
+
+    // GenerationStage flags of the stages that ran
+    unsigned int stages;
+};
+
+class Cube;
+class TerrainPatches;
+class TerrainSquares;
+
+// Everything drawn each frame: the programs, the drawables and the queue they
+// are submitted to. Shared by the interactive loop and the headless
+// benchmark so both exercise the same render path.
+class Scene {
+public:
+    // Time update() gives main thread jobs queued since the last frame,
+    // e.g. uploads of work that finished on the workers
+    static constexpr double MAIN_THREAD_JOB_BUDGET_MS = 2.0;
+
+    // Compressed chunk heights kept for settings visited before
+    static constexpr std::size_t TILE_CACHE_BYTES = 64 * 1024 * 1024;
+
+    Scene(const unsigned int grid_size, const unsigned int patch_size, const unsigned int patch_chunks);
+
+    ~Scene();
+
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    // Regenerates the terrain being drawn if the settings changed since it
+    // was last generated. Only the terrain being drawn is regenerated, the
+    // other one catches up when it is switched to. Only the stages the
+    // changed settings invalidate are rerun, see GenerationStage, so a new
+    // height scale does not evaluate any noise. With progressive updates
+    // the terrain mesh shows a coarse preview right away and is refined over
+    // the following calls, evaluating noise within the refine budget. Each
+    // finished level uploads a mesh of its own samples only. Instanced
+    // chunks the camera approaches regenerate at finer detail in the
+    // background and are swapped in by a later call. Returns true if
+    // anything was regenerated or refined.
+    bool update(const GenerationSettings& settings);
+
+    // Uploads the frame uniforms, then submits and flushes every draw
+    void render(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& camera_position);
+
+    void set_instanced_terrain(bool instanced);
+    bool is_instanced_terrain() const;
+
+    // Only the terrain mesh refines progressively, chunks regenerate at once
+    void set_progressive(bool progressive);
+    bool is_progressive() const;
+    void set_refine_budget(double budget_ms);
+    double get_refine_budget() const;
+
+    const RegenerationStats& get_regeneration_stats() const;
+
+    GpuProfiler& get_gpu_profiler();
+    const RenderQueueStats& get_render_stats() const;
+
+    // Post-transform vertex cache efficiency of the terrain being drawn,
+    // before and after its indices were reordered
+    const VertexCacheReport& get_vertex_cache_report() const;
+
+    // Culls the instanced chunks only, the single terrain mesh is always drawn
+    HorizonCuller& get_culler();
+
+    // Heights of the terrain mesh for the current settings at full
+    // resolution, generated first if the mesh is not drawn or still refining
+    HeightField get_height_field();
+
+    // Shared by everything that generates or loads terrain. update() runs
+    // its main thread jobs.
+    JobSystem& get_jobs();
+
+    TileCache& get_tile_cache();
+
+    // Surface of the terrain being drawn as of the last update() that left
+    // it complete: progressive previews and chunks still refining keep the
+    // previous query. Safe to call from any thread; the query keeps
+    // answering for the terrain it was taken from while a newer one is
+    // published.
+    std::shared_ptr<const TerrainQuery> get_terrain_query() const;
+
+    // Highlights the samples visible in viewshed on either terrain and
+    // darkens the rest until cleared. The overlay does not follow terrain
+    // changes, compute a new viewshed for those.
+    void set_viewshed_overlay(const Viewshed& viewshed);
+    void clear_viewshed_overlay();
+    bool has_viewshed_overlay() const;
+
+    // Bakes ambient occlusion and sun shadows from the terrain query every
+    // time one is published, and lights both terrains with them and the
+    // baked sun instead of the light cube. Costs one texture read per
+    // fragment, nothing is traced per frame. Bakes run on the job system,
+    // one at a time, and update() swaps each one in once it is done; the
+    // previous lighting is drawn until then.
+    void set_baked_lighting(bool enabled);
+    bool is_baked_lighting() const;
+
+    // Rebakes if baked lighting is on
+    void set_lighting_bake_settings(const LightingBakeSettings& settings);
+    const LightingBakeSettings& get_lighting_bake_settings() const;
+
+    // Blocks until the bake in flight and any requested after it are
+    // swapped in, e.g. before a benchmark's first frame
+    void finish_lighting_bake();
+
+    // The last bake swapped in, empty until the first one is
+    const BakedLighting& get_baked_lighting() const;
+
+private:
+    struct ViewshedUniforms;
+    struct LightingUniforms;
+
+    // Rebuilds the terrain query from the terrain being drawn
+    void publish_terrain_query();
+
+    // Attaches the overlay to the most recently submitted terrain packet
+    void with_viewshed(const ViewshedUniforms& uniforms);
+
+    // Starts a bake of the current query, or asks for one once the bake in
+    // flight is swapped in
+    void bake_lighting();
+
+    // Forgets a finished bake, rethrowing if it failed, and starts the one
+    // asked for meanwhile
+    void collect_lighting_bake();
+
+    void with_lighting(const LightingUniforms& uniforms);
+
+    Shader m_mvm_shader;
+    Shader m_terrain_shader;
+    Shader m_patch_shader;
+
+    Uniform<glm::mat4> m_mvm_model;
+    Uniform<glm::vec3> m_mvm_object_color;
+    Uniform<glm::mat4> m_terrain_model;
+    Uniform<glm::mat4> m_patch_model;
+    Uniform<float> m_patch_height_scale;
+    Uniform<int> m_patch_heights;
+
+    // Both terrain programs share terrain.frag and its overlay
+    struct ViewshedUniforms {
+        Uniform<int> mask;
+        Uniform<int> enabled;
+        Uniform<glm::vec2> origin;
+    };
+    ViewshedUniforms m_terrain_viewshed;
+    ViewshedUniforms m_patch_viewshed;
+
+    struct LightingUniforms {
+        Uniform<int> map;
+        Uniform<int> enabled;
+        Uniform<glm::vec2> origin;
+        Uniform<glm::vec3> sun_direction;
+    };
+    LightingUniforms m_terrain_lighting;
+    LightingUniforms m_patch_lighting;
+
+    // Camera and light data shared by every program through the Frame block
+    UniformBuffer<FrameUniforms> m_frame_uniforms;
+
+    std::shared_ptr<Cube> m_light;
+    glm::vec3 m_light_position;
+
+    std::shared_ptr<TerrainSquares> m_terrain;
+    std::shared_ptr<TerrainPatches> m_terrain_patches;
+
+    GenerationSettings m_settings;
+    bool m_instanced_terrain;
+    // GenerationStage flags the terrain mesh still has to rerun
+    unsigned int m_terrain_stages;
+    bool m_patches_dirty;
+    bool m_progressive;
+    double m_refine_budget_ms;
+    RegenerationStats m_regeneration_stats;
+
+    HorizonCuller m_culler;
+    RenderQueue m_render_queue;
+    std::shared_ptr<GpuProfiler> m_gpu_profiler;
+    JobSystem m_jobs;
+    TileCache m_tile_cache;
+
+    std::unique_ptr<MaskTextureObject> m_viewshed_texture;
+    glm::vec2 m_viewshed_origin;
+
+    bool m_bake_lighting;
+    LightingBakeSettings m_lighting_settings;
+    BakedLighting m_baked_lighting;
+    std::unique_ptr<LightingTextureObject> m_lighting_texture;
+
+    // The bake in flight writes m_next_lighting, and the main thread job
+    // depending on it swaps that in
+    JobHandle m_lighting_bake;
+    JobHandle m_lighting_swap;
+    BakedLighting m_next_lighting;
+    bool m_lighting_stale;
+
+    // Only accessed through std::atomic_load and std::atomic_store
+    std::shared_ptr<const TerrainQuery> m_terrain_query;
+    bool m_terrain_query_dirty;
+};
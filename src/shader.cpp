@@ -1,5 +1,12 @@
 #include "shader.hpp"
 
+#include "gl_diagnostics.hpp"
+#include "gl_state.hpp"
+#include "program_cache.hpp"
+#include "uniform_buffer.hpp"
+
+#include <chrono>
+#include <iostream>
 #include <sstream>
 #include <vector>
 
@@ -17,7 +24,37 @@
 
 Shader::Shader(GLuint program) 
     : m_program(program)
-{}
+{
+    introspect();
+}
+
+GLuint Shader::create_program(const char *name, std::string_view vert, std::string_view frag) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed_ms = [&]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    auto key = ProgramCache::make_key(vert, frag);
+    if(auto program = ProgramCache::load(key)) {
+        std::cout << "Shader " << name << " loaded from cache in " << elapsed_ms() << " ms" << std::endl;
+        return program;
+    }
+
+    auto vs = Shader::compile_shader(vert.data(), GL_VERTEX_SHADER);
+    auto fs = Shader::compile_shader(frag.data(), GL_FRAGMENT_SHADER);
+
+    auto program = Shader::link_program(vs, fs);
+
+    glDeleteShader(fs);
+    glDeleteShader(vs);
+
+    auto compile_ms = elapsed_ms();
+    ProgramCache::record_compile(compile_ms);
+    ProgramCache::store(key, program);
+
+    std::cout << "Shader " << name << " compiled in " << compile_ms << " ms" << std::endl;
+    return program;
+}
 
 GLuint Shader::compile_shader(const char * shader_source, GLenum shader_type) {
     auto shader = glCreateShader(shader_type);
@@ -44,6 +81,7 @@ GLuint Shader::link_program(GLuint vs, GLuint fs) {
     auto program = glCreateProgram();
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
     auto status = 0;
@@ -63,149 +101,184 @@ GLuint Shader::link_program(GLuint vs, GLuint fs) {
 }
 
 void Shader::use() {
-    glUseProgram(m_program);
+    GlState::use_program(m_program);
 }
 
-void Shader::set_bool(const char *name, bool value) const
-{   
-    auto variable = glGetUniformLocation(m_program, name);
+GLuint Shader::get_program() const {
+    return m_program;
+}
 
-#ifdef __DEBUG__
-    if(variable == -1) {
+void Shader::introspect() {
+    auto uniform_count = 0;
+    auto max_name_length = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    std::vector<GLchar> name(max_name_length + 1);
+    for(auto index = 0; index < uniform_count; index++) {
+        auto length = 0;
+        auto size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_program, index, name.size(), &length, &size, &type, name.data());
+
+        // Members of uniform blocks have no location and are set via buffers
+        auto location = glGetUniformLocation(m_program, name.data());
+        if(location == -1) {
+            continue;
+        }
+
+        // Arrays are reported as "name[0]", register them under "name" too
+        auto uniform_name = std::string(name.data(), length);
+        m_uniforms.emplace(uniform_name, UniformInfo{location, type});
+        if(size > 1) {
+            m_uniforms.emplace(uniform_name.substr(0, uniform_name.find('[')), UniformInfo{location, type});
+        }
+    }
+
+    // Point every known block at its shared binding so one buffer serves all programs
+    for(auto& binding : UniformBlocks::ALL) {
+        auto block_index = glGetUniformBlockIndex(m_program, binding.name);
+        if(block_index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(m_program, block_index, binding.index);
+        }
+    }
+}
+
+const Shader::UniformInfo& Shader::find_uniform(const char *name) const {
+    auto uniform = m_uniforms.find(name);
+    if(uniform == m_uniforms.end()) {
         std::stringstream error;
         error << "Unknown_variable: ";
         error << name;
         throw std::runtime_error(error.str().c_str());
     }
-#endif
 
-    glUniform1i(variable, (int)value); 
+    return uniform->second;
 }
 
-void Shader::set_int(const char *name, int value) const
-{ 
-    auto variable = glGetUniformLocation(m_program, name);
+GLint Shader::resolve_uniform(const char *name, GLenum type) const {
+    auto& info = find_uniform(name);
 
-#ifdef __DEBUG__
-    if(variable == -1) {
+    // Samplers are assigned texture units through int handles
+    auto is_sampler = info.type == GL_SAMPLER_2D || info.type == GL_SAMPLER_2D_ARRAY || info.type == GL_UNSIGNED_INT_SAMPLER_2D;
+    if(info.type != type && !(is_sampler && type == GL_INT)) {
         std::stringstream error;
-        error << "Unknown_variable: ";
+        error << "Uniform type mismatch: ";
         error << name;
         throw std::runtime_error(error.str().c_str());
     }
+
+    return info.location;
+}
+
+GLint Shader::find_location(const char *name) const {
+    auto uniform = m_uniforms.find(name);
+    if(uniform == m_uniforms.end()) {
+#ifdef __DEBUG__
+        find_uniform(name);
 #endif
+        // Like glGetUniformLocation, unknown names silently do nothing
+        return -1;
+    }
 
-    glUniform1i(variable, value); 
+    return uniform->second.location;
 }
 
-void Shader::set_float(const char *name, float value) const
+void Shader::set(Uniform<bool> uniform, bool value) const {
+    GL_CHECK(glUniform1i(uniform.location, static_cast<int>(value)));
+}
+
+void Shader::set(Uniform<int> uniform, int value) const {
+    GL_CHECK(glUniform1i(uniform.location, value));
+}
+
+void Shader::set(Uniform<float> uniform, float value) const {
+    GL_CHECK(glUniform1f(uniform.location, value));
+}
+
+void Shader::set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const {
+    GL_CHECK(glUniform2fv(uniform.location, 1, &value[0]));
+}
+
+void Shader::set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const {
+    GL_CHECK(glUniform3fv(uniform.location, 1, &value[0]));
+}
+
+void Shader::set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const {
+    GL_CHECK(glUniform4fv(uniform.location, 1, &value[0]));
+}
+
+void Shader::set(Uniform<glm::mat2> uniform, const glm::mat2 &mat) const {
+    GL_CHECK(glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]));
+}
+
+void Shader::set(Uniform<glm::mat3> uniform, const glm::mat3 &mat) const {
+    GL_CHECK(glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]));
+}
+
+void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4 &mat) const {
+    GL_CHECK(glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]));
+}
+
+void Shader::set_bool(const char *name, bool value) const
+{   
+    auto variable = find_location(name);
+
+    GL_CHECK(glUniform1i(variable, (int)value)); 
+}
+
+void Shader::set_int(const char *name, int value) const
 { 
-    auto variable = glGetUniformLocation(m_program, name);
+    auto variable = find_location(name);
 
-#ifdef __DEBUG__
-    if(variable == -1) {
-        std::stringstream error;
-        error << "Unknown_variable: ";
-        error << name;
-        throw std::runtime_error(error.str().c_str());
-    }
-#endif
+    GL_CHECK(glUniform1i(variable, value)); 
+}
 
-    glUniform1f(variable, value); 
+void Shader::set_float(const char *name, float value) const
+{ 
+    auto variable = find_location(name);
+
+    GL_CHECK(glUniform1f(variable, value)); 
 }
 
 void Shader::set_vec2(const char *name, const glm::vec2 &value) const
 { 
-    auto variable = glGetUniformLocation(m_program, name);
-
-#ifdef __DEBUG__
-    if(variable == -1) {
-        std::stringstream error;
-        error << "Unknown_variable: ";
-        error << name;
-        throw std::runtime_error(error.str().c_str());
-    }
-#endif
+    auto variable = find_location(name);
 
-    glUniform2fv(variable, 1, &value[0]); 
+    GL_CHECK(glUniform2fv(variable, 1, &value[0])); 
 }
 
 void Shader::set_vec3(const char *name, const glm::vec3 &value) const
 { 
-    auto variable = glGetUniformLocation(m_program, name);
+    auto variable = find_location(name);
 
-#ifdef __DEBUG__
-    if(variable == -1) {
-        std::stringstream error;
-        error << "Unknown_variable: ";
-        error << name;
-        throw std::runtime_error(error.str().c_str());
-    }
-#endif
-
-    glUniform3fv(variable, 1, &value[0]); 
+    GL_CHECK(glUniform3fv(variable, 1, &value[0])); 
 }
 
 void Shader::set_vec4(const char *name, const glm::vec4 &value) const
 { 
-    auto variable = glGetUniformLocation(m_program, name);
+    auto variable = find_location(name);
 
-#ifdef __DEBUG__
-    if(variable == -1) {
-        std::stringstream error;
-        error << "Unknown_variable: ";
-        error << name;
-        throw std::runtime_error(error.str().c_str());
-    }
-#endif
-
-    glUniform4fv(variable, 1, &value[0]); 
+    GL_CHECK(glUniform4fv(variable, 1, &value[0])); 
 }
 
 void Shader::set_mat2(const char *name, const glm::mat2 &mat) const
 {
-    auto variable = glGetUniformLocation(m_program, name);
+    auto variable = find_location(name);
 
-#ifdef __DEBUG__
-    if(variable == -1) {
-        std::stringstream error;
-        error << "Unknown_variable: ";
-        error << name;
-        throw std::runtime_error(error.str().c_str());
-    }
-#endif
-
-    glUniformMatrix2fv(variable, 1, GL_FALSE, &mat[0][0]);
+    GL_CHECK(glUniformMatrix2fv(variable, 1, GL_FALSE, &mat[0][0]));
 }
 
 void Shader::set_mat3(const char *name, const glm::mat3 &mat) const
 {
-    auto variable = glGetUniformLocation(m_program, name);
+    auto variable = find_location(name);
 
-#ifdef __DEBUG__
-    if(variable == -1) {
-        std::stringstream error;
-        error << "Unknown_variable: ";
-        error << name;
-        throw std::runtime_error(error.str().c_str());
-    }
-#endif
-
-    glUniformMatrix3fv(variable, 1, GL_FALSE, &mat[0][0]);
+    GL_CHECK(glUniformMatrix3fv(variable, 1, GL_FALSE, &mat[0][0]));
 }
 
 void Shader::set_mat4(const char *name, const glm::mat4 &mat) const
 {
-    auto variable = glGetUniformLocation(m_program, name);
-
-#ifdef __DEBUG__
-    if(variable == -1) {
-        std::stringstream error;
-        error << "Unknown_variable: ";
-        error << name;
-        throw std::runtime_error(error.str().c_str());
-    }
-#endif
+    auto variable = find_location(name);
 
-    glUniformMatrix4fv(variable, 1, GL_FALSE, &mat[0][0]);
+    GL_CHECK(glUniformMatrix4fv(variable, 1, GL_FALSE, &mat[0][0]));
 }
\ No newline at end of file
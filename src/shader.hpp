@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string>
+#include <unordered_map>
+
 #include "glad/glad.h"
 #include "glm/mat4x4.hpp"
 
@@ -9,41 +12,83 @@
 #include "shaders/light_mvm.frag"
 #include "shaders/terrain.vert"
 #include "shaders/terrain.frag"
+#include "shaders/terrain_patch.vert"
 
 namespace Shaders {
     struct Mvm {
+        static constexpr const char *Name = "mvm";
         static constexpr std::string_view Vert = MvmVert;
         static constexpr std::string_view Frag = MvmFrag;
     };
 
     struct LightMvm {
+        static constexpr const char *Name = "light_mvm";
         static constexpr std::string_view Vert = LightMvmVert;
         static constexpr std::string_view Frag = LightMvmFrag;
     };
 
     struct Terrain {
+        static constexpr const char *Name = "terrain";
         static constexpr std::string_view Vert = TerrainVert;
         static constexpr std::string_view Frag = TerrainFrag;
     };
+
+    struct TerrainPatch {
+        static constexpr const char *Name = "terrain_patch";
+        static constexpr std::string_view Vert = TerrainPatchVert;
+        static constexpr std::string_view Frag = TerrainFrag;
+    };
 }
 
+// Maps the glm types accepted by Shader::set to their GLSL uniform type
+template <typename Type> struct UniformType;
+template <> struct UniformType<bool> { static constexpr GLenum value = GL_BOOL; };
+template <> struct UniformType<int> { static constexpr GLenum value = GL_INT; };
+template <> struct UniformType<float> { static constexpr GLenum value = GL_FLOAT; };
+template <> struct UniformType<glm::vec2> { static constexpr GLenum value = GL_FLOAT_VEC2; };
+template <> struct UniformType<glm::vec3> { static constexpr GLenum value = GL_FLOAT_VEC3; };
+template <> struct UniformType<glm::vec4> { static constexpr GLenum value = GL_FLOAT_VEC4; };
+template <> struct UniformType<glm::mat2> { static constexpr GLenum value = GL_FLOAT_MAT2; };
+template <> struct UniformType<glm::mat3> { static constexpr GLenum value = GL_FLOAT_MAT3; };
+template <> struct UniformType<glm::mat4> { static constexpr GLenum value = GL_FLOAT_MAT4; };
+
+// A uniform location resolved once at link time. The type parameter ties the
+// handle to the glm type it was looked up with.
+template <typename Type>
+struct Uniform {
+    GLint location;
+};
+
 class Shader {
 public:
 
     template<typename CustomShader>
     static Shader create() {
-        auto vs = Shader::compile_shader(CustomShader::Vert.data(), GL_VERTEX_SHADER);
-        auto fs = Shader::compile_shader(CustomShader::Frag.data(), GL_FRAGMENT_SHADER);
+        return Shader(Shader::create_program(CustomShader::Name, CustomShader::Vert, CustomShader::Frag));
+    }
 
-        auto program = Shader::link_program(vs, fs);
+    void use();
 
-        glDeleteShader(fs);
-        glDeleteShader(vs);
+    GLuint get_program() const;
 
-        return Shader(program);
+    // Looks up a uniform found by introspection at link time. Throws if the
+    // program has no such uniform or it is declared with a different type.
+    template <typename Type>
+    Uniform<Type> get_uniform(const char *name) const {
+        return Uniform<Type>{resolve_uniform(name, UniformType<Type>::value)};
     }
 
-    void use();
+    void set(Uniform<bool> uniform, bool value) const;
+    void set(Uniform<int> uniform, int value) const;
+    void set(Uniform<float> uniform, float value) const;
+    void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const;
+    void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const;
+    void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const;
+    void set(Uniform<glm::mat2> uniform, const glm::mat2 &mat) const;
+    void set(Uniform<glm::mat3> uniform, const glm::mat3 &mat) const;
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 &mat) const;
+
+    // Name based setters, resolved through the link time cache
 
     void set_bool(const char *name, bool value) const;
     void set_int(const char *name, int value) const;
@@ -56,10 +101,23 @@ public:
     void set_mat4(const char *name, const glm::mat4 &mat) const;
 
 private:
+    struct UniformInfo {
+        GLint location;
+        GLenum type;
+    };
+
     Shader(GLuint);
 
+    // Loads the program from the binary cache, or compiles and caches it
+    static GLuint create_program(const char *name, std::string_view vert, std::string_view frag);
     static GLuint compile_shader(const char *shader, GLenum shader_type);
     static GLuint link_program(GLuint vs, GLuint fs);
 
+    void introspect();
+    const UniformInfo& find_uniform(const char *name) const;
+    GLint resolve_uniform(const char *name, GLenum type) const;
+    GLint find_location(const char *name) const;
+
     GLuint m_program;
+    std::unordered_map<std::string, UniformInfo> m_uniforms;
 };
\ No newline at end of file
@@ -7,8 +7,14 @@ static constexpr std::string_view MvmVert = R"(
     layout (location = 0) in vec3 a_pos;
 
     uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+
+    layout (std140) uniform Frame {
+        mat4 projection;
+        mat4 view;
+        vec4 view_position;
+        vec4 light_position;
+        vec4 light_color;
+    };
 
     void main()
     {
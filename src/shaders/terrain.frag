@@ -14,23 +14,67 @@ static constexpr std::string_view TerrainFrag = R"(
     in vec3 fragment_color;
     //in vec2 tex_coord;
 
-    uniform vec3 light_color;
-    uniform vec3 light_pos;
+    layout (std140) uniform Frame {
+        mat4 projection;
+        mat4 view;
+        vec4 view_position;
+        vec4 light_position;
+        vec4 light_color;
+    };
     //uniform sampler2D t_texture;
 
+    // Bit per terrain sample, see Viewshed
+    uniform usampler2D viewshed;
+    uniform int viewshed_enabled;
+    uniform vec2 viewshed_origin;
+
+    // Ambient and sun visibility per terrain sample, see BakedLighting. While
+    // enabled the terrain is lit by the sun it was baked for.
+    uniform sampler2D baked_lighting;
+    uniform int baked_lighting_enabled;
+    uniform vec2 baked_lighting_origin;
+    uniform vec3 sun_direction;
+
+    // Samples outside the mask are neither highlighted nor darkened
+    vec3 apply_viewshed(vec3 lit)
+    {
+        ivec2 sample_pos = ivec2(floor(fragment_pos.xz - viewshed_origin + 0.5));
+        ivec2 words = textureSize(viewshed, 0);
+        if(sample_pos.x < 0 || sample_pos.y < 0 || sample_pos.x >= words.x * 32 || sample_pos.y >= words.y) {
+            return lit;
+        }
+
+        uint word = texelFetch(viewshed, ivec2(sample_pos.x / 32, sample_pos.y), 0).r;
+        bool visible = ((word >> uint(sample_pos.x % 32)) & 1u) != 0u;
+        return visible ? mix(lit, vec3(1.0, 0.85, 0.2), 0.35) : lit * 0.35;
+    }
+
     void main()
     {
+        vec3 light_dir = normalize(light_position.xyz - fragment_pos);
+        float sky = 1.0;
+        float sun = 1.0;
+        if(baked_lighting_enabled != 0) {
+            vec2 uv = (fragment_pos.xz - baked_lighting_origin + 0.5) / vec2(textureSize(baked_lighting, 0));
+            vec2 baked = texture(baked_lighting, uv).rg;
+            sky = baked.r;
+            sun = baked.g;
+            light_dir = normalize(sun_direction);
+        }
+
         // Ambient lighting
         float ambient_strength = 0.25;
-        vec3 ambient = ambient_strength * light_color;
+        vec3 ambient = ambient_strength * sky * light_color.rgb;
 
         // diffuse 
         vec3 norm = normalize(surface_normal);
-        vec3 light_dir = normalize(light_pos - fragment_pos);
         float diff = max(dot(norm, light_dir), 0.0);
-        vec3 diffuse = diff * light_color;
+        vec3 diffuse = diff * sun * light_color.rgb;
             
         vec3 result = (ambient + diffuse) * fragment_color;// * texture(t_texture, tex_coord).xyz;
+        if(viewshed_enabled != 0) {
+            result = apply_viewshed(result);
+        }
         color = vec4(result, 1.0f);
     }
 )";
\ No newline at end of file
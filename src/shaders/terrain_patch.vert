@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string_view>
+
+static constexpr std::string_view TerrainPatchVert = R"(
+    // Instanced terrain patch vertex shader. Every instance is one chunk that
+    // shares the patch grid and reads its heights from one array layer.
+
+    #version 330 core
+    layout (location = 0) in vec2 a_local;
+    layout (location = 1) in vec4 a_placement; // chunk origin x/z, layer, lod
+    layout (location = 2) in vec4 a_edge_lods; // lod towards -x, +x, -z, +z
+
+    out vec3 fragment_pos;
+    out vec3 surface_normal;
+    out vec3 fragment_color;
+
+    uniform mat4 model;
+    uniform float height_scale;
+    uniform sampler2DArray heights;
+
+    layout (std140) uniform Frame {
+        mat4 projection;
+        mat4 view;
+        vec4 view_position;
+        vec4 light_position;
+        vec4 light_color;
+    };
+
+    const float WATER_LEVEL = 0.35;
+
+    const float palette_heights[8] = float[8](0.3, 0.4, 0.45, 0.55, 0.6, 0.7, 0.9, 1.0);
+    const vec3 palette_colors[8] = vec3[8](
+        vec3(0.12, 0.29, 0.72),
+        vec3(0.13, 0.30, 0.76),
+        vec3(0.77, 0.80, 0.28),
+        vec3(0.20, 0.55, 0.0),
+        vec3(0.14, 0.36, 0.0),
+        vec3(0.30, 0.20, 0.17),
+        vec3(0.23, 0.18, 0.16),
+        vec3(1.0, 1.0, 1.0)
+    );
+
+    // Layers carry a one sample apron so normals at patch borders can see
+    // their neighbours
+    float raw_height(ivec2 texel) {
+        return texelFetch(heights, ivec3(texel + 1, int(a_placement.z)), 0).r;
+    }
+
+    float height(ivec2 texel) {
+        return max(raw_height(texel), WATER_LEVEL) * height_scale;
+    }
+
+    void main()
+    {
+        float patch_size = float(textureSize(heights, 0).x - 3);
+
+        // Border vertices follow the coarser of the two patches sharing the
+        // border so that neighbouring LODs meet without cracks
+        float lod = a_placement.w;
+        if(a_local.x == 0.0) {
+            lod = max(lod, a_edge_lods.x);
+        } else if(a_local.x == patch_size) {
+            lod = max(lod, a_edge_lods.y);
+        }
+        if(a_local.y == 0.0) {
+            lod = max(lod, a_edge_lods.z);
+        } else if(a_local.y == patch_size) {
+            lod = max(lod, a_edge_lods.w);
+        }
+
+        // Collapse vertices onto the coarser grid, the triangles in between
+        // degenerate and are dropped before rasterization
+        float lod_step = exp2(lod);
+        vec2 local = floor(a_local / lod_step) * lod_step;
+        ivec2 texel = ivec2(local);
+
+        float center = raw_height(texel);
+        vec3 normal = vec3(
+            height(texel - ivec2(1, 0)) - height(texel + ivec2(1, 0)),
+            2.0,
+            height(texel - ivec2(0, 1)) - height(texel + ivec2(0, 1))
+        );
+
+        vec3 position = vec3(
+            a_placement.x + local.x,
+            max(center, WATER_LEVEL) * height_scale,
+            a_placement.y + local.y
+        );
+
+        vec3 color = vec3(1.0, 1.0, 1.0);
+        for(int index = 0; index < 8; index++) {
+            if(center <= palette_heights[index]) {
+                color = palette_colors[index];
+                break;
+            }
+        }
+
+        fragment_pos = vec3(model * vec4(position, 1.0));
+        surface_normal = mat3(transpose(inverse(model))) * normalize(normal);
+        fragment_color = color;
+
+        gl_Position = projection * view * model * vec4(position, 1.0f);
+    }
+)";
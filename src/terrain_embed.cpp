@@ -0,0 +1,213 @@
+#include "terrain_embed.h"
+
+#include <cmath>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "terrain_generator.hpp"
+
+namespace {
+    // Beyond this a tile's samples no longer fit an int
+    constexpr uint32_t MAX_LOD = 24;
+
+    // Keeps sample coordinates, centered and with the normals' apron, well
+    // within an int
+    constexpr uint32_t MAX_SIZE = 1u << 28;
+
+    thread_local std::string last_error;
+
+    GenerationSettings to_generation_settings(const TerrainSettings& settings) {
+        GenerationSettings generation;
+        generation.seed = settings.seed;
+        generation.scale = settings.scale;
+        generation.height_scale = settings.height_scale;
+        generation.octaves = settings.octaves;
+        generation.persistence = settings.persistence;
+        generation.lacunarity = settings.lacunarity;
+        generation.offset = glm::vec2(settings.offset_x, settings.offset_y);
+        generation.octave_epsilon = settings.octave_epsilon;
+        return generation;
+    }
+
+    TerrainRect whole(const uint32_t size) {
+        return TerrainRect {0, 0, size, size, 0};
+    }
+
+    // Empty if the tile fits the terrain
+    std::string check_rect(const uint32_t size, const TerrainRect& rect) {
+        if(size < 2 || size > MAX_SIZE) {
+            return "terrain size must be between 2 and " + std::to_string(MAX_SIZE);
+        }
+        if(rect.width < 2 || rect.depth < 2) {
+            return "tiles must be at least 2 samples a side";
+        }
+        if(rect.lod > MAX_LOD) {
+            return "lod must be at most " + std::to_string(MAX_LOD);
+        }
+
+        auto last_x = rect.x + (static_cast<uint64_t>(rect.width - 1) << rect.lod);
+        auto last_z = rect.z + (static_cast<uint64_t>(rect.depth - 1) << rect.lod);
+        if(last_x >= size || last_z >= size) {
+            return "tile reaches past the terrain";
+        }
+        return "";
+    }
+
+    template <typename T>
+    T* at(T* base, const size_t stride, const size_t vertex) {
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(base) + stride * vertex);
+    }
+
+    void generate(const GenerationSettings& settings, const uint32_t size, const TerrainRect& rect, const TerrainBuffers& buffers) {
+        thread_local std::vector<glm::vec2> octave_offsets;
+
+        auto spacing = 1 << rect.lod;
+        auto origin = glm::ivec2(
+            static_cast<int>(rect.x) - static_cast<int>(size / 2),
+            static_cast<int>(rect.z) - static_cast<int>(size / 2));
+
+        auto height_stride = buffers.height_stride ? buffers.height_stride : sizeof(float);
+        auto normal_stride = buffers.normal_stride ? buffers.normal_stride : 3 * sizeof(float);
+        auto color_stride = buffers.color_stride ? buffers.color_stride : 3 * sizeof(float);
+
+        if(buffers.heights && !buffers.normals && !buffers.colors) {
+            // Straight into the caller's buffer
+            TerrainGenerator::generate_level_heights(rect.width, rect.depth, origin, rect.lod, settings, buffers.heights, height_stride, octave_offsets);
+        } else if(buffers.heights || buffers.normals || buffers.colors) {
+            // Three rows of heights with a sample either side roll down the
+            // tile, so that the caller's buffers are only ever written
+            thread_local std::vector<float> rows;
+            auto row_size = static_cast<size_t>(rect.width) + 2;
+            rows.resize(row_size * 3);
+
+            auto row = [&](int z) {
+                return rows.data() + row_size * static_cast<size_t>((z + 3) % 3);
+            };
+            auto generate_row = [&](int z) {
+                auto row_origin = origin + glm::ivec2(-spacing, z * spacing);
+                TerrainGenerator::generate_level_heights(rect.width + 2, 1, row_origin, rect.lod, settings, row(z), sizeof(float), octave_offsets);
+            };
+
+            generate_row(-1);
+            generate_row(0);
+            for(auto z = 0; z < static_cast<int>(rect.depth); z++) {
+                generate_row(z + 1);
+
+                auto above = row(z - 1) + 1;
+                auto center = row(z) + 1;
+                auto below = row(z + 1) + 1;
+                for(auto x = 0; x < static_cast<int>(rect.width); x++) {
+                    auto vertex = static_cast<size_t>(z) * rect.width + static_cast<size_t>(x);
+                    if(buffers.heights) {
+                        *at(buffers.heights, height_stride, vertex) = center[x];
+                    }
+                    if(buffers.normals) {
+                        auto normal = glm::normalize(glm::vec3(
+                            (center[x - 1] - center[x + 1]) * settings.height_scale,
+                            2.0f * spacing,
+                            (above[x] - below[x]) * settings.height_scale));
+                        auto out = at(buffers.normals, normal_stride, vertex);
+                        out[0] = normal.x;
+                        out[1] = normal.y;
+                        out[2] = normal.z;
+                    }
+                    if(buffers.colors) {
+                        auto color = TerrainGenerator::get_palette_color(center[x]);
+                        auto out = at(buffers.colors, color_stride, vertex);
+                        out[0] = color.x;
+                        out[1] = color.y;
+                        out[2] = color.z;
+                    }
+                }
+            }
+        }
+
+        if(buffers.indices) {
+            auto out = buffers.indices;
+            for(auto z = 0u; z + 1 < rect.depth; z++) {
+                for(auto x = 0u; x + 1 < rect.width; x++) {
+                    auto vertex = buffers.base_vertex + z * rect.width + x;
+                    *out++ = vertex;
+                    *out++ = vertex + rect.width + 1;
+                    *out++ = vertex + 1;
+                    *out++ = vertex + rect.width + 1;
+                    *out++ = vertex;
+                    *out++ = vertex + rect.width;
+                }
+            }
+        }
+    }
+}
+
+extern "C" {
+
+int terrain_embed_version(void) {
+    return TERRAIN_EMBED_VERSION;
+}
+
+void terrain_default_settings(TerrainSettings *settings) {
+    GenerationSettings defaults;
+    *settings = TerrainSettings {
+        defaults.seed,
+        defaults.scale,
+        defaults.height_scale,
+        defaults.octaves,
+        defaults.persistence,
+        defaults.lacunarity,
+        defaults.offset.x,
+        defaults.offset.y,
+        defaults.octave_epsilon
+    };
+}
+
+size_t terrain_vertex_count(uint32_t size, const TerrainRect *rect) {
+    auto tile = rect ? *rect : whole(size);
+    return static_cast<size_t>(tile.width) * tile.depth;
+}
+
+size_t terrain_index_count(uint32_t size, const TerrainRect *rect) {
+    auto tile = rect ? *rect : whole(size);
+    if(tile.width < 2 || tile.depth < 2) {
+        return 0;
+    }
+    return static_cast<size_t>(tile.width - 1) * (tile.depth - 1) * 6;
+}
+
+TerrainStatus terrain_generate(const TerrainSettings *settings, uint32_t size, const TerrainRect *rect, const TerrainBuffers *buffers) {
+    // Nothing may unwind into C
+    try {
+        if(!settings || !buffers) {
+            last_error = "settings and buffers are required";
+            return TERRAIN_INVALID_ARGUMENT;
+        }
+
+        auto tile = rect ? *rect : whole(size);
+        last_error = check_rect(size, tile);
+        if(!last_error.empty()) {
+            return TERRAIN_INVALID_ARGUMENT;
+        }
+
+        auto generation = to_generation_settings(*settings);
+        last_error = TerrainGenerator::check_settings(generation);
+        if(!last_error.empty()) {
+            return TERRAIN_INVALID_ARGUMENT;
+        }
+
+        generate(generation, size, tile, *buffers);
+        return TERRAIN_OK;
+    } catch(const std::exception& e) {
+        last_error = e.what();
+    } catch(...) {
+        last_error = "unknown error";
+    }
+    return TERRAIN_INTERNAL_ERROR;
+}
+
+const char *terrain_last_error(void) {
+    return last_error.c_str();
+}
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+/*
+ * Terrain generation for engines embedding it, callable from C and C++.
+ *
+ * The caller owns every buffer: heights, normals, colors and indices are
+ * written straight into the memory passed in, e.g. mapped GPU staging
+ * memory, with per vertex strides so that they can be attributes of one
+ * interleaved vertex buffer. Generation never reads those buffers back, so
+ * write combined memory is fine. Nothing is allocated per call besides a
+ * few rows of scratch per thread.
+ *
+ * A terrain is size x size samples one unit apart, centered on the noise
+ * origin. Every tile of it is normalized alike, so that tiles generated
+ * separately line up without seams, normals included. Calls are thread
+ * safe, and tiles may be generated on as many threads as the caller likes.
+ *
+ * Structs may only grow at the end, with TERRAIN_EMBED_VERSION raised.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TERRAIN_EMBED_VERSION 1
+
+typedef enum TerrainStatus {
+    TERRAIN_OK = 0,
+    TERRAIN_INVALID_ARGUMENT = 1,
+    TERRAIN_INTERNAL_ERROR = 2
+} TerrainStatus;
+
+/* GenerationSettings, see terrain_generator.hpp */
+typedef struct TerrainSettings {
+    int32_t seed;
+    float scale;
+    float height_scale;
+    int32_t octaves;
+    float persistence;
+    float lacunarity;
+    float offset_x;
+    float offset_y;
+    float octave_epsilon;
+} TerrainSettings;
+
+/* A tile of the terrain: width x depth samples from sample (x, z), taking
+ * every 2^lod-th sample of the terrain */
+typedef struct TerrainRect {
+    uint32_t x;
+    uint32_t z;
+    uint32_t width;
+    uint32_t depth;
+    uint32_t lod;
+} TerrainRect;
+
+/* Vertex (x, z) of a tile is vertex z * width + x. Any buffer may be null.
+ * A stride of 0 means tightly packed. */
+typedef struct TerrainBuffers {
+    /* One float per vertex in [0, 1], height_scale is left to the caller */
+    float *heights;
+    size_t height_stride;
+
+    /* Three floats per vertex, unit length, with height_scale applied */
+    float *normals;
+    size_t normal_stride;
+
+    /* Three floats per vertex, the terrain mesh's palette */
+    float *colors;
+    size_t color_stride;
+
+    /* terrain_index_count() indices, two counter clockwise triangles per
+     * quad in row order, each offset by base_vertex */
+    uint32_t *indices;
+    uint32_t base_vertex;
+} TerrainBuffers;
+
+int terrain_embed_version(void);
+
+void terrain_default_settings(TerrainSettings *settings);
+
+/* Of a whole size x size terrain when rect is null */
+size_t terrain_vertex_count(uint32_t size, const TerrainRect *rect);
+size_t terrain_index_count(uint32_t size, const TerrainRect *rect);
+
+/* Generates the tile rect of a size x size terrain, or all of it when rect
+ * is null, into buffers. size is at most 2^28, and settings must pass the
+ * bounds the tile server applies: 1 to 16 octaves, a positive scale,
+ * persistence from 0 to 4 and lacunarity from 0.1 to 8. */
+TerrainStatus terrain_generate(
+    const TerrainSettings *settings,
+    uint32_t size,
+    const TerrainRect *rect,
+    const TerrainBuffers *buffers);
+
+/* Why the last terrain_generate() on this thread failed, empty after a
+ * success */
+const char *terrain_last_error(void);
+
+#ifdef __cplusplus
+}
+
+#include <stdexcept>
+#include <string>
+
+namespace TerrainEmbed {
+    // terrain_generate(), throwing std::runtime_error on failure
+    inline void generate(
+        const TerrainSettings& settings,
+        const uint32_t size,
+        const TerrainBuffers& buffers,
+        const TerrainRect* rect = nullptr)
+    {
+        if(terrain_generate(&settings, size, rect, &buffers) != TERRAIN_OK) {
+            throw std::runtime_error(std::string("Terrain generation failed: ") + terrain_last_error());
+        }
+    }
+}
+#endif
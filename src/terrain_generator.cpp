@@ -0,0 +1,519 @@
+#include "terrain_generator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "perlin.hpp"
+
+namespace {
+    // The fewest significant digits that read back as the same float, nine
+    // always do
+    std::string format_float(const double value) {
+        std::ostringstream text;
+        for(auto digits = 1; digits <= std::numeric_limits<float>::max_digits10; digits++) {
+            text.str("");
+            text.precision(digits);
+            text << value;
+            if(static_cast<float>(std::strtod(text.str().c_str(), nullptr)) == static_cast<float>(value)) {
+                break;
+            }
+        }
+        return text.str();
+    }
+
+    void generate_octave_offsets(const GenerationSettings& settings, std::vector<glm::vec2>& octave_offsets) {
+        std::mt19937 gen(settings.seed);
+        std::uniform_int_distribution<> dis(-100000, 100000);
+        octave_offsets.resize(settings.octaves);
+        for (int octave = 0; octave < settings.octaves; octave++) {
+            float offset_x = dis(gen) + settings.offset.x;
+            float offset_y = dis(gen) + settings.offset.y;
+            octave_offsets[octave] = glm::vec2(offset_x, offset_y);
+        }
+    }
+
+    // Which octaves a sample evaluates, and how much of each. Frequencies
+    // and amplitudes are tracked by the callers' loops, so weighing an
+    // octave is a compare and a clamp.
+    struct OctaveFilter {
+        // Noise lattice cells per sample at frequency 1
+        float cells_per_sample;
+        float min_amplitude;
+
+        float weight(const float frequency, const float amplitude) const {
+            if(std::fabs(amplitude) < min_amplitude) {
+                return 0.0f;
+            }
+            return std::clamp(2.0f - 2.0f * frequency * cells_per_sample, 0.0f, 1.0f);
+        }
+    };
+
+    OctaveFilter make_octave_filter(const GenerationSettings& settings, const float spacing) {
+        auto amplitudes = 0.0f;
+        auto amplitude = 1.0f;
+        for (int i = 0; i < settings.octaves; i++) {
+            amplitudes += std::fabs(amplitude);
+            amplitude *= settings.persistence;
+        }
+        return OctaveFilter { spacing / settings.scale, settings.octave_epsilon * amplitudes };
+    }
+
+    // Raw fBm value of the sample at (x, y) relative to the map center
+    inline float centered_noise(
+        const float x,
+        const float y,
+        const GenerationSettings& settings,
+        const std::vector<glm::vec2>& octave_offsets,
+        const OctaveFilter& filter)
+    {
+        float amplitude = 1.0f;
+        float frequency = 1.0f;
+        float noise_height = 0.0f;
+
+        for (int i = 0; i < settings.octaves; i++) {
+            auto weight = filter.weight(frequency, amplitude);
+            if (weight > 0.0f) {
+                float sample_x = x / settings.scale * frequency + octave_offsets[i].x;
+                float sample_y = y / settings.scale * frequency + octave_offsets[i].y;
+
+                float perlin_value = Perlin::noise (sample_x, sample_y, sample_x + sample_y);
+                noise_height += perlin_value * amplitude * weight;
+            }
+
+            amplitude *= settings.persistence;
+            frequency *= settings.lacunarity;
+        }
+
+        return noise_height;
+    }
+    // width x depth samples stride units apart from origin, normalized
+    // against the octaves' combined spread, row major and
+    // byte_stride bytes apart in heights. The outer three rings are weighed
+    // at edge_spacing, the rest at detail_spacing: a chunk's border vertices
+    // sit on the second ring and their normals read the first and third.
+    void generate_samples(
+        const unsigned int width,
+        const unsigned int depth,
+        const glm::ivec2 origin,
+        const int stride,
+        const GenerationSettings& settings,
+        float* heights,
+        const std::size_t byte_stride,
+        std::vector<glm::vec2>& octave_offsets,
+        const float detail_spacing,
+        const float edge_spacing)
+    {
+        generate_octave_offsets(settings, octave_offsets);
+        auto filter = make_octave_filter(settings, detail_spacing);
+        auto edge_filter = make_octave_filter(settings, edge_spacing);
+
+        // Perlin noise is signed and a single octave reaches about +-1, but
+        // octaves are close to independent, so their sum spreads with the
+        // root sum of squares of the amplitudes rather than the plain sum,
+        // which it nears less the more octaves count. Measured over
+        // persistence 0 to 2 and 1 to 16 octaves, 99.9% of samples stay
+        // within 0.87 of the root sum of squares and the largest within
+        // 1.25, so only those rare peaks are clamped. Culled octaves still
+        // count, so that every detail level is scaled alike.
+        auto squared_amplitudes = 0.0f;
+        auto amplitude = 1.0f;
+        for (int i = 0; i < settings.octaves; i++) {
+            squared_amplitudes += amplitude * amplitude;
+            amplitude *= settings.persistence;
+        }
+        auto normalization = std::sqrt(squared_amplitudes);
+
+        auto is_edge = [](int coordinate, unsigned int size) {
+            return coordinate < 3 || coordinate + 3 >= static_cast<int>(size);
+        };
+
+        auto out = reinterpret_cast<char*>(heights);
+        for (int z = 0; z < static_cast<int>(depth); z++) {
+            for (int x = 0; x < static_cast<int>(width); x++) {
+                float world_x = origin.x + x * stride;
+                float world_z = origin.y + z * stride;
+
+                auto& sample_filter = is_edge(x, width) || is_edge(z, depth) ? edge_filter : filter;
+                amplitude = 1.0f;
+                float frequency = 1.0f;
+                float noise_height = 0.0f;
+
+                for (int i = 0; i < settings.octaves; i++) {
+                    auto weight = sample_filter.weight(frequency, amplitude);
+                    if (weight > 0.0f) {
+                        float sample_x = world_x / settings.scale * frequency + octave_offsets[i].x;
+                        float sample_y = world_z / settings.scale * frequency + octave_offsets[i].y;
+
+                        float perlin_value = Perlin::noise (sample_x, sample_y, sample_x + sample_y);
+                        noise_height += perlin_value * amplitude * weight;
+                    }
+
+                    amplitude *= settings.persistence;
+                    frequency *= settings.lacunarity;
+                }
+
+                *reinterpret_cast<float*>(out) = std::clamp((noise_height / normalization + 1.0f) / 2.0f, 0.0f, 1.0f);
+                out += byte_stride;
+            }
+        }
+    }
+}
+
+bool SettingsField::accepts(const double value) const {
+    if(integer) {
+        return value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max() && std::trunc(value) == value;
+    }
+    return std::isfinite(value) && std::fabs(value) <= std::numeric_limits<float>::max();
+}
+
+std::string SettingsField::format(const double value) const {
+    if(integer) {
+        return std::to_string(static_cast<int>(value));
+    }
+
+    return format_float(value);
+}
+
+namespace TerrainGenerator {
+    const std::vector<SettingsField>& get_settings_fields() {
+        static const std::vector<SettingsField> fields = {
+            {"seed", true, [](const GenerationSettings& s) { return static_cast<double>(s.seed); }, [](GenerationSettings& s, double v) { s.seed = static_cast<int>(v); }},
+            {"scale", false, [](const GenerationSettings& s) { return static_cast<double>(s.scale); }, [](GenerationSettings& s, double v) { s.scale = static_cast<float>(v); }},
+            {"height_scale", false, [](const GenerationSettings& s) { return static_cast<double>(s.height_scale); }, [](GenerationSettings& s, double v) { s.height_scale = static_cast<float>(v); }},
+            {"octaves", true, [](const GenerationSettings& s) { return static_cast<double>(s.octaves); }, [](GenerationSettings& s, double v) { s.octaves = static_cast<int>(v); }},
+            {"persistence", false, [](const GenerationSettings& s) { return static_cast<double>(s.persistence); }, [](GenerationSettings& s, double v) { s.persistence = static_cast<float>(v); }},
+            {"lacunarity", false, [](const GenerationSettings& s) { return static_cast<double>(s.lacunarity); }, [](GenerationSettings& s, double v) { s.lacunarity = static_cast<float>(v); }},
+            {"offset_x", false, [](const GenerationSettings& s) { return static_cast<double>(s.offset.x); }, [](GenerationSettings& s, double v) { s.offset.x = static_cast<float>(v); }},
+            {"offset_y", false, [](const GenerationSettings& s) { return static_cast<double>(s.offset.y); }, [](GenerationSettings& s, double v) { s.offset.y = static_cast<float>(v); }},
+            {"octave_epsilon", false, [](const GenerationSettings& s) { return static_cast<double>(s.octave_epsilon); }, [](GenerationSettings& s, double v) { s.octave_epsilon = static_cast<float>(v); }},
+        };
+        return fields;
+    }
+
+    const SettingsField* find_settings_field(const std::string& name) {
+        for(auto& field : get_settings_fields()) {
+            if(name == field.name) {
+                return &field;
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::string check_settings(const GenerationSettings& settings) {
+        if(settings.octaves < 1 || settings.octaves > MAX_OCTAVES) {
+            return "octaves must be between 1 and " + std::to_string(MAX_OCTAVES);
+        }
+        if(!(settings.scale > 0.0f)) {
+            return "scale must be positive";
+        }
+        if(!(settings.persistence >= 0.0f && settings.persistence <= MAX_PERSISTENCE)) {
+            return "persistence must be between 0 and " + format_float(MAX_PERSISTENCE);
+        }
+        if(!(settings.lacunarity >= MIN_LACUNARITY && settings.lacunarity <= MAX_LACUNARITY)) {
+            return "lacunarity must be between " + format_float(MIN_LACUNARITY) + " and " + format_float(MAX_LACUNARITY);
+        }
+        return "";
+    }
+
+    float octave_weight(const GenerationSettings& settings, const int octave, const float spacing) {
+        auto filter = make_octave_filter(settings, spacing);
+        return filter.weight(std::pow(settings.lacunarity, octave), std::pow(settings.persistence, octave));
+    }
+
+    int count_octaves(const GenerationSettings& settings, const float spacing) {
+        auto count = 0;
+        for (int i = 0; i < settings.octaves; i++) {
+            count += octave_weight(settings, i, spacing) > 0.0f ? 1 : 0;
+        }
+        return count;
+    }
+
+    std::vector<float> generate_height_map(
+        const unsigned int grid_size,
+        const GenerationSettings& settings)
+    {
+        std::vector<float> noise_map;
+        std::vector<glm::vec2> octave_offsets;
+        generate_height_map(grid_size, settings, noise_map, octave_offsets);
+        return noise_map;
+    }
+
+    void generate_height_map(
+        const unsigned int grid_size,
+        const GenerationSettings& settings,
+        std::vector<float>& noise_map,
+        std::vector<glm::vec2>& octave_offsets)
+    {
+		noise_map.resize(grid_size * grid_size);
+
+        // Generate octave noise
+        generate_octave_offsets(settings, octave_offsets);
+        auto filter = make_octave_filter(settings, 1.0f);
+
+		float max_noise_height = std::numeric_limits<float>::min();
+		float min_noise_height = std::numeric_limits<float>::max();
+
+		float half_width = grid_size / 2.0f;
+		float half_height = grid_size / 2.0f;
+
+        auto index = 0;
+		for (int y = 0; y < grid_size; y++) {
+			for (int x = 0; x < grid_size; x++) {
+				float noise_height = centered_noise(x - half_width, y - half_height, settings, octave_offsets, filter);
+
+				if (noise_height > max_noise_height) {
+					max_noise_height = noise_height;
+				} else if (noise_height < min_noise_height) {
+					min_noise_height = noise_height;
+				}
+
+				noise_map[index] = noise_height;
+                index++;
+			}
+		}
+
+        auto inverse_lerp = [](float a, float b, float x) {
+            return (x - a) / (b - a);
+        };
+
+        index = 0;
+		for (int y = 0; y < grid_size; y++) {
+			for (int x = 0; x < grid_size; x++) {
+				noise_map[index] = inverse_lerp(min_noise_height, max_noise_height, noise_map[index]);
+                index++;
+			}
+		}
+    }
+
+
+    std::vector<float> generate_chunk_heights(
+        const unsigned int size,
+        const glm::ivec2 origin,
+        const GenerationSettings& settings,
+        const float detail_spacing)
+    {
+        std::vector<float> heights;
+        std::vector<glm::vec2> octave_offsets;
+        generate_chunk_heights(size, origin, settings, heights, octave_offsets, detail_spacing);
+        return heights;
+    }
+
+    void generate_chunk_heights(
+        const unsigned int size,
+        const glm::ivec2 origin,
+        const GenerationSettings& settings,
+        std::vector<float>& heights,
+        std::vector<glm::vec2>& octave_offsets,
+        const float detail_spacing)
+    {
+        heights.resize(static_cast<std::size_t>(size) * size);
+        generate_samples(size, size, origin, 1, settings, heights.data(), sizeof(float), octave_offsets, detail_spacing, 1.0f);
+    }
+
+    void generate_level_heights(
+        const unsigned int width,
+        const unsigned int depth,
+        const glm::ivec2 origin,
+        const unsigned int level,
+        const GenerationSettings& settings,
+        std::vector<float>& heights,
+        std::vector<glm::vec2>& octave_offsets)
+    {
+        heights.resize(static_cast<std::size_t>(width) * depth);
+        generate_level_heights(width, depth, origin, level, settings, heights.data(), sizeof(float), octave_offsets);
+    }
+
+    void generate_level_heights(
+        const unsigned int width,
+        const unsigned int depth,
+        const glm::ivec2 origin,
+        const unsigned int level,
+        const GenerationSettings& settings,
+        float* heights,
+        const std::size_t byte_stride,
+        std::vector<glm::vec2>& octave_offsets)
+    {
+        auto spacing = 1 << level;
+        generate_samples(width, depth, origin, spacing, settings, heights, byte_stride, octave_offsets, static_cast<float>(spacing), static_cast<float>(spacing));
+    }
+
+    glm::vec3 get_palette_color(const float height) {
+        static const float bands[] = {0.3f, 0.4f, 0.45f, 0.55f, 0.6f, 0.7f, 0.9f, 1.0f};
+        static const glm::vec3 palette[] = {
+            glm::vec3(0.12f, 0.29f, 0.72f),
+            glm::vec3(0.13f, 0.30f, 0.76f),
+            glm::vec3(0.77f, 0.80f, 0.28f),
+            glm::vec3(0.20f, 0.55f, 0.0f),
+            glm::vec3(0.14f, 0.36f, 0.0f),
+            glm::vec3(0.30f, 0.20f, 0.17f),
+            glm::vec3(0.23f, 0.18f, 0.16f),
+            glm::vec3(1.0f, 1.0f, 1.0f),
+        };
+
+        for(auto band = 0u; band < std::size(bands); band++) {
+            if(height <= bands[band]) {
+                return palette[band];
+            }
+        }
+        return palette[std::size(palette) - 1];
+    }
+}
+
+ProgressiveHeightMap::ProgressiveHeightMap(const unsigned int grid_size)
+    : m_grid_size(grid_size),
+      m_preview_step(MIN_PREVIEW_STEP),
+      m_settings(),
+      m_noise(grid_size * grid_size),
+      m_heights(grid_size * grid_size),
+      m_lattice_heights(),
+      m_octave_offsets(),
+      m_step(1),
+      m_published_step(1),
+      m_row(0),
+      m_min_noise(0.0f),
+      m_max_noise(0.0f)
+{
+    while(m_grid_size / m_preview_step > MAX_PREVIEW_SAMPLES) {
+        m_preview_step *= 2;
+    }
+}
+
+void ProgressiveHeightMap::restart(const GenerationSettings& settings) {
+    m_settings = settings;
+    generate_octave_offsets(m_settings, m_octave_offsets);
+
+    m_step = m_preview_step;
+    m_published_step = 0;
+    m_row = 0;
+    m_min_noise = std::numeric_limits<float>::max();
+    m_max_noise = std::numeric_limits<float>::lowest();
+
+    // The preview is needed this frame whatever it costs
+    advance(std::numeric_limits<double>::infinity(), 1);
+}
+
+void ProgressiveHeightMap::cancel() {
+    m_step = 1;
+    m_published_step = 1;
+}
+
+bool ProgressiveHeightMap::refine(const double budget_ms) {
+    return advance(budget_ms, std::numeric_limits<unsigned int>::max());
+}
+
+bool ProgressiveHeightMap::advance(const double budget_ms, unsigned int max_levels) {
+    if(is_complete()) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto over_budget = [&]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budget_ms;
+    };
+
+    auto half_size = m_grid_size / 2.0f;
+    auto filter = make_octave_filter(m_settings, 1.0f);
+    auto published = false;
+
+    while(!is_complete()) {
+        // The samples of this level that no coarser level has computed
+        for(; m_row < m_grid_size; m_row++) {
+            if(!on_lattice(m_row, m_step)) {
+                continue;
+            }
+
+            auto row_done_before = m_step < m_preview_step && on_lattice(m_row, m_step * 2);
+            for(auto x = 0u; x < m_grid_size; x++) {
+                if(!on_lattice(x, m_step) || (row_done_before && on_lattice(x, m_step * 2))) {
+                    continue;
+                }
+
+                auto noise = centered_noise(x - half_size, m_row - half_size, m_settings, m_octave_offsets, filter);
+                m_noise[m_row * m_grid_size + x] = noise;
+                m_min_noise = std::min(m_min_noise, noise);
+                m_max_noise = std::max(m_max_noise, noise);
+            }
+
+            if(over_budget()) {
+                m_row++;
+                return published;
+            }
+        }
+
+        publish();
+        published = true;
+
+        m_step /= 2;
+        m_row = 0;
+
+        if(--max_levels == 0 || over_budget()) {
+            break;
+        }
+    }
+
+    return published;
+}
+
+bool ProgressiveHeightMap::is_complete() const {
+    return m_published_step == 1;
+}
+
+unsigned int ProgressiveHeightMap::get_step() const {
+    return m_published_step;
+}
+
+unsigned int ProgressiveHeightMap::get_lattice_side() const {
+    // A level with step 0 was never published
+    auto step = std::max(m_published_step, 1u);
+    return (m_grid_size - 1) / step + 1 + ((m_grid_size - 1) % step != 0 ? 1 : 0);
+}
+
+unsigned int ProgressiveHeightMap::get_lattice_coordinate(const unsigned int index) const {
+    return std::min(index * std::max(m_published_step, 1u), m_grid_size - 1);
+}
+
+const std::vector<float>& ProgressiveHeightMap::get_lattice_heights() const {
+    return m_published_step == 1 ? m_heights : m_lattice_heights;
+}
+
+const std::vector<float>& ProgressiveHeightMap::get_heights() const {
+    return m_heights;
+}
+
+bool ProgressiveHeightMap::on_lattice(const unsigned int coordinate, const unsigned int step) const {
+    // The last row and column belong to every level so that upsampling never
+    // has to extrapolate
+    return coordinate % step == 0 || coordinate == m_grid_size - 1;
+}
+
+void ProgressiveHeightMap::publish() {
+    auto range = m_max_noise - m_min_noise;
+    auto normalize = [&](float noise) {
+        return range > 0.0f ? (noise - m_min_noise) / range : 0.0f;
+    };
+
+    m_published_step = m_step;
+    if(m_step == 1) {
+        for(auto index = std::size_t{0}; index < m_heights.size(); index++) {
+            m_heights[index] = normalize(m_noise[index]);
+        }
+        return;
+    }
+
+    auto side = get_lattice_side();
+    m_lattice_heights.resize(static_cast<std::size_t>(side) * side);
+    for(auto row = 0u; row < side; row++) {
+        auto y = get_lattice_coordinate(row);
+        for(auto column = 0u; column < side; column++) {
+            auto x = get_lattice_coordinate(column);
+            m_lattice_heights[row * side + column] = normalize(m_noise[y * m_grid_size + x]);
+        }
+    }
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// Stages between GenerationSettings and a terrain mesh, as bit flags. Heights
+// feed every later stage and positions feed the normals, while the colors
+// only depend on the normalized heights.
+namespace GenerationStage {
+    constexpr unsigned int NONE = 0;
+    constexpr unsigned int HEIGHTS = 1u << 0;
+    constexpr unsigned int POSITIONS = 1u << 1;
+    constexpr unsigned int NORMALS = 1u << 2;
+    constexpr unsigned int COLORS = 1u << 3;
+    constexpr unsigned int ALL = HEIGHTS | POSITIONS | NORMALS | COLORS;
+}
+
+struct GenerationSettings {
+    int seed;
+    float scale; 
+    float height_scale;
+    int octaves;
+    float persistence; 
+    float lacunarity; 
+    glm::vec2 offset;
+
+    // Octaves quieter than this fraction of all octaves' amplitudes together
+    // are skipped, the default is the UNORM16 quantization step
+    float octave_epsilon;
+
+    // Defaults
+    GenerationSettings() 
+        : seed(0xDEADBEEF),
+          scale(25.0f),
+          height_scale(13.50f),
+          octaves(5),
+          persistence(0.5f),
+          lacunarity(2.5f),
+          offset{0.0f, 0.0f},
+          octave_epsilon(1.0f / 65536.0f)
+    {
+    }
+
+    // Stages that have to rerun to turn terrain generated with other into
+    // terrain generated with these settings
+    unsigned int invalidated_stages(const GenerationSettings& other) const {
+        const auto epsilon = 0.001f;
+        auto stages = GenerationStage::NONE;
+
+        if(seed != other.seed ||
+           fabs(scale - other.scale) >= epsilon ||
+           octaves != other.octaves ||
+           fabs(persistence - other.persistence) >= epsilon ||
+           fabs(lacunarity - other.lacunarity) >= epsilon ||
+           offset != other.offset ||
+           octave_epsilon != other.octave_epsilon) {
+            stages |= GenerationStage::ALL;
+        }
+
+        if(fabs(height_scale - other.height_scale) >= epsilon) {
+            stages |= GenerationStage::POSITIONS | GenerationStage::NORMALS;
+        }
+
+        return stages;
+    }
+
+    bool operator==(const GenerationSettings& other) {
+        return invalidated_stages(other) == GenerationStage::NONE;
+    }
+};
+
+// One GenerationSettings field by name, for scripts, URLs and sweeps.
+// Values pass through a double, which holds every int and float exactly.
+struct SettingsField {
+    const char *name;
+
+    // Integer fields only take whole values
+    bool integer;
+
+    double (*get)(const GenerationSettings&);
+
+    // value must be one the field accepts()
+    void (*set)(GenerationSettings&, double);
+
+    // False for values the field's type cannot hold: not finite, out of its
+    // range, or not whole for integer fields
+    bool accepts(const double value) const;
+
+    // Integers in full, floats with the fewest digits that read back as
+    // the same float
+    std::string format(const double value) const;
+};
+
+namespace TerrainGenerator {
+    // More octaves than this are beyond any detail a sample can show at
+    // the lacunarities allowed
+    constexpr int MAX_OCTAVES = 16;
+
+    // Persistence and lacunarity outside these drive the octaves' amplitudes
+    // or frequencies towards the limits of a float within MAX_OCTAVES
+    constexpr float MAX_PERSISTENCE = 4.0f;
+    constexpr float MIN_LACUNARITY = 0.1f;
+    constexpr float MAX_LACUNARITY = 8.0f;
+
+    // Every field, in declaration order
+    const std::vector<SettingsField>& get_settings_fields();
+
+    // Null for unknown names
+    const SettingsField* find_settings_field(const std::string& name);
+
+    // Why settings from outside the UI cannot be generated, empty if they
+    // can. Checks the octave count, a positive scale and the persistence
+    // and lacunarity bounds above.
+    std::string check_settings(const GenerationSettings& settings);
+
+    // Weight in [0, 1] of an octave when the heights are sampled spacing
+    // world units apart. Octaves fade out from half a noise lattice cell per
+    // sample and are skipped from a whole cell on, where they would only
+    // alias. Octaves below settings.octave_epsilon are skipped at any spacing.
+    float octave_weight(const GenerationSettings& settings, const int octave, const float spacing);
+
+    // Octaves evaluated per sample at that spacing
+    int count_octaves(const GenerationSettings& settings, const float spacing);
+
+    // Generates a grid_size x grid_size height map normalized to [0, 1] over
+    // its own minimum and maximum, centered on the noise origin. Samples are
+    // one unit apart, octaves are weighed at that spacing.
+    std::vector<float> generate_height_map(
+        const unsigned int grid_size,
+        const GenerationSettings& settings);
+
+    // As above, but writes into heights and keeps the per-octave offsets in
+    // octave_offsets. Neither allocates once the vectors have grown to the
+    // grid size and octave count.
+    void generate_height_map(
+        const unsigned int grid_size,
+        const GenerationSettings& settings,
+        std::vector<float>& heights,
+        std::vector<glm::vec2>& octave_offsets);
+
+    // Generates a size x size block of heights whose first sample sits at
+    // origin in world grid units. Heights are normalized against the spread
+    // the octaves' amplitudes give the noise rather than the block's own
+    // range, so neighbouring blocks line up without seams.
+    //
+    // Samples are one unit apart, but only the octaves that survive
+    // detail_spacing are evaluated, for blocks that are drawn at a coarser
+    // LOD. The outer three rings always get full detail, so that blocks of
+    // different detail still agree on the samples they share and on the
+    // normals of their border vertices.
+    std::vector<float> generate_chunk_heights(
+        const unsigned int size,
+        const glm::ivec2 origin,
+        const GenerationSettings& settings,
+        const float detail_spacing = 1.0f);
+
+    void generate_chunk_heights(
+        const unsigned int size,
+        const glm::ivec2 origin,
+        const GenerationSettings& settings,
+        std::vector<float>& heights,
+        std::vector<glm::vec2>& octave_offsets,
+        const float detail_spacing = 1.0f);
+
+    // Generates a width x depth block of mip level `level` directly from the
+    // noise: samples 2^level units apart from origin, with the octaves that
+    // spacing resolves, normalized like generate_chunk_heights(). A level
+    // costs 1/4^level of level 0 for the same area, and fewer octaves.
+    void generate_level_heights(
+        const unsigned int width,
+        const unsigned int depth,
+        const glm::ivec2 origin,
+        const unsigned int level,
+        const GenerationSettings& settings,
+        std::vector<float>& heights,
+        std::vector<glm::vec2>& octave_offsets);
+
+    // As above, but into memory the caller owns: sample (x, z) goes to the
+    // float byte_stride * (z * width + x) bytes past heights, so that it
+    // can be one attribute of an interleaved vertex buffer
+    void generate_level_heights(
+        const unsigned int width,
+        const unsigned int depth,
+        const glm::ivec2 origin,
+        const unsigned int level,
+        const GenerationSettings& settings,
+        float* heights,
+        const std::size_t byte_stride,
+        std::vector<glm::vec2>& octave_offsets);
+
+    // Color band of a normalized height, as the terrain mesh colors it
+    glm::vec3 get_palette_color(const float height);
+}
+
+// Evaluates a generate_height_map() map coarse to fine. restart() computes
+// every n-th sample in both directions, with n at least MIN_PREVIEW_STEP and
+// large enough to keep the preview within MAX_PREVIEW_SAMPLES per side.
+// refine() then computes the samples each finer level adds, halving the step
+// each time, and stops once its time budget is spent. Samples are never
+// computed twice. Each finished level is published as its lattice of
+// computed samples only, so publishing costs as much as the level's samples
+// rather than the full grid. The finished map is normalized over every
+// sample like generate_height_map(), but from a range tracked as levels
+// finish, so the two need not agree bit for bit.
+class ProgressiveHeightMap {
+public:
+    static constexpr unsigned int MIN_PREVIEW_STEP = 8;
+    static constexpr unsigned int MAX_PREVIEW_SAMPLES = 128;
+
+    explicit ProgressiveHeightMap(const unsigned int grid_size);
+
+    void restart(const GenerationSettings& settings);
+
+    // Drops the refinement in progress, e.g. when the terrain was regenerated
+    // in full by other means. Starts out cancelled.
+    void cancel();
+
+    // Returns true if a finer level was finished and get_heights() changed
+    bool refine(const double budget_ms);
+
+    bool is_complete() const;
+
+    // Sample spacing of the published level, 1 once complete
+    unsigned int get_step() const;
+
+    // Samples per side of the published level's lattice. Lattice sample i
+    // sits at grid coordinate get_lattice_coordinate(i), every step-th one
+    // plus the last row and column.
+    unsigned int get_lattice_side() const;
+    unsigned int get_lattice_coordinate(const unsigned int index) const;
+
+    // The published level's samples, get_lattice_side() squared and row
+    // major, normalized to [0, 1] over the samples computed so far
+    const std::vector<float>& get_lattice_heights() const;
+
+    // The full map, only valid once complete
+    const std::vector<float>& get_heights() const;
+
+private:
+    // Works through at most max_levels levels
+    bool advance(const double budget_ms, unsigned int max_levels);
+    bool on_lattice(const unsigned int coordinate, const unsigned int step) const;
+    void publish();
+
+    unsigned int m_grid_size;
+    unsigned int m_preview_step;
+    GenerationSettings m_settings;
+
+    std::vector<float> m_noise;
+    std::vector<float> m_heights;
+    std::vector<float> m_lattice_heights;
+    std::vector<glm::vec2> m_octave_offsets;
+
+    // Level being computed and the next row of it
+    unsigned int m_step;
+    unsigned int m_published_step;
+    unsigned int m_row;
+
+    float m_min_noise;
+    float m_max_noise;
+};
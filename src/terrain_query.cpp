@@ -0,0 +1,394 @@
+#include "terrain_query.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "job_system.hpp"
+
+namespace {
+    // Positions per job in the parallel batch, small batches are not worth a job
+    constexpr std::size_t POSITIONS_PER_JOB = 32 * 1024;
+
+    // A ray walks far more memory than a height lookup
+    constexpr std::size_t RAYS_PER_JOB = 256;
+
+    // The SSE2 path computes sample indices in floats, which are exact below this
+    constexpr std::size_t MAX_FLOAT_INDEX = 1u << 24;
+
+    // Written so that NaN clamps to 0 rather than reading anywhere undefined
+    inline float clamp_to(float value, float max) {
+        value = value > 0.0f ? value : 0.0f;
+        return value < max ? value : max;
+    }
+
+    float catmull_rom(float p0, float p1, float p2, float p3, float t) {
+        return p1 + 0.5f * t * (p2 - p0 + t * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 + t * (3.0f * (p1 - p2) + p3 - p0)));
+    }
+
+    // Runs work(first, count) over [0, count) in slices of per_job, the
+    // calling thread takes the first slice rather than idling in wait()
+    template <typename Work>
+    void parallel_slices(JobSystem& jobs, const std::size_t count, const std::size_t per_job, const Work& work) {
+        std::vector<JobHandle> slices;
+        for(auto first = per_job; first < count; first += per_job) {
+            auto slice_count = std::min(per_job, count - first);
+            slices.push_back(jobs.submit([&work, first, slice_count] {
+                work(first, slice_count);
+            }, JobPriority::IMMEDIATE));
+        }
+
+        work(std::size_t{0}, std::min(per_job, count));
+        for(auto& slice : slices) {
+            jobs.wait(slice);
+        }
+    }
+}
+
+TerrainQuery::TerrainQuery(
+    const unsigned int width,
+    const unsigned int depth,
+    const glm::vec2 origin,
+    std::vector<float>&& heights)
+    : m_width(width),
+      m_depth(depth),
+      m_origin(origin),
+      m_heights(std::move(heights)),
+      m_pyramid()
+{
+    if(width < 2 || depth < 2 || m_heights.size() != static_cast<std::size_t>(width) * depth) {
+        throw std::runtime_error("Terrain query needs at least 2x2 heights, got " + std::to_string(m_heights.size())
+            + " for " + std::to_string(width) + "x" + std::to_string(depth));
+    }
+
+    m_pyramid = HeightPyramid(width, depth, m_heights);
+}
+
+float TerrainQuery::get_height(const float x, const float z) const {
+    float height;
+    auto position = glm::vec2(x, z);
+    get_heights(&position, &height, 1);
+    return height;
+}
+
+float TerrainQuery::get_height_bicubic(const float x, const float z) const {
+    auto local_x = clamp_to(x - m_origin.x, m_width - 1.0f);
+    auto local_z = clamp_to(z - m_origin.y, m_depth - 1.0f);
+    auto cell_x = static_cast<int>(local_x);
+    auto cell_z = static_cast<int>(local_z);
+    auto fx = local_x - cell_x;
+    auto fz = local_z - cell_z;
+
+    float rows[4];
+    for(auto row = 0; row < 4; row++) {
+        auto sample_z = cell_z + row - 1;
+        rows[row] = catmull_rom(
+            sample(cell_x - 1, sample_z),
+            sample(cell_x, sample_z),
+            sample(cell_x + 1, sample_z),
+            sample(cell_x + 2, sample_z),
+            fx);
+    }
+
+    return catmull_rom(rows[0], rows[1], rows[2], rows[3], fz);
+}
+
+glm::vec3 TerrainQuery::get_normal(const float x, const float z) const {
+    glm::vec3 normal;
+    auto position = glm::vec2(x, z);
+    get_normals(&position, &normal, 1);
+    return normal;
+}
+
+float TerrainQuery::get_slope(const float x, const float z) const {
+    return std::acos(std::clamp(get_normal(x, z).y, -1.0f, 1.0f));
+}
+
+void TerrainQuery::get_heights(const std::vector<glm::vec2>& positions, std::vector<float>& out) const {
+    out.resize(positions.size());
+    get_heights(positions.data(), out.data(), positions.size());
+}
+
+void TerrainQuery::get_normals(const std::vector<glm::vec2>& positions, std::vector<glm::vec3>& out) const {
+    out.resize(positions.size());
+    get_normals(positions.data(), out.data(), positions.size());
+}
+
+void TerrainQuery::get_heights(const std::vector<glm::vec2>& positions, std::vector<float>& out, JobSystem& jobs) const {
+    out.resize(positions.size());
+    parallel_slices(jobs, positions.size(), POSITIONS_PER_JOB, [&](std::size_t first, std::size_t count) {
+        get_heights(positions.data() + first, out.data() + first, count);
+    });
+}
+
+TerrainHit TerrainQuery::intersect(const TerrainRay& ray) const {
+    // Zero components would turn the slab tests into 0 / 0
+    auto direction = ray.direction;
+    for(auto axis = 0; axis < 3; axis++) {
+        if(std::fabs(direction[axis]) < 1e-20f) {
+            direction[axis] = 1e-20f;
+        }
+    }
+    auto inverse = 1.0f / direction;
+
+    // Node levels count up from single cells, so pyramid level n is node
+    // level n + 1. Children are pushed far to near, so the nearest block is
+    // tested first and the first cell hit is the nearest hit. Every pop
+    // pushes at most four nodes, one level further down.
+    struct Node {
+        unsigned int level;
+        unsigned int x;
+        unsigned int z;
+    };
+    std::array<Node, 4 * 32> stack;
+    auto stack_size = 0u;
+    stack[stack_size++] = Node{m_pyramid.get_level_count(), 0, 0};
+
+    auto cells = glm::uvec2(m_width - 1, m_depth - 1);
+    auto near_x = direction.x < 0.0f ? 1u : 0u;
+    auto near_z = direction.z < 0.0f ? 1u : 0u;
+
+    while(stack_size > 0) {
+        auto node = stack[--stack_size];
+
+        auto top = 0.0f;
+        if(node.level > 0) {
+            top = m_pyramid.get_bounds(node.level - 1, node.x, node.z).y;
+        } else {
+            auto cell = m_heights.data() + static_cast<std::size_t>(node.z) * m_width + node.x;
+            top = std::max(std::max(cell[0], cell[1]), std::max(cell[m_width], cell[m_width + 1]));
+        }
+
+        // Solid below the surface, rays entering under it hit at once
+        auto low = glm::vec3(
+            m_origin.x + (node.x << node.level),
+            -std::numeric_limits<float>::infinity(),
+            m_origin.y + (node.z << node.level));
+        auto high = glm::vec3(
+            m_origin.x + std::min((node.x + 1) << node.level, cells.x),
+            top,
+            m_origin.y + std::min((node.z + 1) << node.level, cells.y));
+
+        auto to_low = (low - ray.origin) * inverse;
+        auto to_high = (high - ray.origin) * inverse;
+        auto entries = glm::min(to_low, to_high);
+        auto exits = glm::max(to_low, to_high);
+        auto enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+        auto exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, ray.max_distance));
+        if(enter > exit) {
+            continue;
+        }
+
+        if(node.level == 0) {
+            auto entry = ray.origin + ray.direction * enter;
+            auto distance = intersect_cell(node.x, node.z, entry, ray.direction, exit - enter);
+            if(distance >= 0.0f) {
+                distance += enter;
+                return TerrainHit{true, distance, ray.origin + ray.direction * distance};
+            }
+            continue;
+        }
+
+        auto children = node.level > 1 ? m_pyramid.get_level_size(node.level - 2) : cells;
+        for(auto order = 4; order-- > 0;) {
+            auto child_x = 2 * node.x + ((order & 1) ^ near_x);
+            auto child_z = 2 * node.z + ((order >> 1) ^ near_z);
+            if(child_x < children.x && child_z < children.y) {
+                stack[stack_size++] = Node{node.level - 1, child_x, child_z};
+            }
+        }
+    }
+
+    return TerrainHit{false, ray.max_distance, ray.origin + ray.direction * ray.max_distance};
+}
+
+void TerrainQuery::intersect(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits) const {
+    hits.resize(rays.size());
+    for(auto index = std::size_t{0}; index < rays.size(); index++) {
+        hits[index] = intersect(rays[index]);
+    }
+}
+
+void TerrainQuery::intersect(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, JobSystem& jobs) const {
+    hits.resize(rays.size());
+    parallel_slices(jobs, rays.size(), RAYS_PER_JOB, [&](std::size_t first, std::size_t count) {
+        for(auto index = first; index < first + count; index++) {
+            hits[index] = intersect(rays[index]);
+        }
+    });
+}
+
+const HeightPyramid& TerrainQuery::get_pyramid() const {
+    return m_pyramid;
+}
+
+const std::vector<float>& TerrainQuery::get_samples() const {
+    return m_heights;
+}
+
+unsigned int TerrainQuery::get_width() const {
+    return m_width;
+}
+
+unsigned int TerrainQuery::get_depth() const {
+    return m_depth;
+}
+
+glm::vec2 TerrainQuery::get_origin() const {
+    return m_origin;
+}
+
+void TerrainQuery::get_heights(const glm::vec2* positions, float* out, const std::size_t count) const {
+    auto index = std::size_t{0};
+    auto heights = m_heights.data();
+    auto width = m_width;
+
+#ifdef __SSE2__
+    if(m_heights.size() < MAX_FLOAT_INDEX) {
+        const auto zero = _mm_setzero_ps();
+        const auto origin_x = _mm_set1_ps(m_origin.x);
+        const auto origin_z = _mm_set1_ps(m_origin.y);
+        const auto max_x = _mm_set1_ps(m_width - 1.0f);
+        const auto max_z = _mm_set1_ps(m_depth - 1.0f);
+        const auto max_cell_x = _mm_set1_ps(m_width - 2.0f);
+        const auto max_cell_z = _mm_set1_ps(m_depth - 2.0f);
+        const auto row = _mm_set1_ps(static_cast<float>(m_width));
+
+        alignas(16) int32_t cells[4];
+        for(; index + 4 <= count; index += 4) {
+            // Two (x, z) pairs per load, then split into x and z lanes
+            auto first = _mm_loadu_ps(&positions[index].x);
+            auto second = _mm_loadu_ps(&positions[index + 2].x);
+            auto xs = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+            auto zs = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+
+            // max_ps returns its second operand for NaN, so NaN clamps to 0
+            auto local_x = _mm_min_ps(_mm_max_ps(_mm_sub_ps(xs, origin_x), zero), max_x);
+            auto local_z = _mm_min_ps(_mm_max_ps(_mm_sub_ps(zs, origin_z), zero), max_z);
+            auto cell_x = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(local_x)), max_cell_x);
+            auto cell_z = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(local_z)), max_cell_z);
+            auto fx = _mm_sub_ps(local_x, cell_x);
+            auto fz = _mm_sub_ps(local_z, cell_z);
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(cells), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cell_z, row), cell_x)));
+
+            // SSE2 has no gather
+            auto h00 = _mm_setr_ps(heights[cells[0]], heights[cells[1]], heights[cells[2]], heights[cells[3]]);
+            auto h10 = _mm_setr_ps(heights[cells[0] + 1], heights[cells[1] + 1], heights[cells[2] + 1], heights[cells[3] + 1]);
+            auto h01 = _mm_setr_ps(heights[cells[0] + width], heights[cells[1] + width], heights[cells[2] + width], heights[cells[3] + width]);
+            auto h11 = _mm_setr_ps(heights[cells[0] + width + 1], heights[cells[1] + width + 1], heights[cells[2] + width + 1], heights[cells[3] + width + 1]);
+
+            auto near = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fx));
+            auto far = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), fx));
+            _mm_storeu_ps(out + index, _mm_add_ps(near, _mm_mul_ps(_mm_sub_ps(far, near), fz)));
+        }
+    }
+#endif
+
+    for(; index < count; index++) {
+        auto local_x = clamp_to(positions[index].x - m_origin.x, m_width - 1.0f);
+        auto local_z = clamp_to(positions[index].y - m_origin.y, m_depth - 1.0f);
+        auto cell_x = std::min(static_cast<unsigned int>(local_x), m_width - 2);
+        auto cell_z = std::min(static_cast<unsigned int>(local_z), m_depth - 2);
+        auto fx = local_x - cell_x;
+        auto fz = local_z - cell_z;
+
+        auto cell = heights + static_cast<std::size_t>(cell_z) * width + cell_x;
+        auto near = cell[0] + (cell[1] - cell[0]) * fx;
+        auto far = cell[width] + (cell[width + 1] - cell[width]) * fx;
+        out[index] = near + (far - near) * fz;
+    }
+}
+
+void TerrainQuery::get_normals(const glm::vec2* positions, glm::vec3* out, const std::size_t count) const {
+    auto heights = m_heights.data();
+    auto width = m_width;
+
+    for(auto index = std::size_t{0}; index < count; index++) {
+        auto local_x = clamp_to(positions[index].x - m_origin.x, m_width - 1.0f);
+        auto local_z = clamp_to(positions[index].y - m_origin.y, m_depth - 1.0f);
+        auto cell_x = std::min(static_cast<unsigned int>(local_x), m_width - 2);
+        auto cell_z = std::min(static_cast<unsigned int>(local_z), m_depth - 2);
+        auto fx = local_x - cell_x;
+        auto fz = local_z - cell_z;
+
+        // Partial derivatives of the bilinear patch, samples are 1 apart
+        auto cell = heights + static_cast<std::size_t>(cell_z) * width + cell_x;
+        auto slope_x = (cell[1] - cell[0]) + ((cell[width + 1] - cell[width]) - (cell[1] - cell[0])) * fz;
+        auto slope_z = (cell[width] - cell[0]) + ((cell[width + 1] - cell[1]) - (cell[width] - cell[0])) * fx;
+        out[index] = glm::normalize(glm::vec3(-slope_x, 1.0f, -slope_z));
+    }
+}
+
+float TerrainQuery::sample(const int x, const int z) const {
+    auto clamped_x = std::clamp(x, 0, static_cast<int>(m_width) - 1);
+    auto clamped_z = std::clamp(z, 0, static_cast<int>(m_depth) - 1);
+    return m_heights[static_cast<std::size_t>(clamped_z) * m_width + clamped_x];
+}
+
+float TerrainQuery::intersect_cell(
+    const unsigned int x,
+    const unsigned int z,
+    const glm::vec3& entry,
+    const glm::vec3& direction,
+    const float length) const
+{
+    // The surface over the cell is h = a + b * u + c * v + d * u * v for
+    // u, v in [0, 1], so along the ray its height above the ray is a
+    // quadratic in the distance. Doubles keep grazing rays from slipping
+    // through between the roots.
+    auto cell = m_heights.data() + static_cast<std::size_t>(z) * m_width + x;
+    auto a = static_cast<double>(cell[0]);
+    auto b = static_cast<double>(cell[1]) - cell[0];
+    auto c = static_cast<double>(cell[m_width]) - cell[0];
+    auto d = static_cast<double>(cell[m_width + 1]) - cell[m_width] - cell[1] + cell[0];
+
+    auto u = static_cast<double>(entry.x) - (m_origin.x + x);
+    auto v = static_cast<double>(entry.z) - (m_origin.y + z);
+    auto du = static_cast<double>(direction.x);
+    auto dv = static_cast<double>(direction.z);
+
+    // At or below the surface where the ray enters the cell
+    auto constant = a + b * u + c * v + d * u * v - entry.y;
+    if(constant >= 0.0) {
+        return 0.0f;
+    }
+
+    auto linear = b * du + c * dv + d * (u * dv + v * du) - direction.y;
+    auto quadratic = d * du * dv;
+
+    auto first = -1.0;
+    auto second = -1.0;
+    if(quadratic == 0.0) {
+        if(linear != 0.0) {
+            first = -constant / linear;
+        }
+    } else {
+        auto discriminant = linear * linear - 4.0 * quadratic * constant;
+        if(discriminant < 0.0) {
+            return -1.0f;
+        }
+
+        // Without the cancellation of the textbook formula
+        auto q = -0.5 * (linear + std::copysign(std::sqrt(discriminant), linear));
+        first = q / quadratic;
+        second = q != 0.0 ? constant / q : first;
+        if(first > second) {
+            std::swap(first, second);
+        }
+    }
+
+    for(auto root : {first, second}) {
+        if(root >= 0.0 && root <= length) {
+            return static_cast<float>(root);
+        }
+    }
+    return -1.0f;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "height_pyramid.hpp"
+
+class JobSystem;
+
+struct TerrainRay {
+    glm::vec3 origin;
+    // Need not be normalized, distances are in multiples of its length
+    glm::vec3 direction;
+    float max_distance;
+};
+
+struct TerrainHit {
+    bool hit;
+    // origin + direction * distance is the point hit
+    float distance;
+    glm::vec3 position;
+};
+
+// Read-only view of the drawn terrain surface for gameplay code, e.g. ground
+// following or agents walking the terrain. Heights are world space and one
+// sample apart; positions outside the sampled area are clamped to its edge.
+//
+// A query never changes after construction. The Scene publishes a new one
+// after every regeneration, so readers on other threads keep using the one
+// they hold while the terrain is regenerated.
+class TerrainQuery {
+public:
+    // heights[z * width + x] is the height at world (origin.x + x, origin.y + z)
+    TerrainQuery(
+        const unsigned int width,
+        const unsigned int depth,
+        const glm::vec2 origin,
+        std::vector<float>&& heights);
+
+    float get_height(const float x, const float z) const;
+
+    // Catmull-Rom through the 4x4 nearest samples, smoother than
+    // get_height() but four times the memory reads
+    float get_height_bicubic(const float x, const float z) const;
+
+    // Of the bilinear surface get_height() samples
+    glm::vec3 get_normal(const float x, const float z) const;
+
+    // Angle between the surface and the horizontal, in radians
+    float get_slope(const float x, const float z) const;
+
+    // Batched get_height() and get_normal() for (x, z) positions, heights
+    // four at a time with SSE2. out is resized to the number of positions.
+    void get_heights(const std::vector<glm::vec2>& positions, std::vector<float>& out) const;
+    void get_normals(const std::vector<glm::vec2>& positions, std::vector<glm::vec3>& out) const;
+
+    // As above, split over the job system's workers and the calling thread
+    void get_heights(const std::vector<glm::vec2>& positions, std::vector<float>& out, JobSystem& jobs) const;
+
+    // First point where the ray meets the bilinear surface get_height()
+    // samples, within the sampled area. The terrain is solid below its
+    // surface, so a ray starting beneath it or entering the sampled area
+    // from the side below the surface hits where it does. The ray descends the min-max
+    // pyramid front to back and only tests the cells whose bounds it
+    // passes through, so a miss over a flat stretch costs a few blocks
+    // rather than every cell under the ray.
+    TerrainHit intersect(const TerrainRay& ray) const;
+
+    // Batched intersect(), hits is resized to the number of rays
+    void intersect(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits) const;
+    void intersect(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, JobSystem& jobs) const;
+
+    const HeightPyramid& get_pyramid() const;
+
+    // The heights as passed to the constructor
+    const std::vector<float>& get_samples() const;
+
+    // Sample layout and extent, in world units
+    unsigned int get_width() const;
+    unsigned int get_depth() const;
+    glm::vec2 get_origin() const;
+
+private:
+    void get_heights(const glm::vec2* positions, float* out, const std::size_t count) const;
+    void get_normals(const glm::vec2* positions, glm::vec3* out, const std::size_t count) const;
+
+    float sample(const int x, const int z) const;
+
+    // Where the ray, starting at entry within cell (x, z), first meets the
+    // cell's surface before length. Returns a negative value for a miss.
+    float intersect_cell(const unsigned int x, const unsigned int z, const glm::vec3& entry, const glm::vec3& direction, const float length) const;
+
+    unsigned int m_width;
+    unsigned int m_depth;
+    glm::vec2 m_origin;
+    std::vector<float> m_heights;
+    HeightPyramid m_pyramid;
+};
@@ -0,0 +1,181 @@
+#include "tile_cache.hpp"
+
+#include <chrono>
+
+#include "height_codec.hpp"
+
+namespace {
+    uint64_t fnv1a(uint64_t hash, const void* data, std::size_t size) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for(auto index = std::size_t{0}; index < size; index++) {
+            hash ^= bytes[index];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    template <typename Value>
+    uint64_t fnv1a(uint64_t hash, const Value& value) {
+        return fnv1a(hash, &value, sizeof(value));
+    }
+
+    double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+bool TileKey::operator==(const TileKey& other) const {
+    return seed == other.seed
+        && scale == other.scale
+        && octaves == other.octaves
+        && persistence == other.persistence
+        && lacunarity == other.lacunarity
+        && offset == other.offset
+        && octave_epsilon == other.octave_epsilon
+        && origin == other.origin
+        && size == other.size
+        && format == other.format
+        && detail_spacing == other.detail_spacing
+        && sample_spacing == other.sample_spacing;
+}
+
+std::size_t TileKeyHash::operator()(const TileKey& key) const {
+    // Adding 0 turns -0 into 0, which compares equal and so must hash alike
+    auto hash = 0xcbf29ce484222325ull;
+    hash = fnv1a(hash, key.seed);
+    hash = fnv1a(hash, key.scale + 0.0f);
+    hash = fnv1a(hash, key.octaves);
+    hash = fnv1a(hash, key.persistence + 0.0f);
+    hash = fnv1a(hash, key.lacunarity + 0.0f);
+    hash = fnv1a(hash, key.offset.x + 0.0f);
+    hash = fnv1a(hash, key.offset.y + 0.0f);
+    hash = fnv1a(hash, key.octave_epsilon + 0.0f);
+    hash = fnv1a(hash, key.origin.x);
+    hash = fnv1a(hash, key.origin.y);
+    hash = fnv1a(hash, key.size);
+    hash = fnv1a(hash, key.format);
+    hash = fnv1a(hash, key.detail_spacing + 0.0f);
+    hash = fnv1a(hash, key.sample_spacing);
+    return static_cast<std::size_t>(hash);
+}
+
+TileCache::TileCache(std::size_t budget_bytes)
+    : m_mutex(),
+      m_budget_bytes(budget_bytes),
+      m_entries(),
+      m_recency(),
+      m_stats{0, 0, 0, 0, 0, 0, 0.0, 0.0}
+{
+}
+
+TileKey TileCache::make_key(
+    const GenerationSettings& settings,
+    const glm::ivec2 origin,
+    const unsigned int size,
+    const HeightFormat format,
+    const float detail_spacing,
+    const unsigned int sample_spacing)
+{
+    return TileKey {
+        settings.seed,
+        settings.scale,
+        settings.octaves,
+        settings.persistence,
+        settings.lacunarity,
+        settings.offset,
+        settings.octave_epsilon,
+        origin,
+        size,
+        format,
+        detail_spacing,
+        sample_spacing
+    };
+}
+
+bool TileCache::find(const TileKey& key, HeightField& field) {
+    std::shared_ptr<const Tile> tile;
+    {
+        std::lock_guard lock(m_mutex);
+        auto entry = m_entries.find(key);
+        if(entry == m_entries.end()) {
+            m_stats.misses++;
+            return false;
+        }
+
+        m_recency.splice(m_recency.begin(), m_recency, entry->second.recency);
+        tile = entry->second.tile;
+        m_stats.hits++;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    HeightCodec::decompress(*tile, field);
+    auto ms = elapsed_ms(start);
+
+    std::lock_guard lock(m_mutex);
+    m_stats.decompress_ms += ms;
+    return true;
+}
+
+void TileCache::insert(const TileKey& key, const HeightField& field) {
+    auto start = std::chrono::steady_clock::now();
+    auto tile = std::make_shared<Tile>();
+    HeightCodec::compress(field, *tile);
+    tile->shrink_to_fit();
+    auto ms = elapsed_ms(start);
+
+    std::lock_guard lock(m_mutex);
+    m_stats.compress_ms += ms;
+
+    auto existing = m_entries.find(key);
+    if(existing != m_entries.end()) {
+        erase(existing);
+    }
+
+    m_recency.push_front(key);
+    m_entries.emplace(key, Entry{std::move(tile), field.get_byte_size(), m_recency.begin()});
+    m_stats.compressed_bytes += m_entries.at(key).tile->size();
+    m_stats.raw_bytes += field.get_byte_size();
+    m_stats.entries = m_entries.size();
+
+    evict();
+}
+
+void TileCache::clear() {
+    std::lock_guard lock(m_mutex);
+    m_entries.clear();
+    m_recency.clear();
+    m_stats.entries = 0;
+    m_stats.compressed_bytes = 0;
+    m_stats.raw_bytes = 0;
+}
+
+void TileCache::set_budget(std::size_t budget_bytes) {
+    std::lock_guard lock(m_mutex);
+    m_budget_bytes = budget_bytes;
+    evict();
+}
+
+std::size_t TileCache::get_budget() const {
+    std::lock_guard lock(m_mutex);
+    return m_budget_bytes;
+}
+
+TileCacheStats TileCache::get_stats() const {
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
+
+void TileCache::erase(Entries::iterator entry) {
+    m_stats.compressed_bytes -= entry->second.tile->size();
+    m_stats.raw_bytes -= entry->second.raw_bytes;
+    m_recency.erase(entry->second.recency);
+    m_entries.erase(entry);
+    m_stats.entries = m_entries.size();
+}
+
+void TileCache::evict() {
+    while(m_stats.compressed_bytes > m_budget_bytes && !m_recency.empty()) {
+        erase(m_entries.find(m_recency.back()));
+        m_stats.evictions++;
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "height_field.hpp"
+#include "terrain_generator.hpp"
+
+struct TileCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    std::size_t entries;
+
+    // Of the entries currently held
+    std::size_t compressed_bytes;
+    std::size_t raw_bytes;
+
+    double compress_ms;
+    double decompress_ms;
+};
+
+// Everything that determines a cached tile's samples. The height scale is
+// applied after the heights, so it is not part of a tile's identity.
+struct TileKey {
+    int seed;
+    float scale;
+    int octaves;
+    float persistence;
+    float lacunarity;
+    glm::vec2 offset;
+    float octave_epsilon;
+    glm::ivec2 origin;
+    unsigned int size;
+    HeightFormat format;
+    float detail_spacing;
+    unsigned int sample_spacing;
+
+    bool operator==(const TileKey& other) const;
+    bool operator!=(const TileKey& other) const { return !(*this == other); }
+};
+
+// FNV-1a over the fields, only for bucketing: entries compare whole keys
+struct TileKeyHash {
+    std::size_t operator()(const TileKey& key) const;
+};
+
+// Middle tier between the resident height fields and regenerating from
+// noise: height tiles compressed with HeightCodec, keyed by everything that
+// determines their samples. The least recently used tiles are evicted once
+// the compressed size exceeds the budget. Safe to use from several jobs at
+// once, compression and decompression run outside the lock.
+class TileCache {
+public:
+    explicit TileCache(std::size_t budget_bytes);
+
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+
+    // Identifies the tile generate_chunk_heights() produces for these
+    // arguments, in the given storage format. Tiles sampled sample_spacing
+    // units apart, as generate_level_heights() does, get keys of their own.
+    static TileKey make_key(
+        const GenerationSettings& settings,
+        const glm::ivec2 origin,
+        const unsigned int size,
+        const HeightFormat format,
+        const float detail_spacing = 1.0f,
+        const unsigned int sample_spacing = 1);
+
+    // Decompresses the tile into field and returns true if it is cached
+    bool find(const TileKey& key, HeightField& field);
+
+    void insert(const TileKey& key, const HeightField& field);
+
+    void clear();
+
+    void set_budget(std::size_t budget_bytes);
+    std::size_t get_budget() const;
+
+    TileCacheStats get_stats() const;
+
+private:
+    using Tile = std::vector<uint8_t>;
+
+    struct Entry {
+        std::shared_ptr<const Tile> tile;
+        std::size_t raw_bytes;
+        std::list<TileKey>::iterator recency;
+    };
+
+    using Entries = std::unordered_map<TileKey, Entry, TileKeyHash>;
+
+    // Callers hold m_mutex
+    void erase(Entries::iterator entry);
+    void evict();
+
+    mutable std::mutex m_mutex;
+    std::size_t m_budget_bytes;
+    Entries m_entries;
+
+    // Most recently used first
+    std::list<TileKey> m_recency;
+
+    TileCacheStats m_stats;
+};
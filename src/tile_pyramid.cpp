@@ -0,0 +1,116 @@
+#include "tile_pyramid.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+#include "job_system.hpp"
+
+namespace {
+    // Rows of a level generated per job
+    constexpr unsigned int ROWS_PER_JOB = 16;
+}
+
+TilePyramid::TilePyramid()
+    : m_origin(0, 0),
+      m_size(0),
+      m_format(HeightFormat::FLOAT32),
+      m_levels(),
+      m_generated(),
+      m_generation_ms()
+{
+}
+
+TilePyramid::TilePyramid(const glm::ivec2 origin, const unsigned int size, const unsigned int level_count, const HeightFormat format)
+    : m_origin(origin),
+      m_size(size),
+      m_format(format),
+      m_levels(level_count),
+      m_generated(level_count, false),
+      m_generation_ms(level_count, 0.0)
+{
+    if(level_count == 0 || size < 2 || (size - 1) % (1u << (level_count - 1)) != 0) {
+        throw std::runtime_error("Tile of " + std::to_string(size) + " samples cannot hold " + std::to_string(level_count) + " levels");
+    }
+}
+
+void TilePyramid::generate(const GenerationSettings& settings, JobSystem& jobs, const unsigned int first_level) {
+    std::vector<float> samples;
+    std::vector<JobHandle> bands;
+
+    // Coarsest first, the cheap levels are there to be looked at early
+    for(auto level = get_level_count(); level-- > first_level;) {
+        auto start = std::chrono::steady_clock::now();
+        auto size = get_level_size(level);
+        auto spacing = static_cast<int>(get_spacing(level));
+        samples.resize(static_cast<std::size_t>(size) * size);
+
+        bands.clear();
+        for(auto first_row = 0u; first_row < size; first_row += ROWS_PER_JOB) {
+            auto rows = std::min(ROWS_PER_JOB, size - first_row);
+            bands.push_back(jobs.submit([&, level, size, spacing, first_row, rows] {
+                thread_local std::vector<float> band;
+                thread_local std::vector<glm::vec2> octave_offsets;
+
+                auto origin = m_origin + glm::ivec2(0, static_cast<int>(first_row) * spacing);
+                TerrainGenerator::generate_level_heights(size, rows, origin, level, settings, band, octave_offsets);
+                std::copy(band.begin(), band.end(), samples.begin() + static_cast<std::size_t>(first_row) * size);
+            }, JobPriority::IMMEDIATE));
+        }
+
+        for(auto& band : bands) {
+            jobs.wait(band);
+        }
+
+        m_levels[level] = HeightField(size, size, m_format);
+        m_levels[level].encode(samples);
+        m_generated[level] = true;
+        m_generation_ms[level] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+bool TilePyramid::is_generated(const unsigned int level) const {
+    return level < m_generated.size() && m_generated[level];
+}
+
+const HeightField& TilePyramid::get_level(const unsigned int level) const {
+    if(!is_generated(level)) {
+        throw std::runtime_error("Tile pyramid level " + std::to_string(level) + " has not been generated");
+    }
+    return m_levels[level];
+}
+
+unsigned int TilePyramid::get_level_size(const unsigned int level) const {
+    return (m_size - 1) / get_spacing(level) + 1;
+}
+
+unsigned int TilePyramid::get_spacing(const unsigned int level) const {
+    return 1u << level;
+}
+
+unsigned int TilePyramid::get_level_count() const {
+    return static_cast<unsigned int>(m_levels.size());
+}
+
+glm::ivec2 TilePyramid::get_origin() const {
+    return m_origin;
+}
+
+unsigned int TilePyramid::get_size() const {
+    return m_size;
+}
+
+double TilePyramid::get_generation_ms(const unsigned int level) const {
+    return m_generation_ms[level];
+}
+
+std::size_t TilePyramid::get_byte_size() const {
+    auto bytes = std::size_t{0};
+    for(auto level = 0u; level < get_level_count(); level++) {
+        if(m_generated[level]) {
+            bytes += m_levels[level].get_byte_size();
+        }
+    }
+    return bytes;
+}
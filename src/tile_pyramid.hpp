@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "height_field.hpp"
+#include "terrain_generator.hpp"
+
+class JobSystem;
+
+// One square tile of terrain at a chain of resolutions, for LOD, minimaps
+// and far tiles. Level k holds (size - 1) / 2^k + 1 samples a side spaced 2^k
+// units apart over the same area as level 0. Every level is generated from
+// the noise at its own spacing rather than downsampled from the level below,
+// so a coarse level costs 1/4^k of the base level, and all levels are
+// normalized alike so that they can be swapped for each other.
+class TilePyramid {
+public:
+    TilePyramid();
+
+    // size - 1 must be a multiple of 2^(level_count - 1)
+    TilePyramid(const glm::ivec2 origin, const unsigned int size, const unsigned int level_count, const HeightFormat format);
+
+    // Generates levels first_level up to the coarsest, split into bands of
+    // rows over the job system. Levels below first_level are left empty,
+    // e.g. when only far tiles are wanted.
+    void generate(const GenerationSettings& settings, JobSystem& jobs, const unsigned int first_level = 0);
+
+    bool is_generated(const unsigned int level) const;
+
+    // Throws std::runtime_error if the level was not generated
+    const HeightField& get_level(const unsigned int level) const;
+
+    // Samples per side and world units between samples at level
+    unsigned int get_level_size(const unsigned int level) const;
+    unsigned int get_spacing(const unsigned int level) const;
+
+    unsigned int get_level_count() const;
+    glm::ivec2 get_origin() const;
+    unsigned int get_size() const;
+
+    // Milliseconds the last generate() spent on level
+    double get_generation_ms(const unsigned int level) const;
+
+    // Bytes held by the generated levels
+    std::size_t get_byte_size() const;
+
+private:
+    glm::ivec2 m_origin;
+    unsigned int m_size;
+    HeightFormat m_format;
+    std::vector<HeightField> m_levels;
+    std::vector<bool> m_generated;
+    std::vector<double> m_generation_ms;
+};
@@ -0,0 +1,639 @@
+#include "tile_server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "job_system.hpp"
+
+namespace {
+    // Rows of a tile generated per job
+    constexpr unsigned int ROWS_PER_JOB = 16;
+
+    // Apron of one sample on every side, for the normals
+    constexpr unsigned int APRON_SIZE = TileServer::TILE_SIZE + 3;
+
+    // How often the accept loop looks at the stop flag
+    constexpr int POLL_INTERVAL_MS = 200;
+
+    // Requests are a request line and a few headers
+    constexpr std::size_t MAX_REQUEST_BYTES = 8192;
+
+    // A client that stalls this long loses its connection
+    constexpr int CONNECTION_TIMEOUT_S = 10;
+
+    const char *LAYER_NAMES[] = {"height", "normal", "palette"};
+
+    // Answered with 400 rather than 500
+    struct BadRequest : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    int parse_int(const std::string& text) {
+        try {
+            std::size_t parsed = 0;
+            auto number = std::stoi(text, &parsed);
+            if(parsed == text.size()) {
+                return number;
+            }
+        } catch(const std::exception&) {
+        }
+        throw BadRequest("Invalid integer '" + text + "'");
+    }
+
+    // As a double, which holds seeds beyond a float's 24 bits exactly
+    double parse_number(const std::string& text) {
+        try {
+            std::size_t parsed = 0;
+            auto number = std::stod(text, &parsed);
+            if(parsed == text.size() && std::isfinite(number)) {
+                return number;
+            }
+        } catch(const std::exception&) {
+        }
+        throw BadRequest("Invalid number '" + text + "'");
+    }
+
+    std::vector<std::string> split(const std::string& text, const char separator) {
+        std::vector<std::string> parts;
+        auto begin = std::size_t{0};
+        while(true) {
+            auto end = text.find(separator, begin);
+            parts.push_back(text.substr(begin, end - begin));
+            if(end == std::string::npos) {
+                return parts;
+            }
+            begin = end + 1;
+        }
+    }
+
+    GenerationSettings parse_settings(const std::string& query) {
+        GenerationSettings settings;
+        if(query.empty()) {
+            return settings;
+        }
+
+        for(auto& parameter : split(query, '&')) {
+            auto separator = parameter.find('=');
+            if(separator == std::string::npos) {
+                throw BadRequest("Expected name=value, got '" + parameter + "'");
+            }
+            auto name = parameter.substr(0, separator);
+            auto field = TerrainGenerator::find_settings_field(name);
+            if(!field) {
+                throw BadRequest("Unknown setting '" + name + "'");
+            }
+            auto value = parse_number(parameter.substr(separator + 1));
+            if(!field->accepts(value)) {
+                throw BadRequest("Invalid " + name + " '" + parameter.substr(separator + 1) + "'");
+            }
+            field->set(settings, value);
+        }
+
+        auto error = TerrainGenerator::check_settings(settings);
+        if(!error.empty()) {
+            throw BadRequest(error);
+        }
+        return settings;
+    }
+
+    uint8_t to_unorm8(const float value) {
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    std::string to_ppm(const unsigned int size, const std::vector<glm::vec3>& colors) {
+        std::ostringstream out;
+        out << "P6\n" << size << " " << size << "\n255\n";
+        for(auto& color : colors) {
+            out.put(static_cast<char>(to_unorm8(color.x)));
+            out.put(static_cast<char>(to_unorm8(color.y)));
+            out.put(static_cast<char>(to_unorm8(color.z)));
+        }
+        return out.str();
+    }
+
+    TileResponse error_response(const int status, const std::string& message) {
+        return TileResponse {status, "text/plain", message + "\n", ""};
+    }
+
+    const char *reason_phrase(const int status) {
+        switch(status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            default: return "Internal Server Error";
+        }
+    }
+}
+
+TileServer::TileServer(JobSystem& jobs, const std::size_t cache_bytes, const unsigned int connection_threads)
+    : m_jobs(jobs),
+      m_cache(cache_bytes),
+      m_pending_mutex(),
+      m_pending(),
+      m_layer_metrics(),
+      m_other_metrics(),
+      m_coalesced(0),
+      m_client_errors(0),
+      m_server_errors(0),
+      m_listeners(),
+      m_socket_path(),
+      m_port(0),
+      m_stopping(false),
+      m_connection_thread_count(std::max(connection_threads, 1u)),
+      m_connections_mutex(),
+      m_connections_ready(),
+      m_connections()
+{
+}
+
+TileServer::~TileServer() {
+    stop();
+#ifndef _WIN32
+    for(auto listener : m_listeners) {
+        close(listener);
+    }
+    if(!m_socket_path.empty()) {
+        unlink(m_socket_path.c_str());
+    }
+#endif
+}
+
+#ifdef _WIN32
+void TileServer::listen_tcp(const uint16_t) {
+    throw std::runtime_error("The tile server needs POSIX sockets");
+}
+
+void TileServer::listen_unix(const std::string&) {
+    throw std::runtime_error("The tile server needs POSIX sockets");
+}
+
+void TileServer::run() {
+    throw std::runtime_error("The tile server needs POSIX sockets");
+}
+#else
+void TileServer::listen_tcp(const uint16_t port) {
+    auto listener = socket(AF_INET, SOCK_STREAM, 0);
+    if(listener < 0) {
+        throw std::runtime_error(std::string("Cannot create a socket: ") + std::strerror(errno));
+    }
+
+    auto reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if(bind(listener, reinterpret_cast<sockaddr*>(&address), length) < 0
+        || listen(listener, SOMAXCONN) < 0
+        || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) < 0)
+    {
+        auto error = std::string(std::strerror(errno));
+        close(listener);
+        throw std::runtime_error("Cannot listen on port " + std::to_string(port) + ": " + error);
+    }
+
+    m_port = ntohs(address.sin_port);
+    m_listeners.push_back(listener);
+}
+
+void TileServer::listen_unix(const std::string& path) {
+    sockaddr_un address{};
+    if(path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Invalid socket path '" + path + "'");
+    }
+    address.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), address.sun_path);
+
+    auto listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0) {
+        throw std::runtime_error(std::string("Cannot create a socket: ") + std::strerror(errno));
+    }
+
+    unlink(path.c_str());
+    if(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        auto error = std::string(std::strerror(errno));
+        close(listener);
+        throw std::runtime_error("Cannot listen on " + path + ": " + error);
+    }
+
+    m_socket_path = path;
+    m_listeners.push_back(listener);
+}
+
+void TileServer::run() {
+    if(m_listeners.empty()) {
+        throw std::runtime_error("The tile server is not listening on anything");
+    }
+
+    std::vector<std::thread> threads;
+    for(auto thread = 0u; thread < m_connection_thread_count; thread++) {
+        threads.emplace_back([this] { serve_connections(); });
+    }
+
+    std::vector<pollfd> listeners;
+    for(auto listener : m_listeners) {
+        listeners.push_back(pollfd{listener, POLLIN, 0});
+    }
+
+    // A signal interrupts poll(), the flag is seen on the next round
+    while(!m_stopping) {
+        if(poll(listeners.data(), listeners.size(), POLL_INTERVAL_MS) <= 0) {
+            continue;
+        }
+
+        for(auto& listener : listeners) {
+            if(!(listener.revents & POLLIN)) {
+                continue;
+            }
+
+            auto connection = accept(listener.fd, nullptr, nullptr);
+            if(connection < 0) {
+                continue;
+            }
+
+            timeval timeout{CONNECTION_TIMEOUT_S, 0};
+            setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+            std::lock_guard lock(m_connections_mutex);
+            m_connections.push_back(connection);
+            m_connections_ready.notify_one();
+        }
+    }
+
+    {
+        std::lock_guard lock(m_connections_mutex);
+        m_connections_ready.notify_all();
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    for(auto listener : m_listeners) {
+        close(listener);
+    }
+    m_listeners.clear();
+    if(!m_socket_path.empty()) {
+        unlink(m_socket_path.c_str());
+        m_socket_path.clear();
+    }
+}
+
+void TileServer::serve_connections() {
+    while(true) {
+        int connection;
+        {
+            std::unique_lock lock(m_connections_mutex);
+            m_connections_ready.wait(lock, [this] { return m_stopping || !m_connections.empty(); });
+
+            // Connections accepted before stop() are still answered
+            if(m_connections.empty()) {
+                return;
+            }
+            connection = m_connections.front();
+            m_connections.pop_front();
+        }
+
+        serve_connection(connection);
+        close(connection);
+    }
+}
+
+void TileServer::serve_connection(const int connection) {
+    // Only the request line matters, the headers are read and ignored
+    std::string request;
+    char buffer[1024];
+    while(request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos) {
+        if(request.size() > MAX_REQUEST_BYTES) {
+            return;
+        }
+        auto received = recv(connection, buffer, sizeof(buffer), 0);
+        if(received <= 0) {
+            return;
+        }
+        request.append(buffer, static_cast<std::size_t>(received));
+    }
+
+    auto request_line = request.substr(0, request.find('\n'));
+    if(!request_line.empty() && request_line.back() == '\r') {
+        request_line.pop_back();
+    }
+
+    auto parts = split(request_line, ' ');
+    auto response = parts.size() == 3 ? handle(parts[0], parts[1]) : error_response(400, "Malformed request line");
+
+    std::ostringstream header;
+    header << "HTTP/1.0 " << response.status << " " << reason_phrase(response.status) << "\r\n"
+           << "Content-Type: " << response.content_type << "\r\n"
+           << "Content-Length: " << response.body.size() << "\r\n";
+    if(!response.cache.empty()) {
+        header << "X-Tile-Cache: " << response.cache << "\r\n";
+    }
+    header << "Connection: close\r\n\r\n";
+
+    auto message = header.str();
+    if(parts.size() != 3 || parts[0] != "HEAD") {
+        message += response.body;
+    }
+
+#ifdef MSG_NOSIGNAL
+    constexpr auto SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    constexpr auto SEND_FLAGS = 0;
+#endif
+    for(auto sent = std::size_t{0}; sent < message.size();) {
+        auto written = send(connection, message.data() + sent, message.size() - sent, SEND_FLAGS);
+        if(written <= 0) {
+            return;
+        }
+        sent += static_cast<std::size_t>(written);
+    }
+}
+#endif
+
+uint16_t TileServer::get_port() const {
+    return m_port;
+}
+
+void TileServer::stop() {
+    m_stopping = true;
+}
+
+TileResponse TileServer::handle(const std::string& method, const std::string& target) {
+    auto start = std::chrono::steady_clock::now();
+
+    auto query_start = target.find('?');
+    auto path = target.substr(0, query_start);
+    auto query = query_start == std::string::npos ? std::string() : target.substr(query_start + 1);
+    auto segments = split(path, '/');
+
+    // The layer's metrics once it is known, everything else counts as other
+    auto metrics = &m_other_metrics;
+    TileResponse response;
+    try {
+        if(method != "GET" && method != "HEAD") {
+            response = error_response(405, "Only GET and HEAD are supported");
+        } else if(path == "/metrics") {
+            response = TileResponse {200, "text/plain; version=0.0.4", get_metrics(), ""};
+        } else if(segments.size() == 6 && segments[0].empty() && segments[1] == "tiles") {
+            auto layer = std::find(std::begin(LAYER_NAMES), std::end(LAYER_NAMES), segments[2]);
+            if(layer == std::end(LAYER_NAMES)) {
+                response = error_response(404, "Unknown layer '" + segments[2] + "'");
+            } else {
+                auto index = layer - std::begin(LAYER_NAMES);
+                metrics = &m_layer_metrics[index];
+                response = handle_tile(static_cast<TileLayer>(index), segments, query);
+            }
+        } else {
+            response = error_response(404, "No such resource " + path);
+        }
+    } catch(const BadRequest& e) {
+        response = error_response(400, e.what());
+    } catch(const std::exception& e) {
+        response = error_response(500, e.what());
+    }
+
+    if(response.status >= 500) {
+        m_server_errors++;
+    } else if(response.status >= 400) {
+        m_client_errors++;
+    }
+
+    record(*metrics, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return response;
+}
+
+TileResponse TileServer::handle_tile(const TileLayer layer, const std::vector<std::string>& segments, const std::string& query) {
+    // /tiles/{layer}/{lod}/{x}/{z}
+    auto lod = parse_int(segments[3]);
+    auto tile = glm::ivec2(parse_int(segments[4]), parse_int(segments[5]));
+    if(lod < 0 || lod > static_cast<int>(MAX_LOD)) {
+        throw BadRequest("lod must be between 0 and " + std::to_string(MAX_LOD));
+    }
+
+    // Keeps sample coordinates well within an int
+    auto max_tile = (1 << 28) / static_cast<int>(TILE_SIZE << lod);
+    if(std::abs(tile.x) > max_tile || std::abs(tile.y) > max_tile) {
+        throw BadRequest("Tile coordinates must be within " + std::to_string(max_tile));
+    }
+
+    auto settings = parse_settings(query);
+    TileResponse response {200, "", "", ""};
+    auto apron = get_heights(settings, static_cast<unsigned int>(lod), tile, response.cache);
+
+    std::vector<float> heights;
+    apron.decode(heights);
+    // From -1 to TILE_SIZE + 1 on both axes
+    auto at = [&](int x, int z) {
+        return heights[static_cast<std::size_t>(z + 1) * APRON_SIZE + static_cast<std::size_t>(x + 1)];
+    };
+
+    constexpr auto SIZE = static_cast<int>(TILE_SIZE) + 1;
+    if(layer == TileLayer::HEIGHT) {
+        std::vector<float> samples;
+        samples.reserve(SIZE * SIZE);
+        for(auto z = 0; z < SIZE; z++) {
+            for(auto x = 0; x < SIZE; x++) {
+                samples.push_back(at(x, z));
+            }
+        }
+
+        HeightField field(SIZE, SIZE, HeightFormat::FLOAT32);
+        field.encode(samples);
+        std::ostringstream out;
+        field.write_pgm(out);
+        response.content_type = "image/x-portable-graymap";
+        response.body = out.str();
+        return response;
+    }
+
+    std::vector<glm::vec3> colors;
+    colors.reserve(SIZE * SIZE);
+    for(auto z = 0; z < SIZE; z++) {
+        for(auto x = 0; x < SIZE; x++) {
+            if(layer == TileLayer::PALETTE) {
+                colors.push_back(TerrainGenerator::get_palette_color(at(x, z)));
+                continue;
+            }
+
+            // Central differences over the apron, in world units
+            auto spacing = static_cast<float>(1u << lod);
+            auto normal = glm::normalize(glm::vec3(
+                (at(x - 1, z) - at(x + 1, z)) * settings.height_scale,
+                2.0f * spacing,
+                (at(x, z - 1) - at(x, z + 1)) * settings.height_scale));
+            colors.push_back(normal * 0.5f + 0.5f);
+        }
+    }
+
+    response.content_type = "image/x-portable-pixmap";
+    response.body = to_ppm(SIZE, colors);
+    return response;
+}
+
+HeightField TileServer::get_heights(const GenerationSettings& settings, const unsigned int lod, const glm::ivec2 tile, std::string& cache) {
+    auto spacing = static_cast<int>(1u << lod);
+    auto origin = tile * static_cast<int>(TILE_SIZE) * spacing - glm::ivec2(spacing);
+    auto key = TileCache::make_key(settings, origin, APRON_SIZE, HeightFormat::UNORM16, static_cast<float>(spacing), spacing);
+
+    // The first request for a tile produces it, later ones wait for it
+    std::promise<HeightField> produced;
+    std::shared_future<HeightField> pending;
+    auto producer = false;
+    {
+        std::lock_guard lock(m_pending_mutex);
+        auto existing = m_pending.find(key);
+        if(existing != m_pending.end()) {
+            pending = existing->second;
+        } else {
+            pending = produced.get_future().share();
+            m_pending.emplace(key, pending);
+            producer = true;
+        }
+    }
+
+    if(!producer) {
+        m_coalesced++;
+        cache = "coalesced";
+        return pending.get();
+    }
+
+    try {
+        HeightField field(APRON_SIZE, APRON_SIZE, HeightFormat::UNORM16);
+        if(m_cache.find(key, field)) {
+            cache = "hit";
+        } else {
+            cache = "miss";
+            field = generate_heights(settings, lod, origin);
+            m_cache.insert(key, field);
+        }
+        produced.set_value(std::move(field));
+    } catch(...) {
+        produced.set_exception(std::current_exception());
+    }
+
+    {
+        std::lock_guard lock(m_pending_mutex);
+        m_pending.erase(key);
+    }
+    return pending.get();
+}
+
+HeightField TileServer::generate_heights(const GenerationSettings& settings, const unsigned int lod, const glm::ivec2 origin) {
+    auto spacing = static_cast<int>(1u << lod);
+    std::vector<float> samples(static_cast<std::size_t>(APRON_SIZE) * APRON_SIZE);
+
+    std::vector<JobHandle> bands;
+    for(auto first_row = 0u; first_row < APRON_SIZE; first_row += ROWS_PER_JOB) {
+        auto rows = std::min(ROWS_PER_JOB, APRON_SIZE - first_row);
+        bands.push_back(m_jobs.submit([&, first_row, rows] {
+            thread_local std::vector<float> band;
+            thread_local std::vector<glm::vec2> octave_offsets;
+
+            auto band_origin = origin + glm::ivec2(0, static_cast<int>(first_row) * spacing);
+            TerrainGenerator::generate_level_heights(APRON_SIZE, rows, band_origin, lod, settings, band, octave_offsets);
+            std::copy(band.begin(), band.end(), samples.begin() + static_cast<std::size_t>(first_row) * APRON_SIZE);
+        }, JobPriority::IMMEDIATE));
+    }
+
+    // Bands still running write into samples, so every band is waited for
+    // before a failure unwinds this frame
+    std::exception_ptr failure;
+    for(auto& band : bands) {
+        try {
+            m_jobs.wait(band);
+        } catch(...) {
+            if(!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+    if(failure) {
+        std::rethrow_exception(failure);
+    }
+
+    HeightField field(APRON_SIZE, APRON_SIZE, HeightFormat::UNORM16);
+    field.encode(samples);
+    return field;
+}
+
+void TileServer::record(LayerMetrics& metrics, const double ms) {
+    metrics.requests++;
+    metrics.latency_us += static_cast<uint64_t>(ms * 1000.0);
+
+    auto bucket = std::lower_bound(LATENCY_BUCKETS_MS.begin(), LATENCY_BUCKETS_MS.end(), ms) - LATENCY_BUCKETS_MS.begin();
+    metrics.buckets[bucket]++;
+}
+
+std::string TileServer::get_metrics() const {
+    std::ostringstream out;
+
+    auto labels = std::vector<std::pair<std::string, const LayerMetrics*>>();
+    for(auto layer = 0u; layer < m_layer_metrics.size(); layer++) {
+        labels.emplace_back(LAYER_NAMES[layer], &m_layer_metrics[layer]);
+    }
+    labels.emplace_back("other", &m_other_metrics);
+
+    out << "# HELP terrain_tile_requests_total Requests handled, by tile layer\n"
+        << "# TYPE terrain_tile_requests_total counter\n";
+    for(auto& [layer, metrics] : labels) {
+        out << "terrain_tile_requests_total{layer=\"" << layer << "\"} " << metrics->requests << "\n";
+    }
+
+    out << "# HELP terrain_tile_request_duration_ms Time from request line to response, by tile layer\n"
+        << "# TYPE terrain_tile_request_duration_ms histogram\n";
+    for(auto& [layer, metrics] : labels) {
+        auto count = uint64_t{0};
+        for(auto bucket = 0u; bucket < metrics->buckets.size(); bucket++) {
+            count += metrics->buckets[bucket];
+            out << "terrain_tile_request_duration_ms_bucket{layer=\"" << layer << "\",le=\"";
+            if(bucket < LATENCY_BUCKETS_MS.size()) {
+                out << LATENCY_BUCKETS_MS[bucket];
+            } else {
+                out << "+Inf";
+            }
+            out << "\"} " << count << "\n";
+        }
+        out << "terrain_tile_request_duration_ms_sum{layer=\"" << layer << "\"} " << metrics->latency_us / 1000.0 << "\n"
+            << "terrain_tile_request_duration_ms_count{layer=\"" << layer << "\"} " << count << "\n";
+    }
+
+    // Coalesced requests never look at the cache
+    auto stats = m_cache.get_stats();
+    auto lookups = stats.hits + stats.misses;
+    out << "# TYPE terrain_tile_cache_hits_total counter\n"
+        << "terrain_tile_cache_hits_total " << stats.hits << "\n"
+        << "# TYPE terrain_tile_cache_misses_total counter\n"
+        << "terrain_tile_cache_misses_total " << stats.misses << "\n"
+        << "# TYPE terrain_tile_coalesced_total counter\n"
+        << "terrain_tile_coalesced_total " << m_coalesced << "\n"
+        << "# TYPE terrain_tile_cache_hit_ratio gauge\n"
+        << "terrain_tile_cache_hit_ratio " << (lookups ? static_cast<double>(stats.hits) / lookups : 0.0) << "\n"
+        << "# TYPE terrain_tile_cache_entries gauge\n"
+        << "terrain_tile_cache_entries " << stats.entries << "\n"
+        << "# TYPE terrain_tile_cache_bytes gauge\n"
+        << "terrain_tile_cache_bytes " << stats.compressed_bytes << "\n"
+        << "# TYPE terrain_tile_errors_total counter\n"
+        << "terrain_tile_errors_total{kind=\"client\"} " << m_client_errors << "\n"
+        << "terrain_tile_errors_total{kind=\"server\"} " << m_server_errors << "\n";
+
+    return out.str();
+}
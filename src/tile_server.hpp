@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "height_field.hpp"
+#include "terrain_generator.hpp"
+#include "tile_cache.hpp"
+
+class JobSystem;
+
+enum class TileLayer {
+    HEIGHT,
+    NORMAL,
+    PALETTE
+};
+
+struct TileResponse {
+    int status;
+    std::string content_type;
+    std::string body;
+
+    // How the tile's heights were obtained: "hit", "miss" or "coalesced",
+    // empty for anything but a tile
+    std::string cache;
+};
+
+// Serves terrain tiles to headless consumers over HTTP/1.0, on localhost or
+// a Unix domain socket:
+//
+//     GET /tiles/{height|normal|palette}/{lod}/{x}/{z}?seed=3&octaves=6
+//     GET /metrics
+//
+// A tile is TILE_SIZE cells a side at LOD lod, TILE_SIZE + 1 samples
+// 2^lod units apart, generated directly at that spacing with
+// generate_level_heights(). Query parameters override the default
+// GenerationSettings by their flythrough names. Heights come back as a 16
+// bit PGM, normals and palette colors as a PPM.
+//
+// Each tile's heights are generated once, with an apron of one sample for
+// the normals, in bands of rows over the job system. Requests for a tile
+// that is being generated wait for that generation instead of starting
+// their own, and finished tiles are kept in a TileCache. /metrics reports
+// request counts, latency histograms and cache hit rates in the Prometheus
+// text format.
+class TileServer {
+public:
+    static constexpr unsigned int TILE_SIZE = 64;
+    static constexpr unsigned int MAX_LOD = 12;
+
+    // Latency histogram bucket bounds in milliseconds, plus one for
+    // anything slower
+    static constexpr std::array<double, 10> LATENCY_BUCKETS_MS = {1, 2, 5, 10, 25, 50, 100, 250, 500, 1000};
+
+    TileServer(JobSystem& jobs, const std::size_t cache_bytes, const unsigned int connection_threads = 4);
+
+    // Stops serving if run() has not returned yet
+    ~TileServer();
+
+    TileServer(const TileServer&) = delete;
+    TileServer& operator=(const TileServer&) = delete;
+
+    // Binds 127.0.0.1 only, port 0 picks a free one. Throws
+    // std::runtime_error if the socket cannot be set up, or on platforms
+    // without POSIX sockets.
+    void listen_tcp(const uint16_t port);
+
+    // Replaces whatever is at path
+    void listen_unix(const std::string& path);
+
+    // Of the last listen_tcp()
+    uint16_t get_port() const;
+
+    // Accepts connections until stop(), then finishes the requests being
+    // handled and closes every socket
+    void run();
+
+    // Only sets a flag, so that it may be called from a signal handler
+    void stop();
+
+    // The response to a request, without any socket involved
+    TileResponse handle(const std::string& method, const std::string& target);
+
+    // Heights of a tile with its apron, (TILE_SIZE + 3)^2 samples from
+    // one sample before the tile's origin, before height_scale is applied
+    HeightField get_heights(const GenerationSettings& settings, const unsigned int lod, const glm::ivec2 tile, std::string& cache);
+
+    std::string get_metrics() const;
+
+private:
+    struct LayerMetrics {
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> latency_us{0};
+        std::array<std::atomic<uint64_t>, LATENCY_BUCKETS_MS.size() + 1> buckets{};
+    };
+
+    HeightField generate_heights(const GenerationSettings& settings, const unsigned int lod, const glm::ivec2 origin);
+    TileResponse handle_tile(const TileLayer layer, const std::vector<std::string>& segments, const std::string& query);
+    void record(LayerMetrics& metrics, const double ms);
+    void serve_connection(const int connection);
+    void serve_connections();
+
+    JobSystem& m_jobs;
+    TileCache m_cache;
+
+    // Tiles being generated, by cache key
+    std::mutex m_pending_mutex;
+    std::unordered_map<TileKey, std::shared_future<HeightField>, TileKeyHash> m_pending;
+
+    std::array<LayerMetrics, 3> m_layer_metrics;
+    LayerMetrics m_other_metrics;
+    std::atomic<uint64_t> m_coalesced;
+    std::atomic<uint64_t> m_client_errors;
+    std::atomic<uint64_t> m_server_errors;
+
+    std::vector<int> m_listeners;
+    std::string m_socket_path;
+    uint16_t m_port;
+    std::atomic<bool> m_stopping;
+
+    // Accepted connections waiting for a thread
+    unsigned int m_connection_thread_count;
+    std::mutex m_connections_mutex;
+    std::condition_variable m_connections_ready;
+    std::deque<int> m_connections;
+};
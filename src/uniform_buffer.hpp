@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_diagnostics.hpp"
+#include "gl_state.hpp"
+
+// Binding points shared by every program. Shader binds any block with one of
+// these names to its point at link time, so a buffer bound here once is seen
+// by all programs.
+namespace UniformBlocks {
+    struct Binding {
+        const char *name;
+        GLuint index;
+    };
+
+    constexpr Binding FRAME = {"Frame", 0};
+
+    constexpr Binding ALL[] = {FRAME};
+}
+
+// Per-frame camera and light data, laid out to match the std140 "Frame" block
+// declared in the shaders. vec3 values are padded to vec4 as std140 does.
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 view_position;
+    glm::vec4 light_position;
+    glm::vec4 light_color;
+};
+
+static_assert(sizeof(FrameUniforms) == 2 * 64 + 3 * 16, "FrameUniforms must match the std140 Frame block");
+
+template <typename Block>
+class UniformBuffer {
+public:
+    explicit UniformBuffer(UniformBlocks::Binding binding) : m_ubo(0u) {
+        GL_CHECK(glGenBuffers(1, &m_ubo));
+        GlState::bind_buffer(GL_UNIFORM_BUFFER, m_ubo);
+        GL_CHECK(glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW));
+        GL_CHECK(glBindBufferBase(GL_UNIFORM_BUFFER, binding.index, m_ubo));
+    }
+
+    ~UniformBuffer() {
+        GlState::forget_buffer(m_ubo);
+        glDeleteBuffers(1, &m_ubo);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void update(const Block& block) const {
+        GlState::bind_buffer(GL_UNIFORM_BUFFER, m_ubo);
+        GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block));
+    }
+
+private:
+    GLuint m_ubo;
+};
@@ -0,0 +1,188 @@
+#include "vertex_cache.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace {
+    uint64_t hash_indices(const Indices& indices, const unsigned int vertex_count) {
+        auto hash = 0xcbf29ce484222325ull ^ vertex_count;
+        for(auto index : indices) {
+            hash ^= index;
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    // Vertex v's triangles are triangles[offsets[v]] to triangles[offsets[v + 1]]
+    struct Adjacency {
+        std::vector<unsigned int> offsets;
+        std::vector<unsigned int> triangles;
+
+        Adjacency(const Indices& indices, const unsigned int vertex_count)
+            : offsets(vertex_count + 1, 0),
+              triangles(indices.size())
+        {
+            for(auto index : indices) {
+                offsets[index + 1]++;
+            }
+            for(auto vertex = 0u; vertex < vertex_count; vertex++) {
+                offsets[vertex + 1] += offsets[vertex];
+            }
+
+            auto next = std::vector<unsigned int>(offsets.begin(), offsets.end() - 1);
+            for(auto corner = 0u; corner < indices.size(); corner++) {
+                triangles[next[indices[corner]]++] = corner / 3;
+            }
+        }
+    };
+}
+
+namespace VertexCache {
+    VertexCacheStats measure(const Indices& indices, const unsigned int vertex_count, const unsigned int cache_size) {
+        // A vertex is cached while fewer than cache_size misses happened
+        // since its own, which is exactly a FIFO of cache_size entries
+        constexpr auto NEVER = std::numeric_limits<uint64_t>::max();
+        std::vector<uint64_t> missed_at(vertex_count, NEVER);
+
+        auto misses = uint64_t{0};
+        auto used = 0u;
+        for(auto index : indices) {
+            if(missed_at[index] == NEVER) {
+                used++;
+            } else if(misses - missed_at[index] < cache_size) {
+                continue;
+            }
+            missed_at[index] = misses++;
+        }
+
+        auto triangles = indices.size() / 3;
+        return VertexCacheStats {
+            triangles ? static_cast<double>(misses) / triangles : 0.0,
+            used ? static_cast<double>(misses) / used : 0.0
+        };
+    }
+
+    Indices optimize(const Indices& indices, const unsigned int vertex_count, const unsigned int cache_size) {
+        Adjacency adjacency(indices, vertex_count);
+
+        // Triangles of each vertex not emitted yet
+        std::vector<unsigned int> live(vertex_count);
+        for(auto vertex = 0u; vertex < vertex_count; vertex++) {
+            live[vertex] = adjacency.offsets[vertex + 1] - adjacency.offsets[vertex];
+        }
+
+        // Time a vertex entered the simulated cache, everything starts out
+        // of it
+        std::vector<unsigned int> cached_at(vertex_count, 0);
+        auto time = cache_size + 1;
+
+        std::vector<uint8_t> emitted(indices.size() / 3, 0);
+        std::vector<unsigned int> dead_ends;
+        std::vector<unsigned int> candidates;
+
+        Indices optimized;
+        optimized.reserve(indices.size());
+
+        // Continues from the most recently used vertex with triangles left,
+        // then in input order
+        auto cursor = 0u;
+        auto skip_dead_end = [&]() -> int {
+            while(!dead_ends.empty()) {
+                auto vertex = dead_ends.back();
+                dead_ends.pop_back();
+                if(live[vertex] > 0) {
+                    return static_cast<int>(vertex);
+                }
+            }
+            for(; cursor < vertex_count; cursor++) {
+                if(live[cursor] > 0) {
+                    return static_cast<int>(cursor);
+                }
+            }
+            return -1;
+        };
+
+        auto fan = vertex_count > 0 ? skip_dead_end() : -1;
+        while(fan >= 0) {
+            candidates.clear();
+            for(auto slot = adjacency.offsets[fan]; slot < adjacency.offsets[fan + 1]; slot++) {
+                auto triangle = adjacency.triangles[slot];
+                if(emitted[triangle]) {
+                    continue;
+                }
+                emitted[triangle] = 1;
+
+                for(auto corner = 0u; corner < 3; corner++) {
+                    auto vertex = indices[triangle * 3 + corner];
+                    optimized.push_back(vertex);
+                    dead_ends.push_back(vertex);
+                    candidates.push_back(vertex);
+                    live[vertex]--;
+                    if(time - cached_at[vertex] > cache_size) {
+                        cached_at[vertex] = time++;
+                    }
+                }
+            }
+
+            // The candidate longest in the cache that stays there while its
+            // remaining triangles are emitted, two new vertices each at most.
+            // Without one, back to the dead ends.
+            auto next = -1;
+            auto best = 0u;
+            for(auto vertex : candidates) {
+                if(live[vertex] == 0) {
+                    continue;
+                }
+                auto priority = 0u;
+                if(time - cached_at[vertex] + 2 * live[vertex] <= cache_size) {
+                    priority = time - cached_at[vertex];
+                }
+                if(priority > best) {
+                    best = priority;
+                    next = static_cast<int>(vertex);
+                }
+            }
+
+            fan = next >= 0 ? next : skip_dead_end();
+        }
+
+        return optimized;
+    }
+
+    std::shared_ptr<const OptimizedIndices> optimize_cached(const Indices& indices, const unsigned int vertex_count) {
+        struct Entry {
+            uint64_t hash;
+            unsigned int vertex_count;
+            Indices indices;
+            std::shared_ptr<const OptimizedIndices> optimized;
+        };
+
+        // Most recently used first. The hash only rules entries out, a match
+        // compares the whole index list.
+        static std::mutex mutex;
+        static std::list<Entry> entries;
+
+        auto hash = hash_indices(indices, vertex_count);
+
+        std::lock_guard lock(mutex);
+        for(auto entry = entries.begin(); entry != entries.end(); ++entry) {
+            if(entry->hash == hash && entry->vertex_count == vertex_count && entry->indices == indices) {
+                entries.splice(entries.begin(), entries, entry);
+                return entry->optimized;
+            }
+        }
+
+        auto reordered = optimize(indices, vertex_count);
+        auto report = VertexCacheReport { measure(indices, vertex_count), measure(reordered, vertex_count) };
+        auto optimized = std::make_shared<const OptimizedIndices>(OptimizedIndices { std::move(reordered), report });
+
+        entries.push_front(Entry { hash, vertex_count, indices, optimized });
+        if(entries.size() > CACHED_LISTS) {
+            entries.pop_back();
+        }
+        return optimized;
+    }
+}
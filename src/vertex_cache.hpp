@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+using Indices = std::vector<unsigned int>;
+
+// Post-transform vertex cache efficiency of a triangle list, simulated with
+// a FIFO cache of a given size
+struct VertexCacheStats {
+    // Average cache miss ratio: vertex shader invocations per triangle,
+    // 0.5 at best on a large grid and 3 at worst
+    double acmr;
+
+    // Average transform to vertex ratio: invocations per vertex used, 1 at
+    // best
+    double atvr;
+};
+
+struct VertexCacheReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+};
+
+struct OptimizedIndices {
+    Indices indices;
+    VertexCacheReport report;
+};
+
+namespace VertexCache {
+    // Entries of the cache the reordering targets and the stats simulate.
+    // Small enough to hold on every GPU still in use, larger caches only
+    // do better.
+    constexpr unsigned int CACHE_SIZE = 16;
+
+    VertexCacheStats measure(const Indices& indices, const unsigned int vertex_count, const unsigned int cache_size = CACHE_SIZE);
+
+    // Tipsify (Sander, Nehab and Barczak 2007): fans out around one vertex
+    // at a time, moving on to the next vertex still in the cache that will
+    // not be evicted before its remaining triangles are emitted. Linear in
+    // the index count. Triangles keep their winding and first vertex, only
+    // their order changes.
+    Indices optimize(const Indices& indices, const unsigned int vertex_count, const unsigned int cache_size = CACHE_SIZE);
+
+    // Distinct index lists optimize_cached() keeps, the least recently used
+    // is dropped beyond that. A few grid and patch sizes are in use at once.
+    constexpr unsigned int CACHED_LISTS = 8;
+
+    // optimize() with its stats, computed once per distinct vertex count and
+    // index list while it stays among the CACHED_LISTS most recently used.
+    // Safe to call from several threads, the result outlives eviction.
+    std::shared_ptr<const OptimizedIndices> optimize_cached(const Indices& indices, const unsigned int vertex_count);
+}
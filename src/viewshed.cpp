@@ -0,0 +1,244 @@
+#include "viewshed.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "job_system.hpp"
+#include "terrain_query.hpp"
+
+namespace {
+    // Lines of sight per job, each walks up to the radius in samples
+    constexpr unsigned int LINES_PER_JOB = 64;
+
+    using Mask = std::vector<std::atomic<uint32_t>>;
+
+    // Lines from one observer to the edge of the box its radius spans,
+    // clipped to the grid
+    struct Sweep {
+        glm::ivec2 observer;
+        float eye;
+        float radius;
+        glm::ivec2 min;
+        glm::ivec2 max;
+
+        unsigned int get_line_count() const {
+            return 2 * (max.x - min.x) + 2 * (max.y - min.y);
+        }
+
+        // Walks the box's edge counterclockwise from its min corner
+        glm::ivec2 get_line_end(unsigned int line) const {
+            auto side_x = static_cast<unsigned int>(max.x - min.x);
+            auto side_z = static_cast<unsigned int>(max.y - min.y);
+            if(line < side_x) {
+                return glm::ivec2(min.x + line, min.y);
+            }
+            line -= side_x;
+            if(line < side_z) {
+                return glm::ivec2(max.x, min.y + line);
+            }
+            line -= side_z;
+            if(line < side_x) {
+                return glm::ivec2(max.x - line, max.y);
+            }
+            return glm::ivec2(min.x, max.y - (line - side_x));
+        }
+    };
+
+    // Lines near the observer cross the same samples, most are set already
+    void mark_visible(Mask& mask, const unsigned int words_per_row, const int x, const int z) {
+        auto& word = mask[static_cast<std::size_t>(z) * words_per_row + x / 32];
+        auto bit = 1u << (x % 32);
+        if(!(word.load(std::memory_order_relaxed) & bit)) {
+            word.fetch_or(bit, std::memory_order_relaxed);
+        }
+    }
+
+    void walk_line(
+        const Sweep& sweep,
+        const glm::ivec2 end,
+        const std::vector<float>& heights,
+        const unsigned int width,
+        const float target_height,
+        Mask& mask,
+        const unsigned int words_per_row)
+    {
+        auto delta = end - sweep.observer;
+        auto steps = std::max(std::abs(delta.x), std::abs(delta.y));
+        if(steps == 0) {
+            return;
+        }
+
+        // Samples are stepped through one at a time along the major axis,
+        // the minor axis position falls between two samples
+        auto x_major = std::abs(delta.x) >= std::abs(delta.y);
+        auto major_step = (x_major ? delta.x : delta.y) > 0 ? 1 : -1;
+        auto minor_delta = x_major ? delta.y : delta.x;
+        auto minor_step = static_cast<float>(minor_delta) / steps;
+        auto major_origin = x_major ? sweep.observer.x : sweep.observer.y;
+        auto minor_origin = x_major ? sweep.observer.y : sweep.observer.x;
+
+        // Horizontal distance grows by the same amount every step, so
+        // elevation angles compare as height differences over step counts
+        auto step_length = std::sqrt(1.0f + minor_step * minor_step);
+        auto last_step = steps;
+        if(std::isfinite(sweep.radius)) {
+            last_step = std::min(steps, static_cast<int>(sweep.radius / step_length));
+        }
+
+        // Walks a pointer to the lower of the two samples the line passes
+        // between. The minor axis offset is minor_delta * step / steps, kept
+        // as an integer remainder so that it is exact on samples and the
+        // line never reads past its end.
+        auto major_stride = x_major ? std::ptrdiff_t{1} : static_cast<std::ptrdiff_t>(width);
+        auto minor_stride = x_major ? static_cast<std::ptrdiff_t>(width) : std::ptrdiff_t{1};
+        auto lower = minor_origin;
+        auto remainder = 0;
+        auto sample = heights.data() + major_origin * major_stride + minor_origin * minor_stride;
+        auto inverse_steps = 1.0f / steps;
+
+        // The steepest slope is only divided out when it changes
+        auto steepest = -std::numeric_limits<float>::infinity();
+        for(auto step = 1; step <= last_step; step++) {
+            sample += major_step * major_stride;
+            remainder += minor_delta;
+            if(remainder >= steps) {
+                remainder -= steps;
+                lower++;
+                sample += minor_stride;
+            } else if(remainder < 0) {
+                remainder += steps;
+                lower--;
+                sample -= minor_stride;
+            }
+
+            auto fraction = remainder * inverse_steps;
+            auto terrain = remainder > 0 ? sample[0] + (sample[minor_stride] - sample[0]) * fraction : sample[0];
+
+            auto rounds_up = fraction >= 0.5f;
+            auto horizon = steepest * step;
+            if(sample[rounds_up ? minor_stride : 0] + target_height - sweep.eye >= horizon) {
+                auto major = major_origin + step * major_step;
+                auto nearest = lower + (rounds_up ? 1 : 0);
+                if(x_major) {
+                    mark_visible(mask, words_per_row, major, nearest);
+                } else {
+                    mark_visible(mask, words_per_row, nearest, major);
+                }
+            }
+
+            if(terrain - sweep.eye > horizon) {
+                steepest = (terrain - sweep.eye) / step;
+            }
+        }
+    }
+}
+
+Viewshed::Viewshed()
+    : Viewshed(0, 0, glm::vec2(0.0f, 0.0f))
+{
+}
+
+Viewshed::Viewshed(const unsigned int width, const unsigned int depth, const glm::vec2 origin)
+    : m_width(width),
+      m_depth(depth),
+      m_origin(origin),
+      m_words_per_row((width + 31) / 32),
+      m_bits(static_cast<std::size_t>(m_words_per_row) * depth, 0u)
+{
+}
+
+Viewshed Viewshed::compute(
+    const TerrainQuery& terrain,
+    const std::vector<ViewshedObserver>& observers,
+    const float target_height,
+    JobSystem& jobs)
+{
+    auto width = terrain.get_width();
+    auto depth = terrain.get_depth();
+    auto& heights = terrain.get_samples();
+
+    Viewshed viewshed(width, depth, terrain.get_origin());
+    Mask mask(viewshed.m_bits.size());
+
+    std::vector<Sweep> sweeps;
+    sweeps.reserve(observers.size());
+    for(auto& observer : observers) {
+        auto local = observer.position - viewshed.m_origin;
+        auto position = glm::ivec2(
+            std::clamp(static_cast<int>(std::lround(local.x)), 0, static_cast<int>(width) - 1),
+            std::clamp(static_cast<int>(std::lround(local.y)), 0, static_cast<int>(depth) - 1));
+
+        auto reach = static_cast<int>(std::max(width, depth));
+        if(std::isfinite(observer.radius)) {
+            reach = std::min(reach, static_cast<int>(std::ceil(std::max(observer.radius, 0.0f))));
+        }
+
+        sweeps.push_back(Sweep {
+            position,
+            heights[static_cast<std::size_t>(position.y) * width + position.x] + observer.height,
+            observer.radius,
+            glm::ivec2(std::max(position.x - reach, 0), std::max(position.y - reach, 0)),
+            glm::ivec2(std::min(position.x + reach, static_cast<int>(width) - 1), std::min(position.y + reach, static_cast<int>(depth) - 1))
+        });
+
+        // Observers see where they stand
+        mark_visible(mask, viewshed.m_words_per_row, position.x, position.y);
+    }
+
+    std::vector<JobHandle> sectors;
+    for(auto& sweep : sweeps) {
+        for(auto first = 0u; first < sweep.get_line_count(); first += LINES_PER_JOB) {
+            auto last = std::min(first + LINES_PER_JOB, sweep.get_line_count());
+            sectors.push_back(jobs.submit([&, first, last] {
+                for(auto line = first; line < last; line++) {
+                    walk_line(sweep, sweep.get_line_end(line), heights, width, target_height, mask, viewshed.m_words_per_row);
+                }
+            }, JobPriority::IMMEDIATE));
+        }
+    }
+
+    for(auto& sector : sectors) {
+        jobs.wait(sector);
+    }
+
+    for(auto index = std::size_t{0}; index < mask.size(); index++) {
+        viewshed.m_bits[index] = mask[index].load(std::memory_order_relaxed);
+    }
+
+    return viewshed;
+}
+
+bool Viewshed::is_visible(const unsigned int x, const unsigned int z) const {
+    return m_bits[static_cast<std::size_t>(z) * m_words_per_row + x / 32] & (1u << (x % 32));
+}
+
+std::size_t Viewshed::count_visible() const {
+    auto count = std::size_t{0};
+    for(auto word : m_bits) {
+        for(; word; word &= word - 1) {
+            count++;
+        }
+    }
+    return count;
+}
+
+unsigned int Viewshed::get_width() const {
+    return m_width;
+}
+
+unsigned int Viewshed::get_depth() const {
+    return m_depth;
+}
+
+glm::vec2 Viewshed::get_origin() const {
+    return m_origin;
+}
+
+unsigned int Viewshed::get_words_per_row() const {
+    return m_words_per_row;
+}
+
+const std::vector<uint32_t>& Viewshed::get_bits() const {
+    return m_bits;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+class JobSystem;
+class TerrainQuery;
+
+struct ViewshedObserver {
+    // World x and z, snapped to the nearest sample
+    glm::vec2 position;
+
+    // Eye height above the ground
+    float height;
+
+    // Samples further than this, horizontally, are not tested
+    float radius = std::numeric_limits<float>::infinity();
+};
+
+// Which samples of a TerrainQuery's grid can be seen from at least one of a
+// set of observers, one bit per sample. Rows are padded to whole 32 bit
+// words so that the mask can be uploaded as an integer texture as it is.
+class Viewshed {
+public:
+    Viewshed();
+    Viewshed(const unsigned int width, const unsigned int depth, const glm::vec2 origin);
+
+    // R2 sweep: a line of sight is walked from every observer to every
+    // sample on the edge of its area, one sample along the major axis at a
+    // time, keeping the steepest elevation angle of the terrain crossed so
+    // far. A sample is visible if a point target_height above it is at or
+    // above that angle. The lines through nearby samples are shared, so the
+    // cost grows with the perimeter times the radius rather than with the
+    // area times the radius. Lines are split over the job system's workers.
+    static Viewshed compute(
+        const TerrainQuery& terrain,
+        const std::vector<ViewshedObserver>& observers,
+        const float target_height,
+        JobSystem& jobs);
+
+    bool is_visible(const unsigned int x, const unsigned int z) const;
+    std::size_t count_visible() const;
+
+    unsigned int get_width() const;
+    unsigned int get_depth() const;
+    glm::vec2 get_origin() const;
+
+    // Sample (x, z) is bit x % 32 of word z * words_per_row + x / 32
+    unsigned int get_words_per_row() const;
+    const std::vector<uint32_t>& get_bits() const;
+
+private:
+    unsigned int m_width;
+    unsigned int m_depth;
+    glm::vec2 m_origin;
+    unsigned int m_words_per_row;
+    std::vector<uint32_t> m_bits;
+};
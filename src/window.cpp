@@ -1,7 +1,25 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <stdexcept>
 
+#ifdef HAS_EGL
+// Keep Xlib out, its macros clash with everything
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "gl_diagnostics.hpp"
 #include "window.hpp"
 
+namespace {
+    double steady_seconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
 // Default callback will just resize the OpenGL viewport
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
@@ -18,7 +36,18 @@ static void glfw_error_callback(int error, const char* description)
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
-Window::Window(const unsigned int width, const unsigned int height, const char *window_name) {
+Window::Window(const unsigned int width, const unsigned int height, const char *window_name)
+    : m_window(nullptr),
+      m_backend(WindowBackend::GLFW),
+      m_width(width),
+      m_height(height),
+      m_framebuffer(0),
+      m_color_buffer(0),
+      m_depth_buffer(0),
+      m_egl_display(nullptr),
+      m_egl_context(nullptr),
+      m_start_time(steady_seconds())
+{
     // glfw: initialize and configure
     // ------------------------------
     glfwSetErrorCallback(glfw_error_callback);
@@ -31,6 +60,8 @@ Window::Window(const unsigned int width, const unsigned int height, const char *
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GlDiagnostics::DEBUG_CONTEXT);
+
     // Create internal glfw window
     GLFWwindow* window = glfwCreateWindow(width, height, window_name, nullptr, nullptr);
     if (window == nullptr)
@@ -49,13 +80,213 @@ Window::Window(const unsigned int width, const unsigned int height, const char *
         throw std::runtime_error("Failed to initialize GLAD");
     }  
 
+    GlDiagnostics::initialize(reinterpret_cast<GlDiagnostics::ProcLoader>(glfwGetProcAddress));
+
     m_window = window;
 }
 
+Window::Window(const unsigned int width, const unsigned int height, WindowBackend backend)
+    : m_window(nullptr),
+      m_backend(backend),
+      m_width(width),
+      m_height(height),
+      m_framebuffer(0),
+      m_color_buffer(0),
+      m_depth_buffer(0),
+      m_egl_display(nullptr),
+      m_egl_context(nullptr),
+      m_start_time(steady_seconds())
+{
+}
+
+std::unique_ptr<Window> Window::create_headless(const unsigned int width, const unsigned int height) {
+    if(width == 0 || height == 0) {
+        throw std::runtime_error("Headless framebuffer size must not be zero");
+    }
+
+    // Not make_unique, the constructor is private
+    auto window = std::unique_ptr<Window>(new Window(width, height, WindowBackend::EGL_SURFACELESS));
+    if(!window->create_egl_context()) {
+        window->m_backend = WindowBackend::GLFW_HIDDEN;
+        window->create_hidden_glfw_context();
+    }
+
+    window->create_framebuffer();
+    return window;
+}
+
+#ifdef HAS_EGL
+bool Window::create_egl_context() {
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if(!get_platform_display) {
+        return false;
+    }
+
+    auto display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        return false;
+    }
+
+    if(!eglBindAPI(EGL_OPENGL_API)) {
+        eglTerminate(display);
+        return false;
+    }
+
+    // Nothing is ever drawn to an EGL surface, any config will do and Mesa
+    // accepts no config at all
+    EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = nullptr;
+    EGLint config_count = 0;
+    eglChooseConfig(display, config_attributes, &config, 1, &config_count);
+
+    EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_DEBUG, GlDiagnostics::DEBUG_CONTEXT ? EGL_TRUE : EGL_FALSE,
+        EGL_NONE
+    };
+
+    auto context = eglCreateContext(display, config_count > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+    if(context == EGL_NO_CONTEXT) {
+        eglTerminate(display);
+        return false;
+    }
+
+    if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return false;
+    }
+
+    m_egl_display = display;
+    m_egl_context = context;
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)))
+    {
+        throw std::runtime_error("Failed to initialize GLAD");
+    }
+
+    GlDiagnostics::initialize(reinterpret_cast<GlDiagnostics::ProcLoader>(eglGetProcAddress));
+    return true;
+}
+#else
+bool Window::create_egl_context() {
+    return false;
+}
+#endif
+
+void Window::create_hidden_glfw_context() {
+    glfwSetErrorCallback(glfw_error_callback);
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GlDiagnostics::DEBUG_CONTEXT);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    // The window only carries the context, its own framebuffer is never used
+    GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
+    if (window == nullptr)
+    {
+        glfwTerminate();
+        throw std::runtime_error("Failed to create a headless context, neither EGL nor GLFW are available");
+    }
+
+    glfwMakeContextCurrent(window);
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
+    {
+        glfwTerminate();
+        throw std::runtime_error("Failed to initialize GLAD");
+    }
+
+    GlDiagnostics::initialize(reinterpret_cast<GlDiagnostics::ProcLoader>(glfwGetProcAddress));
+
+    m_window = window;
+}
+
+void Window::create_framebuffer() {
+    glGenRenderbuffers(1, &m_color_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_color_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+
+    glGenRenderbuffers(1, &m_depth_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depth_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_buffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depth_buffer);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("Headless framebuffer is incomplete");
+    }
+
+    // Nothing else binds framebuffers, so this stays the draw target
+    glViewport(0, 0, m_width, m_height);
+}
+
 Window::~Window() {
+    if(m_framebuffer) {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteRenderbuffers(1, &m_color_buffer);
+        glDeleteRenderbuffers(1, &m_depth_buffer);
+    }
+
+#ifdef HAS_EGL
+    if(m_egl_context) {
+        eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_egl_display, m_egl_context);
+        eglTerminate(m_egl_display);
+        return;
+    }
+#endif
+
     glfwTerminate();
 }
 
+bool Window::is_headless() const {
+    return m_backend != WindowBackend::GLFW;
+}
+
+WindowBackend Window::get_backend() const {
+    return m_backend;
+}
+
+unsigned int Window::get_width() const {
+    return m_width;
+}
+
+unsigned int Window::get_height() const {
+    return m_height;
+}
+
+std::vector<uint8_t> Window::read_pixels() {
+    std::vector<uint8_t> pixels(m_width * m_height * 3);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    // GL rows start at the bottom
+    auto row_size = m_width * 3;
+    for(auto row = 0u; row < m_height / 2; row++) {
+        std::swap_ranges(
+            pixels.begin() + row * row_size,
+            pixels.begin() + (row + 1) * row_size,
+            pixels.begin() + (m_height - row - 1) * row_size
+        );
+    }
+
+    return pixels;
+}
+
 void Window::clear_screen() {
     // TODO: Set custom clear color
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -64,7 +295,7 @@ void Window::clear_screen() {
 }
 
 bool Window::should_close() {
-    return glfwWindowShouldClose(m_window);
+    return !is_headless() && glfwWindowShouldClose(m_window);
 }
 
 GLFWwindow* Window::get_window() {
@@ -80,23 +311,40 @@ void Window::polygon_mode(PolygonMode mode) {
 }
 
 void Window::close() {
-    glfwSetWindowShouldClose(m_window, true);
+    if(!is_headless()) {
+        glfwSetWindowShouldClose(m_window, true);
+    }
 }
 
 void Window::swap_and_poll() {
+    if(is_headless()) {
+        // There is no swap to pace the frames, keep the driver from queueing
+        // an unbounded amount of work
+        glFlush();
+        return;
+    }
+
     glfwSwapBuffers(m_window);
     glfwPollEvents();
 }
 
 Keyboard::KeyState Window::get_key(Keyboard::Key key) {
+    if(is_headless()) {
+        return Keyboard::KeyState::RELEASED;
+    }
+
     return static_cast<Keyboard::KeyState>(glfwGetKey(m_window, static_cast<GLint>(key)));
 }
 
 float Window::get_elapsed_time() {
-    return glfwGetTime();
+    return steady_seconds() - m_start_time;
 }
 
 void Window::set_mouse_callback(GLFWmousebuttonfun mouse_btn_func, GLFWcursorposfun mouse_pos_func) {
+    if(is_headless()) {
+        return;
+    }
+
     if(mouse_btn_func) {
         glfwSetMouseButtonCallback(m_window, mouse_btn_func);
     }
@@ -107,9 +355,17 @@ void Window::set_mouse_callback(GLFWmousebuttonfun mouse_btn_func, GLFWcursorpos
 }
 
 void Window::set_mouse_mode(MouseMode mode) {
+    if(is_headless()) {
+        return;
+    }
+
     glfwSetInputMode(m_window, GLFW_CURSOR, static_cast<int>(mode));
 }
 
 void Window::set_zoom_callback(GLFWscrollfun func) {
+    if(is_headless()) {
+        return;
+    }
+
     glfwSetScrollCallback(m_window, func);
 }
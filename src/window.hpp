@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -157,11 +159,37 @@ enum class Capability {
     PROGRAM_POINT_SIZE = GL_PROGRAM_POINT_SIZE
 };
 
+enum class WindowBackend {
+    GLFW,
+    // Invisible GLFW window, still needs a display server
+    GLFW_HIDDEN,
+    // EGL context without any surface (Mesa), needs no display at all
+    EGL_SURFACELESS,
+};
+
 class Window {
 public:
     Window(const unsigned int width, const unsigned int height, const char *name);
     ~Window();
 
+    Window(const Window&) = delete;
+    Window& operator=(const Window&) = delete;
+
+    // Creates a context nothing is presented from. Rendering goes to an
+    // offscreen framebuffer of the given size that stays bound as the draw
+    // target. Tries an EGL surfaceless context first, when built with EGL,
+    // and falls back to a hidden GLFW window.
+    static std::unique_ptr<Window> create_headless(const unsigned int width, const unsigned int height);
+
+    bool is_headless() const;
+    WindowBackend get_backend() const;
+    unsigned int get_width() const;
+    unsigned int get_height() const;
+
+    // Reads the current color buffer back as tightly packed RGB rows, top
+    // row first. Blocks until rendering has finished.
+    std::vector<uint8_t> read_pixels();
+
     void clear_screen();
     void close();
     bool should_close();
@@ -178,5 +206,25 @@ public:
     Keyboard::KeyState get_key(Keyboard::Key key);
 
 private:
+    Window(const unsigned int width, const unsigned int height, WindowBackend backend);
+
+    bool create_egl_context();
+    void create_hidden_glfw_context();
+    void create_framebuffer();
+
     GLFWwindow *m_window;
+    WindowBackend m_backend;
+    unsigned int m_width;
+    unsigned int m_height;
+
+    // Offscreen target of headless windows
+    GLuint m_framebuffer;
+    GLuint m_color_buffer;
+    GLuint m_depth_buffer;
+
+    // EGL handles, kept opaque so that EGL headers stay out of here
+    void *m_egl_display;
+    void *m_egl_context;
+
+    double m_start_time;
 };
\ No newline at end of file
@@ -0,0 +1,141 @@
+// Round trips height fields through HeightCodec and checks that every
+// sample comes back bit for bit. Exits non-zero on the first mismatch.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "height_codec.hpp"
+#include "height_field.hpp"
+
+namespace {
+    int failures = 0;
+
+    void fail(const std::string& name, const std::string& message) {
+        std::fprintf(stderr, "%s: %s\n", name.c_str(), message.c_str());
+        failures++;
+    }
+
+    // Fills width x height samples from sample(x, y) and round trips them
+    void round_trip(
+        const std::string& name,
+        const unsigned int width,
+        const unsigned int height,
+        const HeightFormat format,
+        const std::function<float(unsigned int, unsigned int)>& sample)
+    {
+        std::vector<float> samples(static_cast<std::size_t>(width) * height);
+        for(auto y = 0u; y < height; y++) {
+            for(auto x = 0u; x < width; x++) {
+                samples[static_cast<std::size_t>(y) * width + x] = sample(x, y);
+            }
+        }
+
+        HeightField field(width, height, format);
+        field.encode(samples);
+
+        // Compressing appends, so leading bytes must be left alone
+        std::vector<uint8_t> data{0xab};
+        HeightCodec::compress(field, data);
+        if(data[0] != 0xab) {
+            fail(name, "compress overwrote earlier bytes");
+            return;
+        }
+        data.erase(data.begin());
+
+        HeightField decoded(width, height, format);
+        HeightCodec::decompress(data, decoded);
+
+        if(std::memcmp(field.get_data(), decoded.get_data(), field.get_byte_size()) != 0) {
+            fail(name, "samples differ after the round trip");
+        }
+        if(field.get_min() != decoded.get_min() || field.get_max() != decoded.get_max()) {
+            fail(name, "range differs after the round trip");
+        }
+    }
+
+    template <typename Call>
+    void expect_throw(const std::string& name, Call call) {
+        try {
+            call();
+        } catch(const std::runtime_error&) {
+            return;
+        }
+        fail(name, "expected std::runtime_error");
+    }
+}
+
+int main() {
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for(auto format : {HeightFormat::UNORM16, HeightFormat::FLOAT16}) {
+        auto suffix = format == HeightFormat::UNORM16 ? " unorm16" : " float16";
+
+        // Smooth terrain like the generator's, the case the codec is tuned for
+        round_trip(std::string("smooth") + suffix, 67, 67, format, [](unsigned int x, unsigned int y) {
+            return 0.5f + 0.25f * std::sin(x * 0.11f) * std::cos(y * 0.07f) + 0.05f * std::sin((x + y) * 0.9f);
+        });
+
+        // White noise, whose residuals mostly need escapes
+        round_trip(std::string("noise") + suffix, 64, 33, format, [&](unsigned int, unsigned int) {
+            return uniform(random);
+        });
+
+        // Extremes next to each other give the largest residuals
+        round_trip(std::string("checkerboard") + suffix, 31, 17, format, [](unsigned int x, unsigned int y) {
+            return (x + y) % 2 ? 1.0f : 0.0f;
+        });
+
+        round_trip(std::string("flat") + suffix, 40, 40, format, [](unsigned int, unsigned int) {
+            return 0.25f;
+        });
+
+        // Sizes that are not multiples of the block or of a row
+        round_trip(std::string("single sample") + suffix, 1, 1, format, [](unsigned int, unsigned int) {
+            return 0.75f;
+        });
+        round_trip(std::string("column") + suffix, 1, 45, format, [](unsigned int, unsigned int y) {
+            return y / 44.0f;
+        });
+        round_trip(std::string("row") + suffix, 45, 1, format, [](unsigned int x, unsigned int) {
+            return 1.0f - x / 44.0f;
+        });
+    }
+
+    // Misuse is reported rather than decoded into garbage
+    HeightField field(16, 16, HeightFormat::UNORM16);
+    field.encode(std::vector<float>(256, 0.5f));
+    std::vector<uint8_t> data;
+    HeightCodec::compress(field, data);
+
+    expect_throw("float32 compress", [] {
+        std::vector<uint8_t> out;
+        HeightCodec::compress(HeightField(4, 4, HeightFormat::FLOAT32), out);
+    });
+    expect_throw("size mismatch", [&] {
+        HeightField other(8, 16, HeightFormat::UNORM16);
+        HeightCodec::decompress(data, other);
+    });
+    expect_throw("format mismatch", [&] {
+        HeightField other(16, 16, HeightFormat::FLOAT16);
+        HeightCodec::decompress(data, other);
+    });
+    expect_throw("truncated header", [&] {
+        HeightField other(16, 16, HeightFormat::UNORM16);
+        HeightCodec::decompress(std::vector<uint8_t>(data.begin(), data.begin() + 4), other);
+    });
+
+    if(failures > 0) {
+        std::fprintf(stderr, "%d height codec checks failed\n", failures);
+        return 1;
+    }
+    std::printf("height codec round trips passed\n");
+    return 0;
+}
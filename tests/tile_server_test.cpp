@@ -0,0 +1,193 @@
+// Drives TileServer::handle() and get_heights() directly, the way a local
+// client would through the socket, and checks statuses, tile formats, the
+// cache, coalescing and the /metrics histogram. Exits non-zero if any check
+// fails.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job_system.hpp"
+#include "tile_server.hpp"
+
+namespace {
+    int failures = 0;
+
+    void check(const bool passed, const std::string& message) {
+        if(!passed) {
+            std::fprintf(stderr, "%s\n", message.c_str());
+            failures++;
+        }
+    }
+
+    void expect_status(TileServer& server, const std::string& target, const int status, const std::string& method = "GET") {
+        auto response = server.handle(method, target);
+        check(response.status == status,
+            method + " " + target + ": expected " + std::to_string(status) + ", got " + std::to_string(response.status));
+    }
+
+    // The value of the metric line starting with name, -1 if there is none
+    double metric(const std::string& metrics, const std::string& name) {
+        std::istringstream lines(metrics);
+        std::string line;
+        while(std::getline(lines, line)) {
+            if(line.compare(0, name.size() + 1, name + " ") == 0) {
+                return std::stod(line.substr(name.size() + 1));
+            }
+        }
+        return -1.0;
+    }
+
+    void check_statuses(TileServer& server) {
+        expect_status(server, "/tiles/height/13/0/0", 400);
+        expect_status(server, "/tiles/height/-1/0/0", 400);
+        expect_status(server, "/tiles/height/x/0/0", 400);
+        expect_status(server, "/tiles/height/0/99999999/0", 400);
+        expect_status(server, "/tiles/height/0/0/0?octaves=100", 400);
+        expect_status(server, "/tiles/height/0/0/0?octaves=3.5", 400);
+        expect_status(server, "/tiles/height/0/0/0?seed=abc", 400);
+        expect_status(server, "/tiles/height/0/0/0?unknown=1", 400);
+        expect_status(server, "/tiles/height/0/0/0?persistence", 400);
+
+        expect_status(server, "/tiles/slope/0/0/0", 404);
+        expect_status(server, "/tiles/height/0/0", 404);
+        expect_status(server, "/nothing", 404);
+
+        expect_status(server, "/tiles/height/0/0/0", 405, "POST");
+    }
+
+    void check_formats(TileServer& server) {
+        constexpr auto SIZE = TileServer::TILE_SIZE + 1;
+        auto size = std::to_string(SIZE) + " " + std::to_string(SIZE);
+
+        auto height = server.handle("GET", "/tiles/height/2/-1/3?seed=5");
+        auto pgm_header = "P5\n" + size + "\n65535\n";
+        check(height.status == 200, "height tile failed: " + height.body);
+        check(height.content_type == "image/x-portable-graymap", "height tile is " + height.content_type);
+        check(height.body.compare(0, pgm_header.size(), pgm_header) == 0, "height tile has a bad PGM header");
+        check(height.body.size() == pgm_header.size() + SIZE * SIZE * 2, "height tile has the wrong size");
+
+        for(auto layer : {"normal", "palette"}) {
+            auto color = server.handle("GET", std::string("/tiles/") + layer + "/2/-1/3?seed=5");
+            auto ppm_header = "P6\n" + size + "\n255\n";
+            check(color.status == 200, std::string(layer) + " tile failed: " + color.body);
+            check(color.content_type == "image/x-portable-pixmap", std::string(layer) + " tile is " + color.content_type);
+            check(color.body.compare(0, ppm_header.size(), ppm_header) == 0, std::string(layer) + " tile has a bad PPM header");
+            check(color.body.size() == ppm_header.size() + SIZE * SIZE * 3, std::string(layer) + " tile has the wrong size");
+        }
+    }
+
+    void check_cache(TileServer& server) {
+        auto first = server.handle("GET", "/tiles/height/0/4/4?seed=11");
+        auto second = server.handle("GET", "/tiles/height/0/4/4?seed=11");
+        auto other_layer = server.handle("GET", "/tiles/palette/0/4/4?seed=11");
+        check(first.cache == "miss", "first request for a tile was a " + first.cache);
+        check(second.cache == "hit", "repeated request for a tile was a " + second.cache);
+        check(second.body == first.body, "cached tile differs from the generated one");
+        check(other_layer.cache == "hit", "other layer of a cached tile was a " + other_layer.cache);
+
+        // The height scale is applied after the heights, other settings are
+        // tiles of their own
+        auto scaled = server.handle("GET", "/tiles/height/0/4/4?seed=11&height_scale=20");
+        auto reseeded = server.handle("GET", "/tiles/height/0/4/4?seed=12");
+        check(scaled.cache == "hit", "tile with another height scale was a " + scaled.cache);
+        check(reseeded.cache == "miss", "tile with another seed was a " + reseeded.cache);
+    }
+
+    // Two threads request a tile nobody has asked for at the same moment.
+    // Exactly one of them produces it; the other either waits for that
+    // generation or, if it came late, finds it in the cache.
+    void check_coalescing(TileServer& server) {
+        auto coalesced = 0;
+        for(auto seed = 1000; seed < 1050 && coalesced == 0; seed++) {
+            GenerationSettings settings;
+            settings.seed = seed;
+            settings.octaves = 16;
+
+            std::mutex mutex;
+            std::condition_variable ready;
+            auto waiting = 0;
+
+            std::string caches[2];
+            HeightField fields[2];
+            auto request = [&](int index) {
+                {
+                    std::unique_lock lock(mutex);
+                    waiting++;
+                    ready.notify_all();
+                    ready.wait(lock, [&] { return waiting == 2; });
+                }
+                fields[index] = server.get_heights(settings, 0, glm::ivec2(7, 7), caches[index]);
+            };
+
+            std::thread first(request, 0);
+            std::thread second(request, 1);
+            first.join();
+            second.join();
+
+            auto misses = (caches[0] == "miss") + (caches[1] == "miss");
+            check(misses == 1, "concurrent requests generated a tile " + std::to_string(misses) + " times");
+            check(caches[0] != "coalesced" || caches[1] != "coalesced", "both concurrent requests waited for each other");
+            check(fields[0].get_byte_size() == fields[1].get_byte_size()
+                && std::equal(fields[0].get_samples16(), fields[0].get_samples16() + fields[0].get_byte_size() / 2, fields[1].get_samples16()),
+                "concurrent requests got different heights");
+
+            coalesced += (caches[0] == "coalesced") + (caches[1] == "coalesced");
+        }
+        check(coalesced > 0, "no concurrent request was coalesced");
+    }
+
+    void check_metrics(TileServer& server, const int height_requests) {
+        auto metrics = server.handle("GET", "/metrics");
+        check(metrics.status == 200, "/metrics failed");
+        check(metrics.content_type.compare(0, 10, "text/plain") == 0, "/metrics is " + metrics.content_type);
+
+        auto& body = metrics.body;
+        auto requests = metric(body, "terrain_tile_requests_total{layer=\"height\"}");
+        check(requests == height_requests, "height requests counted " + std::to_string(requests) + " of " + std::to_string(height_requests));
+
+        // Buckets are cumulative and end in +Inf, which holds every request
+        auto previous = 0.0;
+        for(auto bound : TileServer::LATENCY_BUCKETS_MS) {
+            std::ostringstream name;
+            name << "terrain_tile_request_duration_ms_bucket{layer=\"height\",le=\"" << bound << "\"}";
+            auto count = metric(body, name.str());
+            check(count >= previous, name.str() + " is missing or not cumulative");
+            previous = count;
+        }
+        auto all = metric(body, "terrain_tile_request_duration_ms_bucket{layer=\"height\",le=\"+Inf\"}");
+        check(all >= previous && all == height_requests, "+Inf bucket holds " + std::to_string(all) + " of " + std::to_string(height_requests));
+        check(metric(body, "terrain_tile_request_duration_ms_count{layer=\"height\"}") == height_requests, "histogram count is off");
+
+        check(metric(body, "terrain_tile_coalesced_total") >= 1, "coalesced requests are not counted");
+        check(metric(body, "terrain_tile_cache_hits_total") >= 3, "cache hits are not counted");
+        check(metric(body, "terrain_tile_errors_total{kind=\"client\"}") >= 13, "client errors are not counted");
+        check(metric(body, "terrain_tile_errors_total{kind=\"server\"}") == 0, "server errors were counted");
+    }
+}
+
+int main() {
+    JobSystem jobs(2);
+    TileServer server(jobs, 16 * 1024 * 1024);
+
+    check_statuses(server);
+    check_formats(server);
+    check_cache(server);
+    check_coalescing(server);
+
+    // 9 bad requests, the tile with the wrong number of segments counts as
+    // other, 1 tile from check_formats and 4 from check_cache
+    check_metrics(server, 9 + 1 + 4);
+
+    if(failures > 0) {
+        std::fprintf(stderr, "%d tile server checks failed\n", failures);
+        return 1;
+    }
+    std::printf("tile server checks passed\n");
+    return 0;
+}